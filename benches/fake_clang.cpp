@@ -0,0 +1,64 @@
+// Stands in for `clang++` in Freight's self-benchmarks, so that they measure Freight's
+// own overhead instead of the compiler's. Writes a placeholder to the `-o` output (and
+// a depfile to `-MF`, if requested) and exits.
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <unistd.h>
+
+static bool write_file(const char *path, std::string_view content)
+{
+	static constexpr mode_t MODE = 0755;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, MODE);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool ok = write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size());
+	close(fd);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = nullptr;
+	const char *depfile = nullptr;
+	const char *source = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view arg {argv[i]};
+		if (arg == "-o" && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else if (arg == "-MF" && i + 1 < argc)
+		{
+			depfile = argv[++i];
+		}
+		else if (arg.ends_with(".cpp"))
+		{
+			source = argv[i];
+		}
+	}
+
+	if (output != nullptr && !write_file(output, "fake\n"))
+	{
+		return 1;
+	}
+
+	if (depfile != nullptr && output != nullptr && source != nullptr)
+	{
+		char buffer[4096];
+		int length = snprintf(buffer, sizeof(buffer), "%s: %s\n", output, source);
+		if (length < 0 || !write_file(depfile, {buffer, static_cast<std::size_t>(length)}))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,437 @@
+// Benchmarks Freight's own overhead: manifest parsing, workspace loading, target
+// inference, build planning, no-op builds, process spawning and content hashing.
+// Builds run against `fake-clang`, so compiler time doesn't drown out Freight's.
+//
+// Synthetic workspaces of 1k and 10k translation units are generated by default. Set
+// `FREIGHT_SELF_BENCH_SIZES` (e.g. `1000,10000,100000`) to choose others; 100k-TU
+// builds spawn 100k processes per iteration, so pair it with a low
+// `FREIGHT_BENCH_SAMPLES`.
+
+#include "Pch.h"
+
+#include <freight/bench.h>
+#include <map>
+#include <memory>
+
+#include "Build.h"
+#include "Support/DigestCache.h"
+#include "Support/Hash.h"
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+#include "Toml.h"
+#include "Workspace.h"
+
+namespace
+{
+constexpr std::size_t TUS_PER_BIN_TARGET = 250;
+// Sources of each `src/bin` target are spread over this many levels of directories
+constexpr std::size_t BIN_TREE_DEPTH = 4;
+// Generated manifests get one `[package.metadata]` key per this many TUs
+constexpr std::size_t TUS_PER_MANIFEST_KEY = 10;
+constexpr std::size_t PARALLEL_SPAWNS = 64;
+constexpr std::size_t HASH_BUFFER_SIZE = std::size_t {64} << 20;
+constexpr std::size_t HASH_FILE_COUNT = 256;
+constexpr std::size_t HASH_FILE_SIZE = std::size_t {1} << 20;
+
+bool size_enabled(std::size_t tus)
+{
+	static const std::vector<std::size_t> sizes = [] {
+		const char *env = std::getenv("FREIGHT_SELF_BENCH_SIZES");
+		std::string_view list = env != nullptr ? env : "1000,10000";
+
+		std::vector<std::size_t> parsed;
+		for (auto item : list | std::views::split(','))
+		{
+			parsed.push_back(std::stoull(std::string {std::string_view {item}}));
+		}
+
+		return parsed;
+	}();
+
+	return std::ranges::contains(sizes, tus);
+}
+
+void write_or_die(const std::filesystem::path& file, std::string_view content)
+{
+	if (!io::write_file(file, content))
+	{
+		bail("failed to write `{}`", file.string());
+	}
+}
+
+void generate_workspace(const std::filesystem::path& root, std::size_t tus)
+{
+	using namespace std::filesystem;
+
+	remove_all(root);
+	create_directories(root / "src" / "bin");
+
+	std::string manifest =
+		"[package]\n"
+		"name = \"bench\"\n"
+		"version = \"0.1.0\"\n"
+		"standard = \"23\"\n"
+		"\n"
+		"[package.metadata.generated]\n";
+	for (std::size_t i = 0; i < tus / TUS_PER_MANIFEST_KEY; i++)
+	{
+		manifest += std::format("key_{0} = {{ name = \"value_{0}\", index = {0} }}\n", i);
+	}
+	write_or_die(root / "Freight.toml", manifest);
+	write_or_die(root / "src" / "main.cpp", "int main() {}\n");
+
+	std::size_t targets = std::max<std::size_t>(1, tus / TUS_PER_BIN_TARGET);
+	for (std::size_t target = 0; target < targets; target++)
+	{
+		auto targetDir = root / "src" / "bin" / std::format("tool_{}", target);
+		create_directories(targetDir);
+		write_or_die(targetDir / "main.cpp", "int main() {}\n");
+
+		for (std::size_t unit = 1; unit < tus / targets; unit++)
+		{
+			auto dir = targetDir;
+			for (std::size_t level = 0; level < unit % (BIN_TREE_DEPTH + 1); level++)
+			{
+				dir /= std::format("level_{}", level);
+			}
+
+			create_directories(dir);
+			write_or_die(dir / std::format("unit_{}.cpp", unit),
+				std::format("int unit_{}() {{ return {}; }}\n", unit, unit));
+		}
+	}
+}
+
+struct Fixture
+{
+	std::filesystem::path root;
+	std::filesystem::path manifest;
+	GlobalContext gctx;
+	Profile profile = Profile::dev();
+
+	explicit Fixture(std::filesystem::path root)
+		: root {root},
+		  manifest {root / "Freight.toml"},
+		  gctx {root}
+	{
+		gctx.set_clang_path(FREIGHT_FAKE_CLANG);
+	}
+
+	Build build(const Workspace& ws) const
+	{
+		Build ctx {
+			.gctx = &gctx,
+			.workspace = &ws,
+			.roots = {},
+			.dependencies = {},
+			.prebuilt = {},
+			.featureDefines = {},
+			.scriptOutputs = {},
+			.jobs = jobs::Scheduler::default_jobs(),
+		};
+
+		for (auto& target : ws.current().targets())
+		{
+			ctx.roots.push_back({&ws.current(), &target, &profile});
+		}
+
+		return ctx;
+	}
+
+	CompileOptions compile_options(const Workspace& ws) const
+	{
+		return {
+			.debugLevel = profile.debug,
+			.optLevel = profile.optLevel,
+			.standard = ws.current().standard(),
+			.includeDirs = {},
+			.defines = {},
+		};
+	}
+};
+
+Fixture& fixture(std::size_t tus)
+{
+	static std::map<std::size_t, std::unique_ptr<Fixture>> fixtures;
+
+	auto& fixture = fixtures[tus];
+	if (!fixture)
+	{
+		auto root = std::filesystem::temp_directory_path() / "freight-self-bench" /
+					std::to_string(tus);
+		generate_workspace(root, tus);
+		fixture = std::make_unique<Fixture>(root);
+	}
+
+	return *fixture;
+}
+
+template<std::size_t TUs> void bench_manifest_parse(freight::bench::Bencher& b)
+{
+	if (!size_enabled(TUs))
+	{
+		return;
+	}
+
+	auto& f = fixture(TUs);
+	b.iter([&] { freight::bench::black_box(serialize_toml(f.manifest)); });
+}
+
+template<std::size_t TUs> void bench_read_manifest(freight::bench::Bencher& b)
+{
+	if (!size_enabled(TUs))
+	{
+		return;
+	}
+
+	auto& f = fixture(TUs);
+	b.iter([&] { freight::bench::black_box(read_manifest(f.gctx, f.manifest)); });
+}
+
+template<std::size_t TUs> void bench_workspace_open(freight::bench::Bencher& b)
+{
+	if (!size_enabled(TUs))
+	{
+		return;
+	}
+
+	auto& f = fixture(TUs);
+	b.iter([&] {
+		Workspace ws {f.manifest, f.gctx};
+		freight::bench::black_box(ws.current());
+	});
+}
+
+template<std::size_t TUs> void bench_target_inference(freight::bench::Bencher& b)
+{
+	if (!size_enabled(TUs))
+	{
+		return;
+	}
+
+	auto& f = fixture(TUs);
+	b.iter([&] { freight::bench::black_box(infer_targets(f.root, "bench")); });
+}
+
+template<std::size_t TUs> void bench_build_plan(freight::bench::Bencher& b)
+{
+	if (!size_enabled(TUs))
+	{
+		return;
+	}
+
+	auto& f = fixture(TUs);
+	Workspace ws {f.manifest, f.gctx};
+	auto ctx = f.build(ws);
+	auto opts = f.compile_options(ws);
+
+	b.iter([&] {
+		BuildPlan plan {ctx, opts};
+		freight::bench::black_box(plan.job_count());
+	});
+}
+
+template<std::size_t TUs> void bench_noop_build(freight::bench::Bencher& b)
+{
+	if (!size_enabled(TUs))
+	{
+		return;
+	}
+
+	auto& f = fixture(TUs);
+	Workspace ws {f.manifest, f.gctx};
+	auto ctx = f.build(ws);
+	auto opts = f.compile_options(ws);
+
+	// Everything after the first build should be up to date
+	compile(ctx, opts);
+
+	b.iter([&] { freight::bench::black_box(compile(ctx, opts)); });
+}
+
+std::vector<std::byte> hash_input(std::size_t size)
+{
+	std::vector<std::byte> buffer(size);
+	for (std::size_t i = 0; i < buffer.size(); i++)
+	{
+		buffer[i] = static_cast<std::byte>(i * 31);
+	}
+
+	return buffer;
+}
+
+/**
+ * Bails unless `kernel` computes reference XXH3-64 digests, of prefixes of
+ * `hash_input` whose lengths sit around the 16, 128 and 240 byte paths, the 64-byte
+ * stripes and the 1 KiB blocks. Every fingerprint would change otherwise.
+ */
+void verify_kernel(hash::Kernel kernel)
+{
+	static constexpr std::array<std::pair<std::size_t, hash::Digest>, 22> VECTORS {{
+		{0, 0x2d06800538d394c2},
+		{1, 0xc44bdff4074eecdb},
+		{3, 0x3698b80191e625f9},
+		{4, 0x2e4ac2f1c52157fc},
+		{8, 0x60e1baa91347a1f2},
+		{9, 0x9c88fc32c37b56cb},
+		{16, 0xf9fbd0260ba978df},
+		{17, 0xc56f339d36cc73d7},
+		{64, 0xef5426b31747db78},
+		{128, 0x31ccf8dec850d035},
+		{129, 0xc72af4c6ac4dea94},
+		{240, 0xe315d53d5129eede},
+		{241, 0x18773c512b008a63},
+		{255, 0x947de0ba95c5ed6b},
+		{256, 0xcdd3578b9df45e59},
+		{1023, 0xd4f791cf4e47520c},
+		{1024, 0x4986ea1c273817c6},
+		{1025, 0x7775793e9ae60f68},
+		{2048, 0xae9fe389b636a6c4},
+		{4099, 0x05b1e5d8591f6114},
+		{5000, 0x60b1c0ae31e84fef},
+		{16385, 0x3a5a1822826726fd},
+	}};
+
+	auto input = hash_input(VECTORS.back().first);
+	for (auto [length, expected] : VECTORS)
+	{
+		auto digest = hash::hash_bytes(std::span {input}.first(length), kernel);
+		if (digest != expected)
+		{
+			bail("the {} kernel hashes {} bytes to {}, but XXH3-64 gives {}",
+				hash::kernel_name(kernel),
+				length,
+				hash::to_hex(digest),
+				hash::to_hex(expected));
+		}
+	}
+}
+
+void bench_hash_bytes(freight::bench::Bencher& b, hash::Kernel kernel)
+{
+	if (!std::ranges::contains(hash::supported_kernels(), kernel))
+	{
+		return;
+	}
+
+	// A fast kernel computing the wrong digests is no use
+	verify_kernel(kernel);
+
+	auto buffer = hash_input(HASH_BUFFER_SIZE);
+
+	b.bytes(buffer.size());
+	b.iter([&] { freight::bench::black_box(hash::hash_bytes(buffer, kernel)); });
+}
+
+/**
+ * Files old enough for `DigestCache` to memoize.
+ */
+const std::vector<std::filesystem::path>& hash_fixture()
+{
+	static const std::vector<std::filesystem::path> files = [] {
+		using namespace std::filesystem;
+
+		auto root = temp_directory_path() / "freight-self-bench" / "hash";
+		remove_all(root);
+		create_directories(root);
+
+		std::vector<path> files;
+		std::string content(HASH_FILE_SIZE, '\0');
+		for (std::size_t i = 0; i < HASH_FILE_COUNT; i++)
+		{
+			std::ranges::fill(content, static_cast<char>(i));
+			auto file = root / std::format("file_{}.bin", i);
+			write_or_die(file, content);
+			last_write_time(file, file_time_type::clock::now() - std::chrono::hours {1});
+			files.push_back(std::move(file));
+		}
+
+		return files;
+	}();
+
+	return files;
+}
+} // namespace
+
+#define SELF_BENCH_SIZES(name)                                                           \
+	FREIGHT_BENCH(name##_1k)                                                             \
+	{                                                                                    \
+		bench_##name<1'000>(b);                                                          \
+	}                                                                                    \
+	FREIGHT_BENCH(name##_10k)                                                            \
+	{                                                                                    \
+		bench_##name<10'000>(b);                                                         \
+	}                                                                                    \
+	FREIGHT_BENCH(name##_100k)                                                           \
+	{                                                                                    \
+		bench_##name<100'000>(b);                                                        \
+	}
+
+SELF_BENCH_SIZES(manifest_parse)
+SELF_BENCH_SIZES(read_manifest)
+SELF_BENCH_SIZES(workspace_open)
+SELF_BENCH_SIZES(target_inference)
+SELF_BENCH_SIZES(build_plan)
+SELF_BENCH_SIZES(noop_build)
+
+FREIGHT_BENCH(process_spawn)
+{
+	ProcessBuilder pb {FREIGHT_FAKE_CLANG};
+	b.iter([&] { freight::bench::black_box(pb.start()); });
+}
+
+FREIGHT_BENCH(process_spawn_parallel)
+{
+	ProcessBuilder pb {FREIGHT_FAKE_CLANG};
+	b.iter([&] {
+		jobs::Scheduler scheduler;
+		for (std::size_t i = 0; i < PARALLEL_SPAWNS; i++)
+		{
+			scheduler.add([&pb] { return pb.start() == 0; });
+		}
+
+		freight::bench::black_box(scheduler.run());
+	});
+}
+
+FREIGHT_BENCH(hash_bytes_scalar)
+{
+	bench_hash_bytes(b, hash::Kernel::Scalar);
+}
+
+FREIGHT_BENCH(hash_bytes_sse2)
+{
+	bench_hash_bytes(b, hash::Kernel::Sse2);
+}
+
+FREIGHT_BENCH(hash_bytes_avx2)
+{
+	bench_hash_bytes(b, hash::Kernel::Avx2);
+}
+
+FREIGHT_BENCH(hash_bytes_avx512)
+{
+	bench_hash_bytes(b, hash::Kernel::Avx512);
+}
+
+FREIGHT_BENCH(hash_files_parallel)
+{
+	auto& files = hash_fixture();
+	b.bytes(files.size() * HASH_FILE_SIZE);
+	auto threads = jobs::Scheduler::default_jobs();
+	b.iter([&] { freight::bench::black_box(hash::hash_files(files, threads)); });
+}
+
+FREIGHT_BENCH(hash_files_memoized)
+{
+	auto& files = hash_fixture();
+	auto memo = std::filesystem::temp_directory_path() / "freight-self-bench" / "digests";
+	std::filesystem::remove(memo);
+
+	hash::DigestCache cache {memo};
+	b.bytes(files.size() * HASH_FILE_SIZE);
+	auto threads = jobs::Scheduler::default_jobs();
+	b.iter([&] { freight::bench::black_box(cache.hash_files(files, threads)); });
+}
+
+FREIGHT_BENCH_MAIN()
@@ -0,0 +1,314 @@
+#pragma once
+
+/**
+ * Freight's benchmark harness. Include it from the sources of a target in `benches/`,
+ * register benchmarks with `FREIGHT_BENCH`, and expand `FREIGHT_BENCH_MAIN()` in
+ * exactly one source file of the target:
+ *
+ *     #include <freight/bench.h>
+ *
+ *     FREIGHT_BENCH(vector_push_back)
+ *     {
+ *         b.iter([] {
+ *             std::vector<int> v;
+ *             for (int i = 0; i < 1000; i++)
+ *                 v.push_back(i);
+ *             freight::bench::black_box(v);
+ *         });
+ *     }
+ *
+ *     FREIGHT_BENCH_MAIN()
+ *
+ * Running a bench binary directly prints a short summary. `freight bench` runs it with
+ * `FREIGHT_BENCH_FORMAT=json`, collects the raw samples and does the statistics and
+ * baseline comparisons itself.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+namespace freight::bench
+{
+struct Config
+{
+	// Number of samples to take per benchmark
+	std::size_t samples = 50;
+	// How long to run the routine before measuring
+	std::chrono::nanoseconds warmup = std::chrono::milliseconds {500};
+	// Roughly how long to spend measuring, spread over all samples
+	std::chrono::nanoseconds measurement = std::chrono::seconds {2};
+};
+
+struct Sample
+{
+	std::uint64_t iterations;
+	// Total time taken by all iterations of the sample
+	std::uint64_t nanoseconds;
+};
+
+/**
+ * Prevents the compiler from optimizing away the computation of `value`.
+ */
+template<class T> inline void black_box(T&& value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+class Bencher
+{
+public:
+	explicit Bencher(const Config& config) : config_ {config}
+	{
+	}
+
+	/**
+	 * Measures `routine`. Should be called exactly once per benchmark.
+	 */
+	template<class F> void iter(F&& routine)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		// Warm up with exponentially growing batches, which also gives an estimate of
+		// the time per iteration
+		static constexpr std::uint64_t MAX_WARMUP_BATCH = std::uint64_t {1} << 30;
+		std::uint64_t batch = 1;
+		std::uint64_t warmupIterations = 0;
+		std::uint64_t warmupNanoseconds = 0;
+		auto warmupStart = Clock::now();
+		do
+		{
+			warmupNanoseconds += time_batch(routine, batch);
+			warmupIterations += batch;
+			batch = std::min(batch * 2, MAX_WARMUP_BATCH);
+		} while (Clock::now() - warmupStart < config_.warmup);
+
+		double nanosecondsPerIteration =
+			std::max(1.0, static_cast<double>(warmupNanoseconds) / warmupIterations);
+		double sampleNanoseconds =
+			static_cast<double>(config_.measurement.count()) / config_.samples;
+		auto iterations = static_cast<std::uint64_t>(
+			std::max(1.0, sampleNanoseconds / nanosecondsPerIteration));
+
+		samples_.clear();
+		for (std::size_t i = 0; i < config_.samples; i++)
+		{
+			samples_.push_back({iterations, time_batch(routine, iterations)});
+		}
+	}
+
+	/**
+	 * Reports throughput alongside time, for routines that process `bytes` bytes per
+	 * iteration.
+	 */
+	void bytes(std::uint64_t bytes)
+	{
+		bytes_ = bytes;
+	}
+
+	const std::vector<Sample>& samples() const
+	{
+		return samples_;
+	}
+
+	std::uint64_t bytes_per_iteration() const
+	{
+		return bytes_;
+	}
+private:
+	Config config_;
+	std::vector<Sample> samples_;
+	std::uint64_t bytes_ = 0;
+
+	template<class F> static std::uint64_t time_batch(F& routine, std::uint64_t iterations)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		auto start = Clock::now();
+		for (std::uint64_t i = 0; i < iterations; i++)
+		{
+			routine();
+		}
+		auto end = Clock::now();
+
+		return static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+};
+
+using BenchFn = void (*)(Bencher&);
+
+struct Benchmark
+{
+	const char *name;
+	BenchFn function;
+};
+
+inline std::vector<Benchmark>& registry()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+struct Registrar
+{
+	Registrar(const char *name, BenchFn function)
+	{
+		registry().push_back({name, function});
+	}
+};
+
+namespace detail
+{
+	inline std::size_t env_number(const char *name, std::size_t fallback)
+	{
+		const char *value = std::getenv(name);
+		if (value == nullptr)
+		{
+			return fallback;
+		}
+
+		char *end = nullptr;
+		auto number = std::strtoull(value, &end, 10);
+		return end != value && *end == '\0' ? number : fallback;
+	}
+
+	inline Config config_from_env()
+	{
+		Config config;
+		config.samples = std::max<std::size_t>(
+			2, env_number("FREIGHT_BENCH_SAMPLES", config.samples));
+		config.warmup = std::chrono::milliseconds {env_number("FREIGHT_BENCH_WARMUP_MS",
+			std::chrono::duration_cast<std::chrono::milliseconds>(config.warmup).count())};
+		config.measurement = std::chrono::milliseconds {env_number(
+			"FREIGHT_BENCH_MEASUREMENT_MS",
+			std::chrono::duration_cast<std::chrono::milliseconds>(config.measurement)
+				.count())};
+		return config;
+	}
+
+	inline bool matches_filters(std::string_view name, int argc, char **argv)
+	{
+		if (argc <= 1)
+		{
+			return true;
+		}
+
+		for (int i = 1; i < argc; i++)
+		{
+			if (name.find(argv[i]) != std::string_view::npos)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	inline void print_json(const char *name,
+		const std::vector<Sample>& samples,
+		std::uint64_t bytes)
+	{
+		std::printf("{\"name\":\"%s\",\"iters\":[", name);
+		for (std::size_t i = 0; i < samples.size(); i++)
+		{
+			std::printf("%s%llu",
+				i == 0 ? "" : ",",
+				static_cast<unsigned long long>(samples[i].iterations));
+		}
+
+		std::printf("],\"times\":[");
+		for (std::size_t i = 0; i < samples.size(); i++)
+		{
+			std::printf("%s%llu",
+				i == 0 ? "" : ",",
+				static_cast<unsigned long long>(samples[i].nanoseconds));
+		}
+
+		std::printf("]");
+		if (bytes > 0)
+		{
+			std::printf(",\"bytes\":%llu", static_cast<unsigned long long>(bytes));
+		}
+
+		std::printf("}\n");
+	}
+
+	inline void print_summary(const char *name,
+		const std::vector<Sample>& samples,
+		std::uint64_t bytes)
+	{
+		std::vector<double> times;
+		for (auto& sample : samples)
+		{
+			times.push_back(static_cast<double>(sample.nanoseconds) / sample.iterations);
+		}
+
+		std::ranges::sort(times);
+		double median = times[times.size() / 2];
+		std::printf("%-40s median %12.2f ns/iter (%zu samples)", name, median, times.size());
+		if (bytes > 0)
+		{
+			std::printf(" %8.2f GB/s", static_cast<double>(bytes) / median);
+		}
+
+		std::printf("\n");
+	}
+} // namespace detail
+
+inline int run_main(int argc, char **argv)
+{
+	Config config = detail::config_from_env();
+	const char *format = std::getenv("FREIGHT_BENCH_FORMAT");
+	bool json = format != nullptr && std::string_view {format} == "json";
+
+	for (auto& benchmark : registry())
+	{
+		if (!detail::matches_filters(benchmark.name, argc, argv))
+		{
+			continue;
+		}
+
+		Bencher bencher {config};
+		benchmark.function(bencher);
+		if (bencher.samples().empty())
+		{
+			continue;
+		}
+
+		if (json)
+		{
+			detail::print_json(benchmark.name,
+				bencher.samples(),
+				bencher.bytes_per_iteration());
+		}
+		else
+		{
+			detail::print_summary(benchmark.name,
+				bencher.samples(),
+				bencher.bytes_per_iteration());
+		}
+
+		std::fflush(stdout);
+	}
+
+	return 0;
+}
+} // namespace freight::bench
+
+#define FREIGHT_BENCH(name)                                                              \
+	static void freight_bench_##name(::freight::bench::Bencher& b);                      \
+	static const ::freight::bench::Registrar freight_bench_registrar_##name {           \
+		#name, &freight_bench_##name};                                                   \
+	static void freight_bench_##name([[maybe_unused]] ::freight::bench::Bencher& b)
+
+#define FREIGHT_BENCH_MAIN()                                                             \
+	int main(int argc, char **argv)                                                      \
+	{                                                                                    \
+		return ::freight::bench::run_main(argc, argv);                                   \
+	}
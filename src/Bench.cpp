@@ -0,0 +1,537 @@
+#include "Pch.h"
+
+#include <cmath>
+#include <filesystem>
+#include <numbers>
+#include <numeric>
+#include <sched.h>
+#include <vector>
+
+#include "Build.h"
+#include "Cmds.h"
+#include "Support/Io.h"
+#include "Support/Json.h"
+#include "Support/Util.h"
+#include "Workspace.h"
+
+// Generated by CMake from `include/freight/bench.h`
+std::string_view bench_harness_source();
+
+// Scales the MAD so it estimates the standard deviation of normally distributed data
+static constexpr double MAD_SCALE = 1.4826;
+// Samples with a modified z-score above this are outliers (Iglewicz and Hoaglin)
+static constexpr double OUTLIER_Z_SCORE = 3.5;
+static constexpr double SIGNIFICANCE_LEVEL = 0.05;
+// Changes in the median smaller than this are treated as noise, even if significant
+static constexpr double NOISE_THRESHOLD = 0.02;
+
+std::filesystem::path install_bench_harness(const Workspace& ws)
+{
+	auto includeDir = ws.target_dir() / "freight" / "include";
+	auto header = includeDir / "freight" / "bench.h";
+	auto source = bench_harness_source();
+
+	// Only rewrite the header if it changed, so its mtime stays stable between builds
+	if (io::read_file(header) != source)
+	{
+		std::error_code err;
+		std::filesystem::create_directories(header.parent_path(), err);
+		if (err || !io::write_file_atomic(header, source))
+		{
+			bail("failed to write benchmark harness to `{}`", header.string());
+		}
+	}
+
+	return includeDir;
+}
+
+struct Samples
+{
+	std::vector<double> iterations;
+	// Total nanoseconds taken by each sample
+	std::vector<double> times;
+
+	std::vector<double> per_iteration() const
+	{
+		std::vector<double> values;
+		for (std::size_t i = 0; i < times.size(); i++)
+		{
+			values.push_back(times[i] / iterations[i]);
+		}
+
+		return values;
+	}
+};
+
+struct BenchResult
+{
+	std::string name;
+	Samples samples;
+	// Bytes processed per iteration, or 0 if the benchmark doesn't report throughput
+	std::uint64_t bytes = 0;
+};
+
+struct Estimates
+{
+	double median;
+	// Median absolute deviation, scaled by `MAD_SCALE`
+	double mad;
+	double mean;
+	std::size_t outliers;
+};
+
+static double median_of(std::vector<double> values)
+{
+	std::ranges::sort(values);
+	auto n = values.size();
+	return n % 2 == 1 ? values[n / 2] : (values[(n / 2) - 1] + values[n / 2]) / 2;
+}
+
+static Estimates estimate(const std::vector<double>& values)
+{
+	double median = median_of(values);
+
+	std::vector<double> deviations;
+	for (double value : values)
+	{
+		deviations.push_back(std::abs(value - median));
+	}
+
+	double rawMad = median_of(deviations);
+
+	std::size_t outliers = 0;
+	if (rawMad > 0)
+	{
+		static constexpr double Z_SCORE_SCALE = 0.6745;
+		outliers = std::ranges::count_if(values, [&](double value) {
+			return std::abs(Z_SCORE_SCALE * (value - median) / rawMad) > OUTLIER_Z_SCORE;
+		});
+	}
+
+	return {
+		.median = median,
+		.mad = rawMad * MAD_SCALE,
+		.mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size(),
+		.outliers = outliers,
+	};
+}
+
+/**
+ * Two-sided p-value of the Mann-Whitney U test, using the normal approximation with a
+ * correction for ties. Unlike a t-test it doesn't assume the samples are normally
+ * distributed, which timings rarely are.
+ */
+static double mann_whitney_p_value(const std::vector<double>& a, const std::vector<double>& b)
+{
+	std::vector<std::pair<double, bool>> all;
+	for (double value : a)
+	{
+		all.emplace_back(value, true);
+	}
+	for (double value : b)
+	{
+		all.emplace_back(value, false);
+	}
+
+	std::ranges::sort(all, {}, &std::pair<double, bool>::first);
+
+	double n1 = a.size();
+	double n2 = b.size();
+	double n = n1 + n2;
+	double rankSumA = 0;
+	double tieCorrection = 0;
+	for (std::size_t i = 0; i < all.size();)
+	{
+		std::size_t j = i;
+		while (j < all.size() && all[j].first == all[i].first)
+		{
+			j++;
+		}
+
+		// Tied values all get the average of the ranks they span
+		double rank = (static_cast<double>(i + 1) + static_cast<double>(j)) / 2;
+		for (std::size_t k = i; k < j; k++)
+		{
+			rankSumA += all[k].second ? rank : 0;
+		}
+
+		double ties = static_cast<double>(j - i);
+		tieCorrection += (ties * ties * ties) - ties;
+		i = j;
+	}
+
+	double u = rankSumA - (n1 * (n1 + 1) / 2);
+	double mean = n1 * n2 / 2;
+	double variance = n1 * n2 / 12 * ((n + 1) - (tieCorrection / (n * (n - 1))));
+	if (variance <= 0)
+	{
+		return 1;
+	}
+
+	double z = std::max(0.0, std::abs(u - mean) - 0.5) / std::sqrt(variance);
+	return std::erfc(z / std::numbers::sqrt2);
+}
+
+static std::string format_duration(double nanoseconds)
+{
+	static constexpr double THOUSAND = 1000;
+
+	if (nanoseconds < THOUSAND)
+	{
+		return std::format("{:.3f} ns", nanoseconds);
+	}
+	else if (nanoseconds < THOUSAND * THOUSAND)
+	{
+		return std::format("{:.3f} µs", nanoseconds / THOUSAND);
+	}
+	else if (nanoseconds < THOUSAND * THOUSAND * THOUSAND)
+	{
+		return std::format("{:.3f} ms", nanoseconds / (THOUSAND * THOUSAND));
+	}
+
+	return std::format("{:.3f} s", nanoseconds / (THOUSAND * THOUSAND * THOUSAND));
+}
+
+static std::optional<Samples> samples_from_json(const json::Value& value)
+{
+	auto *iterations = value.find("iters") ? value.find("iters")->as_array() : nullptr;
+	auto *times = value.find("times") ? value.find("times")->as_array() : nullptr;
+	if (iterations == nullptr || times == nullptr || iterations->size() != times->size() ||
+		times->empty())
+	{
+		return {};
+	}
+
+	Samples samples;
+	for (std::size_t i = 0; i < times->size(); i++)
+	{
+		auto *iteration = (*iterations)[i].as_number();
+		auto *time = (*times)[i].as_number();
+		if (iteration == nullptr || time == nullptr || *iteration <= 0)
+		{
+			return {};
+		}
+
+		samples.iterations.push_back(*iteration);
+		samples.times.push_back(*time);
+	}
+
+	return samples;
+}
+
+/**
+ * Parses the JSON lines a bench binary prints when run with `FREIGHT_BENCH_FORMAT=json`.
+ * Anything else the benchmarks print is ignored.
+ */
+static std::vector<BenchResult> parse_bench_output(std::string_view output)
+{
+	std::vector<BenchResult> results;
+	for (auto lineRange : output | std::views::split('\n'))
+	{
+		std::string_view line {lineRange};
+		if (!line.starts_with('{'))
+		{
+			continue;
+		}
+
+		auto value = json::parse(line);
+		if (!value || !value->find("name") || !value->find("name")->as_string())
+		{
+			continue;
+		}
+
+		if (auto samples = samples_from_json(*value))
+		{
+			auto *bytes = value->find("bytes") ? value->find("bytes")->as_number()
+											   : nullptr;
+			results.push_back({
+				.name = *value->find("name")->as_string(),
+				.samples = std::move(*samples),
+				.bytes = bytes != nullptr && *bytes > 0
+							 ? static_cast<std::uint64_t>(*bytes)
+							 : 0,
+			});
+		}
+	}
+
+	return results;
+}
+
+static std::optional<Samples> load_baseline(const std::filesystem::path& dir)
+{
+	auto text = io::read_file(dir / "sample.json");
+	if (!text)
+	{
+		return {};
+	}
+
+	auto value = json::parse(*text);
+	return value ? samples_from_json(*value) : std::nullopt;
+}
+
+static bool save_results(const std::filesystem::path& dir,
+	const std::string& target,
+	const BenchResult& result,
+	const Estimates& estimates)
+{
+	std::error_code err;
+	std::filesystem::create_directories(dir, err);
+	if (err)
+	{
+		return false;
+	}
+
+	auto toArray = [](const std::vector<double>& values) {
+		return json::Array(values.begin(), values.end());
+	};
+
+	json::Value sample {json::Object {
+		{"sampling_mode", "Flat"},
+		{"iters", toArray(result.samples.iterations)},
+		{"times", toArray(result.samples.times)},
+	}};
+
+	auto pointEstimate = [](double value) {
+		return json::Value {json::Object {{"point_estimate", value}}};
+	};
+
+	json::Value estimatesJson {json::Object {
+		{"mean", pointEstimate(estimates.mean)},
+		{"median", pointEstimate(estimates.median)},
+		{"median_abs_dev", pointEstimate(estimates.mad)},
+	}};
+
+	json::Object benchmark {
+		{"group_id", target},
+		{"function_id", result.name},
+		{"full_id", std::format("{}/{}", target, result.name)},
+		{"outliers", estimates.outliers},
+	};
+	if (result.bytes > 0)
+	{
+		benchmark.emplace_back("throughput", json::Object {{"Bytes", result.bytes}});
+	}
+
+	return io::write_file_atomic(dir / "sample.json", json::to_string(sample, true)) &&
+		   io::write_file_atomic(dir / "estimates.json",
+			   json::to_string(estimatesJson, true)) &&
+		   io::write_file_atomic(dir / "benchmark.json",
+			   json::to_string(json::Value {std::move(benchmark)}, true));
+}
+
+/**
+ * The highest-numbered CPU this process may run on. CPU 0 tends to handle most
+ * interrupts, so the last one is usually the quietest.
+ */
+static std::optional<int> default_bench_cpu()
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == -1)
+	{
+		return {};
+	}
+
+	for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--)
+	{
+		if (CPU_ISSET(cpu, &set))
+		{
+			return cpu;
+		}
+	}
+
+	return {};
+}
+
+/**
+ * Where the results of bench `target` are stored. Builds for another platform or of
+ * an instrumented variant keep theirs apart, under their subdirectory of `target/`.
+ */
+static std::filesystem::path results_dir(const Workspace& ws,
+	const Profile& profile,
+	const std::string& target)
+{
+	auto dir = ws.target_dir() / "criterion";
+	if (profile.platform || !profile.variant.name().empty())
+	{
+		dir /= profile.target_subdir;
+	}
+
+	return dir / target;
+}
+
+enum class BenchVerdict
+{
+	NoBaseline,
+	NoChange,
+	Improved,
+	Regressed,
+};
+
+static BenchVerdict report_result(const std::string& target,
+	const BenchResult& result,
+	const Estimates& estimates,
+	const std::optional<Samples>& baseline)
+{
+	static constexpr double PERCENT = 100;
+
+	print_status("Benchmark", "{}/{}", target, result.name);
+	std::println("             time:     [{} ± {}] (median ± MAD)",
+		format_duration(estimates.median),
+		format_duration(estimates.mad));
+
+	if (result.bytes > 0)
+	{
+		// Bytes per nanosecond are gigabytes per second
+		std::println("             thrpt:    [{:.3f} GB/s]",
+			static_cast<double>(result.bytes) / estimates.median);
+	}
+
+	auto sampleCount = result.samples.times.size();
+	if (estimates.outliers > 0)
+	{
+		std::println("             outliers: {} of {} samples ({:.2f}%)",
+			estimates.outliers,
+			sampleCount,
+			PERCENT * static_cast<double>(estimates.outliers) / sampleCount);
+	}
+
+	if (!baseline)
+	{
+		return BenchVerdict::NoBaseline;
+	}
+
+	auto current = result.samples.per_iteration();
+	auto previous = baseline->per_iteration();
+	double previousMedian = median_of(previous);
+	double change = (estimates.median - previousMedian) / previousMedian;
+	double pValue = mann_whitney_p_value(current, previous);
+
+	BenchVerdict verdict = BenchVerdict::NoChange;
+	std::string_view description = "No change in performance detected.";
+	if (pValue < SIGNIFICANCE_LEVEL && change > NOISE_THRESHOLD)
+	{
+		verdict = BenchVerdict::Regressed;
+		description = "\033[31mPerformance has regressed.\033[39m";
+	}
+	else if (pValue < SIGNIFICANCE_LEVEL && change < -NOISE_THRESHOLD)
+	{
+		verdict = BenchVerdict::Improved;
+		description = "\033[32mPerformance has improved.\033[39m";
+	}
+
+	std::println("             change:   {:+.2f}% (p = {:.4f}) {}",
+		PERCENT * change,
+		pValue,
+		description);
+	return verdict;
+}
+
+void exec_bench(const BenchOptions& opts)
+{
+	using namespace std::filesystem;
+
+	auto cwd = current_path();
+	GlobalContext gctx {cwd};
+	Workspace ws {cwd / "Freight.toml", gctx};
+	auto& package = ws.current();
+
+	// Every bench runs once per variant and platform
+	auto& buildOpts = opts.build_opts;
+	auto buildCount = std::max<std::size_t>(buildOpts.variants.size(), 1) *
+					  std::max<std::size_t>(buildOpts.targets.size(), 1);
+	auto compilation = build_package(ws, package, buildOpts, TargetKind::Bench);
+	auto benchCount = std::ranges::count(package.targets(), TargetKind::Bench, &Target::kind);
+	if (compilation.binaries.size() != static_cast<std::size_t>(benchCount) * buildCount)
+	{
+		bail("could not compile benchmarks for `{}`", package.name());
+	}
+
+	auto cpu = opts.cpu ? opts.cpu : default_bench_cpu();
+	auto compareName = opts.baseline.value_or("base");
+	// Like criterion, comparing against a named baseline doesn't overwrite it
+	std::optional<std::string> saveName = opts.save_baseline;
+	if (!opts.baseline && !saveName)
+	{
+		saveName = "base";
+	}
+
+	std::size_t failures = 0;
+	std::size_t regressions = 0;
+	for (std::size_t i = 0; i < compilation.binaries.size(); i++)
+	{
+		auto& binary = compilation.binaries[i];
+		auto& profile = compilation.binaryProfiles[i];
+		auto name = binary.filename().string();
+		auto outputFile = binary.parent_path() / (name + ".out");
+		auto target = name + describe_build(profile, false);
+
+		ProcessBuilder pb {binary};
+		pb.set_env("FREIGHT_BENCH_FORMAT", "json");
+		if (opts.samples)
+		{
+			pb.set_env("FREIGHT_BENCH_SAMPLES", std::to_string(*opts.samples));
+		}
+
+		if (cpu)
+		{
+			pb.set_cpu_affinity(*cpu);
+		}
+
+		for (auto& filter : opts.filters)
+		{
+			pb.add_arg(filter);
+		}
+
+		pb.set_output_file(outputFile);
+
+		print_status("  Running",
+			"`{}`{}",
+			relative(binary, gctx.cwd()).string(),
+			cpu ? std::format(" (pinned to CPU {})", *cpu) : "");
+
+		int exitCode = pb.start();
+		auto output = io::read_file(outputFile).value_or("");
+		if (exitCode != 0)
+		{
+			print_error("bench `{}` failed with exit code {}\n{}", target, exitCode, output);
+			failures++;
+			continue;
+		}
+
+		for (auto& result : parse_bench_output(output))
+		{
+			auto resultDir = results_dir(ws, profile, name) / result.name;
+			auto estimates = estimate(result.samples.per_iteration());
+			auto baseline = load_baseline(resultDir / compareName);
+
+			if (report_result(target, result, estimates, baseline) == BenchVerdict::Regressed)
+			{
+				regressions++;
+			}
+
+			bool saved = save_results(resultDir / "new", target, result, estimates);
+			if (saveName)
+			{
+				saved = saved && save_results(resultDir / *saveName, target, result, estimates);
+			}
+
+			if (!saved)
+			{
+				print_error("failed to save results to `{}`", resultDir.string());
+			}
+		}
+	}
+
+	if (failures > 0)
+	{
+		bail("{} bench target(s) failed", failures);
+	}
+
+	if (opts.baseline && regressions > 0)
+	{
+		bail("{} benchmark(s) regressed compared to baseline `{}`",
+			regressions,
+			*opts.baseline);
+	}
+}
@@ -0,0 +1,2164 @@
+#include "Pch.h"
+
+#include "Build.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#include "BuildScript.h"
+#include "Depfile.h"
+#include "Features.h"
+#include "Fingerprint.h"
+#include "Lockfile.h"
+#include "Registry.h"
+#include "Support/DigestCache.h"
+#include "Support/Hash.h"
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+#include "Support/Json.h"
+#include "Support/Util.h"
+#include "TimeTrace.h"
+#include "Workspace.h"
+
+static std::vector<std::filesystem::path> expand_linear_paths(
+	std::span<const std::filesystem::path> paths)
+{
+	using namespace std::filesystem;
+
+	std::vector<std::filesystem::path> files;
+
+	for (auto& path : paths)
+	{
+		if (is_regular_file(path))
+		{
+			files.push_back(path);
+		}
+		else if (is_directory(path))
+		{
+			// Directories are listed in no particular order, but link order has to be
+			// stable for builds to be reproducible
+			auto first = files.size();
+			for (auto& file : recursive_directory_iterator {path})
+			{
+				files.push_back(file);
+			}
+
+			std::sort(files.begin() + static_cast<std::ptrdiff_t>(first), files.end());
+		}
+		else
+		{
+			assert(false && "expand_paths can only expand regular files and directories");
+		}
+	}
+
+	return files;
+}
+
+// Well below the 128 KiB a single argument and the 2 MiB the whole argument vector are
+// limited to on Linux, leaving room for the environment
+static constexpr std::size_t RESPONSE_FILE_THRESHOLD = 32 * 1024;
+
+/**
+ * Runs `pb`, passing its arguments through the response file `responseFile` instead if
+ * the command line is long enough to risk `ARG_MAX` or to make copying it on exec
+ * expensive. The tool runs in a process group of its own, which is killed as soon as
+ * `stop` is requested.
+ */
+static int start_with_response_file(ProcessBuilder pb,
+	const std::filesystem::path& responseFile,
+	std::stop_token stop)
+{
+	pb.set_own_process_group();
+	if (pb.command_line_size() > RESPONSE_FILE_THRESHOLD)
+	{
+		if (auto withFile = pb.with_response_file(responseFile))
+		{
+			return withFile->start(std::move(stop));
+		}
+	}
+
+	return pb.start(std::move(stop));
+}
+
+/**
+ * The time `__DATE__` and `__TIME__` expand to in reproducible builds, in seconds since
+ * the Unix epoch: `SOURCE_DATE_EPOCH` if the caller picked one, or else 0.
+ */
+static std::uint64_t source_date_epoch()
+{
+	const char *value = std::getenv("SOURCE_DATE_EPOCH");
+	if (value == nullptr || *value == '\0')
+	{
+		return 0;
+	}
+
+	std::uint64_t seconds = 0;
+	std::string_view str {value};
+	auto [end, err] = std::from_chars(str.data(), str.data() + str.size(), seconds);
+	if (err != std::errc {} || end != str.data() + str.size())
+	{
+		bail("invalid `SOURCE_DATE_EPOCH` `{}`\n\n{}",
+			str,
+			cause("expected a number of seconds since the Unix epoch"));
+	}
+
+	return seconds;
+}
+
+/**
+ * Runs `pb` with an environment that only passes on where to find tools and where to
+ * put temporary files, so reproducible builds don't depend on the rest of it.
+ */
+static void make_hermetic(ProcessBuilder& pb)
+{
+	pb.set_env_allowlist({"PATH", "TMPDIR"});
+	pb.set_env("LC_ALL", "C");
+	pb.set_env("TZ", "UTC");
+	pb.set_env("SOURCE_DATE_EPOCH", std::to_string(source_date_epoch()));
+}
+
+/**
+ * Links objects into an executable, or, for libraries, collects them into a thin
+ * archive. Thin archives only refer to their members, so archiving doesn't copy any
+ * object bytes.
+ */
+class Linker
+{
+private:
+	struct Object
+	{
+		std::filesystem::path file;
+		// The source file the object was compiled from, which, unlike `file`, stays
+		// the same between builds
+		std::filesystem::path source;
+	};
+
+	struct Library
+	{
+		std::filesystem::path archive;
+		std::vector<Object> members;
+	};
+
+	const Build *ctx;
+	hash::DigestCache *digests;
+	bool archive;
+	std::vector<Object> objects;
+	std::vector<Library> libraries;
+	std::vector<std::string> flags;
+public:
+	Linker(const Build& ctx, hash::DigestCache& digests, bool archive = false)
+		: ctx {&ctx},
+		  digests {&digests},
+		  archive {archive}
+	{
+	}
+
+	void add_object(const std::filesystem::path& unit, const std::filesystem::path& source);
+
+	void add_flag(const std::string& flag)
+	{
+		flags.push_back(flag);
+	}
+
+	/**
+	 * Links against the thin archive `archive` of `objects`, compiled from `sources`.
+	 * Without objects, `archive` is a regular archive and is fingerprinted itself.
+	 */
+	void add_library(const std::filesystem::path& archive,
+		std::span<const std::filesystem::path> objects,
+		std::span<const std::filesystem::path> sources);
+
+	std::optional<Fingerprint> fingerprint(const std::filesystem::path& exe) const;
+
+	/**
+	 * Links or archives into `exe`, killing the tool as soon as `stop` is requested.
+	 */
+	bool link(const std::filesystem::path exe,
+		const std::filesystem::path& responseFile,
+		std::stop_token stop);
+private:
+	const std::filesystem::path& tool() const;
+	std::vector<std::string> args(const std::filesystem::path& exe) const;
+};
+
+void Linker::add_object(const std::filesystem::path& unit,
+	const std::filesystem::path& source)
+{
+	objects.push_back({unit, source});
+}
+
+void Linker::add_library(const std::filesystem::path& archive,
+	std::span<const std::filesystem::path> objects,
+	std::span<const std::filesystem::path> sources)
+{
+	auto& library = libraries.emplace_back(archive);
+	if (objects.empty())
+	{
+		library.members.push_back({archive, archive});
+	}
+
+	for (std::size_t i = 0; i < objects.size(); i++)
+	{
+		library.members.push_back({objects[i], sources[i]});
+	}
+}
+
+const std::filesystem::path& Linker::tool() const
+{
+	auto& toolchain = ctx->workspace->toolchain();
+	return archive ? toolchain.ar.path : toolchain.clang.path;
+}
+
+std::vector<std::string> Linker::args(const std::filesystem::path& exe) const
+{
+	if (archive)
+	{
+		// `D` zeroes the timestamps, owners and modes of members
+		return {ctx->reproducible ? "rcsD" : "rcs", "--thin", exe};
+	}
+
+	std::vector<std::string> args {"-o", exe};
+	args.insert(args.end(), flags.begin(), flags.end());
+	return args;
+}
+
+std::optional<Fingerprint> Linker::fingerprint(const std::filesystem::path& exe) const
+{
+	auto& toolchain = ctx->workspace->toolchain();
+
+	Fingerprint fingerprint;
+	fingerprint.add_input(tool(), toolchain.identity());
+
+	for (auto& arg : args(exe))
+	{
+		fingerprint.add_arg(arg);
+	}
+
+	for (auto& library : libraries)
+	{
+		fingerprint.add_arg(library.archive.string());
+	}
+
+	// A thin archive stays the same when its members change without their symbols
+	// changing, so its members are hashed instead
+	std::vector<const Object *> inputs;
+	for (auto& object : objects)
+	{
+		inputs.push_back(&object);
+	}
+
+	for (auto& library : libraries)
+	{
+		for (auto& member : library.members)
+		{
+			inputs.push_back(&member);
+		}
+	}
+
+	for (auto *object : inputs)
+	{
+		auto digest = digests->hash_file(object->file);
+		if (!digest)
+		{
+			return {};
+		}
+
+		fingerprint.add_input(object->source, *digest);
+	}
+
+	return fingerprint;
+}
+
+bool Linker::link(const std::filesystem::path exe,
+	const std::filesystem::path& responseFile,
+	std::stop_token stop)
+{
+	using namespace std::filesystem;
+
+	if (archive && tool().empty())
+	{
+		print_error("could not find `llvm-ar` next to `{}`",
+			ctx->workspace->toolchain().clang.path.string());
+		return false;
+	}
+
+	create_directories(exe.parent_path());
+
+	// Linking next to `exe` and renaming the result over it means binaries that are
+	// running, or being linked against by another build, are never seen half-written.
+	// It also starts archives afresh, which would keep the members of deleted sources
+	// otherwise. Thin archives name their members relative to their own directory, so
+	// the rename doesn't break them.
+	auto temp = io::temp_path(exe);
+	ProcessBuilder pb {tool()};
+	if (ctx->reproducible)
+	{
+		make_hermetic(pb);
+	}
+
+	for (auto& arg : args(temp))
+	{
+		pb.add_arg(arg);
+	}
+
+	for (auto& object : objects)
+	{
+		pb.add_arg(object.file);
+	}
+
+	// Archives go after the objects that use them
+	for (auto& library : libraries)
+	{
+		pb.add_arg(library.archive);
+	}
+
+	std::error_code err;
+	int result = start_with_response_file(std::move(pb), responseFile, std::move(stop));
+	if (result == 0)
+	{
+		rename(temp, exe, err);
+	}
+
+	if (result != 0 || err)
+	{
+		remove(temp, err);
+		return false;
+	}
+
+	return true;
+}
+
+static char optlevel_to_char(OptLevel level)
+{
+	if (level <= OptLevel::LEVEL_3)
+	{
+		return static_cast<char>('0' + static_cast<int>(level));
+	}
+	else if (level == OptLevel::LEVEL_S)
+	{
+		return 's';
+	}
+	else if (level == OptLevel::LEVEL_Z)
+	{
+		return 'z';
+	}
+
+	std::unreachable();
+}
+
+static int debuglevel_to_int(DebugInfo level)
+{
+	return static_cast<int>(level);
+}
+
+static std::string standard_to_str(Standard standard)
+{
+	switch (standard)
+	{
+	case Standard::CXX23:
+		return "c++23";
+	}
+}
+
+static std::string_view debug_compression_to_str(DebugCompression compression)
+{
+	switch (compression)
+	{
+	case DebugCompression::None:
+		return "none";
+	case DebugCompression::Zlib:
+		return "zlib";
+	case DebugCompression::Zstd:
+		return "zstd";
+	}
+
+	std::unreachable();
+}
+
+/**
+ * The flags instrumenting `variant`, passed both when compiling and when linking, so the
+ * runtimes they need are linked in.
+ */
+static std::vector<std::string> variant_flags(const Variant& variant)
+{
+	static constexpr std::array SANITIZER_NAMES = {
+		"address",
+		"undefined",
+		"thread",
+		"memory",
+		"leak",
+	};
+
+	std::vector<std::string> flags;
+	if (!variant.sanitizers.empty())
+	{
+		std::string list;
+		for (auto sanitizer : variant.sanitizers)
+		{
+			list += list.empty() ? "" : ",";
+			list += SANITIZER_NAMES[static_cast<std::size_t>(sanitizer)];
+		}
+
+		flags.push_back(std::format("-fsanitize={}", list));
+		// Keeps sanitizer reports' stack traces cheap to unwind
+		flags.push_back("-fno-omit-frame-pointer");
+	}
+
+	if (variant.coverage)
+	{
+		flags.push_back("-fprofile-instr-generate");
+		flags.push_back("-fcoverage-mapping");
+	}
+
+	return flags;
+}
+
+/**
+ * The flags units of `profile` are compiled with on top of the plan's: those of its
+ * variant and of the platform it's cross-compiled for.
+ */
+static std::vector<std::string> profile_compile_flags(const Profile& profile)
+{
+	auto flags = variant_flags(profile.variant);
+	if (auto& platform = profile.platform)
+	{
+		flags.push_back(std::format("--target={}", platform->triple));
+		if (platform->sysroot)
+		{
+			flags.push_back(std::format("--sysroot={}", platform->sysroot->string()));
+		}
+
+		flags.insert(flags.end(), platform->flags.begin(), platform->flags.end());
+	}
+
+	return flags;
+}
+
+static std::vector<std::string> profile_link_flags(const Profile& profile)
+{
+	auto flags = variant_flags(profile.variant);
+	if (auto& platform = profile.platform)
+	{
+		flags.push_back(std::format("--target={}", platform->triple));
+		if (platform->sysroot)
+		{
+			flags.push_back(std::format("--sysroot={}", platform->sysroot->string()));
+		}
+
+		if (platform->linker)
+		{
+			flags.push_back(std::format("--ld-path={}", platform->linker->string()));
+		}
+
+		flags.insert(flags.end(), platform->linkFlags.begin(), platform->linkFlags.end());
+	}
+
+	return flags;
+}
+
+/**
+ * Whether objects keep their debug info in `.dwo` files. Anonymous files can't have a
+ * `.dwo` file next to them, so objects stored in memfds never do.
+ */
+static bool uses_split_dwarf(const Build& ctx, const CompileOptions& opts)
+{
+	return opts.debugLevel != DebugInfo::LEVEL_0 &&
+		   opts.splitDebugInfo != SplitDebugInfo::Off &&
+		   ctx.objectStorage != ObjectStorage::Memfd;
+}
+
+static ProcessBuilder compiler_command(const Build& ctx, const CompileOptions& opts)
+{
+	ProcessBuilder clangBase {ctx.workspace->toolchain().clang.path};
+
+	clangBase.add_arg(ctx.check ? "-fsyntax-only" : "-c");
+
+	if (opts.debugLevel != DebugInfo::LEVEL_0)
+	{
+		clangBase.add_arg(std::format("-g{}", debuglevel_to_int(opts.debugLevel)));
+
+		if (uses_split_dwarf(ctx, opts))
+		{
+			clangBase.add_arg("-gsplit-dwarf");
+		}
+
+		if (opts.debugCompression != DebugCompression::None)
+		{
+			clangBase.add_arg(
+				std::format("-gz={}", debug_compression_to_str(opts.debugCompression)));
+		}
+	}
+
+	if (opts.optLevel != OptLevel::LEVEL_0)
+	{
+		clangBase.add_arg(std::format("-O{}", optlevel_to_char(opts.optLevel)));
+	}
+
+	clangBase.add_arg(std::format("-std={}", standard_to_str(opts.standard)));
+
+	for (auto& dir : opts.includeDirs)
+	{
+		clangBase.add_arg("-I");
+		clangBase.add_arg(dir);
+	}
+
+	for (auto& define : opts.defines)
+	{
+		clangBase.add_arg(std::format("-D{}", define));
+	}
+
+	return clangBase;
+}
+
+/**
+ * The in-flight state of one unit. Each compile job only touches its own slot in
+ * `objects` and `memfds`, so no locking is needed.
+ */
+struct UnitState
+{
+	std::vector<std::filesystem::path> sources;
+	std::vector<std::filesystem::path> objects;
+	// Keeps the objects alive when they are stored in memfds
+	std::vector<io::AnonymousFile> memfds;
+	std::filesystem::path binary;
+	// Set once the binary or archive is written, unless it was up to date
+	bool linked = false;
+	std::vector<jobs::JobId> compileJobs;
+	jobs::JobId linkJob;
+	// Only set when debug info is packaged into `.dwp` files
+	std::optional<jobs::JobId> packageJob;
+};
+
+/**
+ * The `.dwo` file clang writes next to `object` with `-gsplit-dwarf`.
+ */
+static std::filesystem::path dwo_path(const std::filesystem::path& object)
+{
+	auto dwo = object;
+	dwo.replace_extension(".dwo");
+	return dwo;
+}
+
+static std::filesystem::path dwp_path(const std::filesystem::path& binary)
+{
+	auto dwp = binary;
+	dwp += ".dwp";
+	return dwp;
+}
+
+std::string_view target_kind_to_str(TargetKind kind)
+{
+	switch (kind)
+	{
+	case TargetKind::Bin:
+		return "bin";
+	case TargetKind::Test:
+		return "test";
+	case TargetKind::Bench:
+		return "bench";
+	case TargetKind::Lib:
+		return "lib";
+	}
+
+	std::unreachable();
+}
+
+Profile select_profile(const BuildOptions& opts, TargetKind kind)
+{
+	return opts.release || kind == TargetKind::Bench ? Profile::release() : Profile::dev();
+}
+
+std::string describe_build(const Profile& profile, bool always)
+{
+	std::vector<std::string> parts;
+	if (profile.platform)
+	{
+		parts.push_back(profile.platform->triple);
+	}
+
+	auto variant = profile.variant.name();
+	if (!variant.empty() || always)
+	{
+		parts.push_back(variant.empty() ? "uninstrumented" : variant);
+	}
+
+	if (parts.empty())
+	{
+		return "";
+	}
+
+	std::string label = " [";
+	for (std::size_t i = 0; i < parts.size(); i++)
+	{
+		label += i == 0 ? "" : ", ";
+		label += parts[i];
+	}
+
+	return label + "]";
+}
+
+std::filesystem::path target_kind_subdir(TargetKind kind)
+{
+	switch (kind)
+	{
+	case TargetKind::Bin:
+	case TargetKind::Lib:
+		return "";
+	case TargetKind::Test:
+		return "tests";
+	case TargetKind::Bench:
+		return "benches";
+	}
+
+	std::unreachable();
+}
+
+std::filesystem::path artifact_name(const Target& target)
+{
+	if (target.kind == TargetKind::Lib)
+	{
+		return std::format("lib{}.a", target.name);
+	}
+
+	return target.name;
+}
+
+/**
+ * Checks keep their own fingerprints, so they never invalidate those of real builds.
+ */
+static std::filesystem::path fingerprint_dir(const Build& ctx, const Unit& unit)
+{
+	return ctx.workspace->build_dir() / unit.profile->target_subdir /
+		   (ctx.check ? ".check" : ".fingerprint") /
+		   target_kind_subdir(unit.target->kind) / artifact_name(*unit.target);
+}
+
+static std::filesystem::path link_fingerprint_path(const Build& ctx, const Unit& unit)
+{
+	return fingerprint_dir(ctx, unit) / "link";
+}
+
+/**
+ * The digest of everything the library of a dependency was last built from.
+ */
+static std::filesystem::path dependency_stamp_path(const Build& ctx, const Unit& unit)
+{
+	return fingerprint_dir(ctx, unit) / "stamp";
+}
+
+/**
+ * Names the object and compile fingerprint of `source`: its path relative to the
+ * package, so the layout of `obj/` mirrors the sources.
+ */
+static std::filesystem::path source_key(const Unit& unit,
+	const std::filesystem::path& source)
+{
+	auto relative = source.lexically_relative(unit.package->root());
+	if (relative.empty() || *relative.begin() == "..")
+	{
+		// Sources outside the package are named after their full path instead
+		hash::Hasher hasher;
+		hasher.update(source.native());
+		return std::format("{}-{}",
+			source.filename().string(),
+			hash::to_hex(hasher.finish()));
+	}
+
+	return relative;
+}
+
+static std::filesystem::path compile_fingerprint_path(const Build& ctx,
+	const Unit& unit,
+	const std::filesystem::path& source)
+{
+	return fingerprint_dir(ctx, unit) / "compile" / source_key(unit, source);
+}
+
+/**
+ * How long the source took to compile last time, in microseconds.
+ */
+static std::filesystem::path compile_duration_path(const Build& ctx,
+	const Unit& unit,
+	const std::filesystem::path& source)
+{
+	auto duration = compile_fingerprint_path(ctx, unit, source);
+	duration += ".duration";
+	return duration;
+}
+
+/**
+ * Traces sit next to the compile fingerprint, so traces of checks and builds are kept
+ * apart. A trace is only rewritten when its source is compiled again.
+ */
+static std::filesystem::path time_trace_path(const Build& ctx,
+	const Unit& unit,
+	const std::filesystem::path& source)
+{
+	auto trace = compile_fingerprint_path(ctx, unit, source);
+	trace += ".time-trace.json";
+	return trace;
+}
+
+std::filesystem::path BuildPlan::object_path(const Unit& unit,
+	const std::filesystem::path& source) const
+{
+	auto root = ctx->objectStorage == ObjectStorage::Tmpfs
+					? tmpfsDir / unit.profile->target_subdir
+					: ctx->workspace->build_dir() / unit.profile->target_subdir / "obj";
+	auto object = root / target_kind_subdir(unit.target->kind) /
+				  artifact_name(*unit.target) / source_key(unit, source);
+	object += ".o";
+	return object;
+}
+
+std::optional<Fingerprint> BuildPlan::compile_fingerprint(const ProcessBuilder& clang,
+	std::span<const std::filesystem::path> deps)
+{
+	auto& toolchain = ctx->workspace->toolchain();
+
+	Fingerprint fingerprint;
+	fingerprint.add_input(toolchain.clang.path, toolchain.identity());
+
+	// The overlay is named after the contents of the whole snapshot, which would make
+	// every edit invalidate every object. The inputs cover what the unit actually read.
+	auto& args = clang.arguments();
+	for (std::size_t i = 1; i < args.size(); i++)
+	{
+		if (args[i] == "-ivfsoverlay")
+		{
+			i++;
+			continue;
+		}
+
+		fingerprint.add_arg(args[i]);
+	}
+
+	for (auto& dep : deps)
+	{
+		auto path = std::filesystem::absolute(dep).lexically_normal();
+		auto digest = snapshot.digest(path);
+		if (!digest)
+		{
+			digest = digests.hash_file(path);
+		}
+
+		if (!digest)
+		{
+			return {};
+		}
+
+		fingerprint.add_input(path, *digest);
+	}
+
+	return fingerprint;
+}
+
+static std::string display_path(const Unit& unit, const std::filesystem::path& file)
+{
+	auto relative = file.lexically_relative(unit.package->root());
+	return relative.empty() || *relative.begin() == ".." ? file.string()
+														 : relative.string();
+}
+
+/**
+ * Describes how the fingerprint of a step changed since its last run, for `--explain`.
+ * The first input is always the tool, and `describe` names the others.
+ */
+static std::vector<std::string> explain_diff(const Fingerprint& previous,
+	const Fingerprint& current,
+	const std::function<std::string(const std::filesystem::path&)>& describe)
+{
+	std::vector<std::string> reasons;
+	auto& tool = current.inputs().front();
+	if (previous.inputs().front() != tool)
+	{
+		reasons.push_back(std::format("`{}` changed", tool.path.filename().string()));
+	}
+
+	auto diff = current.diff(previous);
+	for (auto& input : diff.changedInputs)
+	{
+		if (input != tool.path)
+		{
+			reasons.push_back(std::format("{} changed", describe(input)));
+		}
+	}
+
+	for (auto& input : diff.addedInputs)
+	{
+		if (input != tool.path)
+		{
+			reasons.push_back(std::format("{} was added", describe(input)));
+		}
+	}
+
+	for (auto& input : diff.removedInputs)
+	{
+		if (input != previous.inputs().front().path)
+		{
+			reasons.push_back(std::format("{} was removed", describe(input)));
+		}
+	}
+
+	if (!diff.removedArgs.empty() || !diff.addedArgs.empty())
+	{
+		std::string flags = "flags changed";
+		for (auto& arg : diff.removedArgs)
+		{
+			flags += std::format("\n                 - {}", arg);
+		}
+
+		for (auto& arg : diff.addedArgs)
+		{
+			flags += std::format("\n                 + {}", arg);
+		}
+
+		reasons.push_back(std::move(flags));
+	}
+
+	return reasons;
+}
+
+/**
+ * Prints why `step` has to run. Every reason is printed at once, so those of steps
+ * running concurrently don't interleave.
+ */
+static void print_dirty(std::string_view step, std::span<const std::string> reasons)
+{
+	std::string message {step};
+	for (auto& reason : reasons)
+	{
+		message += std::format("\n               {}", reason);
+	}
+
+	print_status("    Dirty", "{}", message);
+}
+
+/**
+ * Works out why a source that wasn't up to date has to be compiled again.
+ */
+static std::vector<std::string> explain_compile(const Unit& unit,
+	const std::filesystem::path& source,
+	const std::filesystem::path& object,
+	const std::optional<Fingerprint>& previous,
+	const std::optional<Fingerprint>& current)
+{
+	if (!previous || previous->inputs().empty())
+	{
+		return {"dependency info missing: never compiled, or the last compile failed"};
+	}
+
+	if (!object.empty() && !std::filesystem::exists(object))
+	{
+		return {std::format("object `{}` missing", object.string())};
+	}
+
+	auto describe = [&unit, &source](const std::filesystem::path& file) {
+		return file == source ? std::format("source `{}`", display_path(unit, file))
+							  : std::format("header `{}`", display_path(unit, file));
+	};
+
+	if (!current)
+	{
+		for (auto& input : previous->inputs() | std::views::drop(1))
+		{
+			if (!std::filesystem::exists(input.path))
+			{
+				return {std::format("{} was removed", describe(input.path))};
+			}
+		}
+
+		return {"a dependency couldn't be read"};
+	}
+
+	return explain_diff(*previous, *current, describe);
+}
+
+bool BuildPlan::compile_source(const Unit& unit, UnitState& state, std::size_t index)
+{
+	auto& source = state.sources[index];
+	auto& object = state.objects[index];
+
+	ProcessBuilder clang {clangBase};
+	for (auto& flag : profile_compile_flags(*unit.profile))
+	{
+		clang.add_arg(flag);
+	}
+
+	if (auto defines = ctx->featureDefines.find(unit.package);
+		defines != ctx->featureDefines.end())
+	{
+		for (auto& define : defines->second)
+		{
+			clang.add_arg(std::format("-D{}", define));
+		}
+	}
+
+	if (auto script = ctx->scriptOutputs.find(unit.package);
+		script != ctx->scriptOutputs.end())
+	{
+		for (auto& dir : script->second.includeDirs)
+		{
+			clang.add_arg("-I");
+			clang.add_arg(dir);
+		}
+
+		for (auto& define : script->second.defines)
+		{
+			clang.add_arg(std::format("-D{}", define));
+		}
+	}
+
+	// Part of the fingerprint, so sources compiled without it last time get traced
+	if (ctx->timeTrace)
+	{
+		auto trace = time_trace_path(*ctx, unit, source);
+		std::filesystem::create_directories(trace.parent_path());
+		clang.add_arg(std::format("-ftime-trace={}", trace.string()));
+	}
+
+	clang.add_arg(source);
+
+	if (ctx->check)
+	{
+		// Nothing is written
+	}
+	else if (ctx->objectStorage == ObjectStorage::Memfd)
+	{
+		state.memfds[index] = io::AnonymousFile::create();
+		object = state.memfds[index].path();
+	}
+	else
+	{
+		std::filesystem::create_directories(object.parent_path());
+	}
+
+	if (ctx->explain && !ctx->check && ctx->objectStorage != ObjectStorage::Disk)
+	{
+		std::array<std::string, 1> reasons {"objects aren't kept between builds"};
+		print_dirty(display_path(unit, std::filesystem::absolute(source)), reasons);
+	}
+
+	if (!ctx->check)
+	{
+		clang.add_arg("-o");
+		clang.add_arg(object);
+	}
+
+	// System headers are left out of depfiles like they are left out of the snapshot
+	std::filesystem::path fingerprintPath;
+	std::filesystem::path depfile;
+	if (ctx->check || ctx->objectStorage == ObjectStorage::Disk)
+	{
+		fingerprintPath = compile_fingerprint_path(*ctx, unit, source);
+
+		// Checks only leave their fingerprint behind, which is enough to know that the
+		// source checked cleanly
+		depfile = ctx->check ? fingerprintPath : object;
+		depfile += ".d";
+		std::filesystem::create_directories(depfile.parent_path());
+		clang.add_arg("-MMD");
+		clang.add_arg("-MF");
+		clang.add_arg(depfile);
+
+		auto previous = Fingerprint::load(fingerprintPath);
+		std::optional<Fingerprint> current;
+		if (previous && !previous->inputs().empty() &&
+			(ctx->check || std::filesystem::exists(object)))
+		{
+			// The first input is always the compiler
+			std::vector<std::filesystem::path> deps;
+			for (auto& input : previous->inputs() | std::views::drop(1))
+			{
+				deps.push_back(input.path);
+			}
+
+			current = compile_fingerprint(clang, deps);
+			if (current == previous)
+			{
+				return true;
+			}
+		}
+
+		if (ctx->explain)
+		{
+			auto absoluteSource = std::filesystem::absolute(source).lexically_normal();
+			print_dirty(display_path(unit, absoluteSource),
+				explain_compile(unit,
+					absoluteSource,
+					ctx->check ? std::filesystem::path {} : object,
+					previous,
+					current));
+		}
+
+		// A failed compile must never leave an object that looks up to date behind
+		std::error_code err;
+		std::filesystem::remove(fingerprintPath, err);
+	}
+
+	auto startTime = std::chrono::steady_clock::now();
+	if (inProcess)
+	{
+		inProcessCompiles++;
+		if (!inProcess->compile(clang.arguments()))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		auto responseFile = compile_fingerprint_path(*ctx, unit, source);
+		responseFile += ".rsp";
+		if (start_with_response_file(clang, responseFile, scheduler.stop_token()) != 0)
+		{
+			return false;
+		}
+	}
+
+	if (!fingerprintPath.empty())
+	{
+		auto deps = read_depfile(depfile);
+		auto fingerprint = deps ? compile_fingerprint(clang, *deps) : std::nullopt;
+		if (fingerprint)
+		{
+			fingerprint->save(fingerprintPath);
+		}
+
+		// Lets `freight deps` estimate what rebuilding the source costs
+		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - startTime);
+		io::write_file_atomic(compile_duration_path(*ctx, unit, source),
+			std::to_string(duration.count()));
+	}
+
+	return true;
+}
+
+/**
+ * Works out why a unit that wasn't up to date has to be linked or archived again.
+ */
+static std::vector<std::string> explain_link(const Unit& unit,
+	const std::filesystem::path& binary,
+	const std::optional<Fingerprint>& previous,
+	const std::optional<Fingerprint>& current)
+{
+	if (!std::filesystem::exists(binary))
+	{
+		return {std::format("`{}` missing", display_path(unit, binary))};
+	}
+
+	if (!previous || previous->inputs().empty())
+	{
+		return {"no fingerprint of the last link, or it failed"};
+	}
+
+	if (!current)
+	{
+		return {"an object couldn't be read"};
+	}
+
+	// Objects are fingerprinted under the source they were compiled from
+	return explain_diff(*previous, *current, [&unit](const std::filesystem::path& file) {
+		return std::format("object of `{}`", display_path(unit, file));
+	});
+}
+
+bool BuildPlan::dependency_up_to_date(const Unit& unit, const UnitState& state) const
+{
+	// Objects are only kept between builds on disk
+	if (!dependencyStamp || !std::ranges::contains(ctx->dependencies, unit.package) ||
+		(!ctx->check && ctx->objectStorage != ObjectStorage::Disk))
+	{
+		return false;
+	}
+
+	auto stamp = io::read_file(dependency_stamp_path(*ctx, unit));
+	if (!stamp || hash::from_hex(*stamp) != dependencyStamp)
+	{
+		return false;
+	}
+
+	auto exists = [](const std::filesystem::path& file) {
+		return std::filesystem::exists(file);
+	};
+	return ctx->check ||
+		   (exists(state.binary) && std::ranges::all_of(state.objects, exists));
+}
+
+void BuildPlan::schedule_unit(const Unit& unit,
+	UnitState& state,
+	std::vector<UnitState *> libraries)
+{
+	auto& ctx = *this->ctx;
+
+	state.sources = expand_linear_paths(unit.target->paths);
+	state.objects.resize(state.sources.size());
+	state.binary = ctx.workspace->build_dir() / unit.profile->target_subdir /
+				   target_kind_subdir(unit.target->kind) / artifact_name(*unit.target);
+
+	if (ctx.objectStorage == ObjectStorage::Memfd)
+	{
+		state.memfds.resize(state.sources.size());
+	}
+	else if (!ctx.check)
+	{
+		for (std::size_t i = 0; i < state.sources.size(); i++)
+		{
+			state.objects[i] = object_path(unit, state.sources[i]);
+		}
+	}
+
+	if (dependency_up_to_date(unit, state))
+	{
+		state.linkJob = scheduler.add([] { return true; });
+		return;
+	}
+
+	auto& compileJobs = state.compileJobs;
+	for (std::size_t i = 0; i < state.sources.size(); i++)
+	{
+		compileJobs.push_back(scheduler.add(
+			[this, &unit, &state, i] { return compile_source(unit, state, i); }));
+	}
+
+	// Checks stop after compiling, but every unit still gets a final job, so its
+	// outcome can be told from the job's status
+	if (ctx.check)
+	{
+		state.linkJob = scheduler.add([] { return true; }, compileJobs);
+		return;
+	}
+
+	auto linkDeps = compileJobs;
+	for (auto *library : libraries)
+	{
+		linkDeps.push_back(library->linkJob);
+	}
+
+	state.linkJob = scheduler.add(
+		[this, &ctx, &unit, &state, libraries] {
+			bool isLibrary = unit.target->kind == TargetKind::Lib;
+			Linker linker {ctx, digests, isLibrary};
+			for (std::size_t i = 0; i < state.sources.size(); i++)
+			{
+				linker.add_object(state.objects[i], state.sources[i]);
+			}
+
+			for (auto *library : libraries)
+			{
+				linker.add_library(library->binary, library->objects, library->sources);
+			}
+
+			if (!isLibrary)
+			{
+				for (auto& flag : linkFlags)
+				{
+					linker.add_flag(flag);
+				}
+
+				for (auto& flag : profile_link_flags(*unit.profile))
+				{
+					linker.add_flag(flag);
+				}
+			}
+
+			auto fingerprintPath = link_fingerprint_path(ctx, unit);
+			auto fingerprint = linker.fingerprint(state.binary);
+			auto previous = Fingerprint::load(fingerprintPath);
+			if (fingerprint && std::filesystem::exists(state.binary) &&
+				previous == fingerprint)
+			{
+				return true;
+			}
+
+			if (ctx.explain)
+			{
+				print_dirty(std::format("{} \"{}\"",
+								target_kind_to_str(unit.target->kind),
+								unit.target->name),
+					explain_link(unit, state.binary, previous, fingerprint));
+			}
+
+			// A failed link must never leave a binary that looks up to date behind
+			std::error_code err;
+			std::filesystem::remove(fingerprintPath, err);
+
+			auto responseFile = fingerprint_dir(ctx, unit) / "link.rsp";
+			if (!linker.link(state.binary, responseFile, scheduler.stop_token()))
+			{
+				// Killed because another job failed first, which was reported already
+				if (scheduler.cancelled())
+				{
+					return false;
+				}
+
+				print_error("could not compile `{}` ({} \"{}\") due to {} error(s)",
+					unit.package->name(),
+					target_kind_to_str(unit.target->kind),
+					unit.target->name,
+					isLibrary ? "archiver" : "linker");
+				return false;
+			}
+
+			if (fingerprint)
+			{
+				fingerprint->save(fingerprintPath);
+			}
+
+			state.linked = true;
+			return true;
+		},
+		linkDeps);
+
+	// Runs alongside compiling and linking the other units
+	if (packDebugInfo && unit.target->kind != TargetKind::Lib)
+	{
+		state.packageJob = scheduler.add(
+			[this, &unit, &state] { return package_debug_info(unit, state); },
+			{state.linkJob});
+	}
+}
+
+bool BuildPlan::package_debug_info(const Unit& unit, UnitState& state)
+{
+	auto& toolchain = ctx->workspace->toolchain();
+
+	// The `.dwo` files only change along with the binary referring to them
+	auto dwp = dwp_path(state.binary);
+	if (!state.linked && std::filesystem::exists(dwp))
+	{
+		return true;
+	}
+
+	if (!toolchain.dwp.found())
+	{
+		print_error("could not find `llvm-dwp` next to `{}`",
+			toolchain.clang.path.string());
+		return false;
+	}
+
+	ProcessBuilder dwpTool {toolchain.dwp.path};
+	if (ctx->reproducible)
+	{
+		make_hermetic(dwpTool);
+	}
+
+	auto temp = io::temp_path(dwp);
+	dwpTool.add_arg("-e");
+	dwpTool.add_arg(state.binary);
+	dwpTool.add_arg("-o");
+	dwpTool.add_arg(temp);
+	dwpTool.set_own_process_group();
+
+	std::error_code err;
+	bool packaged = dwpTool.start(scheduler.stop_token()) == 0;
+	if (packaged)
+	{
+		std::filesystem::rename(temp, dwp, err);
+	}
+
+	if (!packaged || err)
+	{
+		std::filesystem::remove(temp, err);
+		if (scheduler.cancelled())
+		{
+			return false;
+		}
+
+		print_error("could not package the debug info of `{}` ({} \"{}\")",
+			unit.package->name(),
+			target_kind_to_str(unit.target->kind),
+			unit.target->name);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * The directories whose files a build may read: the sources, tests, benchmarks and
+ * headers of every package being built or depended on, and any extra include
+ * directories. System headers are left out, they only change along with the toolchain.
+ */
+static std::vector<std::filesystem::path> snapshot_roots(const Build& ctx,
+	const CompileOptions& opts)
+{
+	std::vector<const Package *> packages = ctx.dependencies;
+	for (auto& unit : ctx.roots)
+	{
+		packages.push_back(unit.package);
+	}
+
+	std::vector<std::filesystem::path> roots;
+	for (auto *package : packages)
+	{
+		for (auto dir : {"src", "tests", "benches", "include"})
+		{
+			auto path = package->root() / dir;
+			if (std::filesystem::is_directory(path) &&
+				!std::ranges::contains(roots, path))
+			{
+				roots.push_back(std::move(path));
+			}
+		}
+	}
+
+	for (auto& dir : opts.includeDirs)
+	{
+		roots.push_back(dir);
+	}
+
+	for (auto& [package, script] : ctx.scriptOutputs)
+	{
+		std::ranges::copy(script.includeDirs, std::back_inserter(roots));
+	}
+
+	return roots;
+}
+
+/**
+ * Creates a private directory on tmpfs. `/dev/shm` is a tmpfs on every mainstream
+ * distribution; elsewhere this falls back to the usual temporary directory.
+ */
+static std::filesystem::path create_tmpfs_dir()
+{
+	std::error_code errc;
+	auto base = std::filesystem::is_directory("/dev/shm", errc)
+					? std::filesystem::path {"/dev/shm"}
+					: std::filesystem::temp_directory_path();
+
+	auto dir = (base / "freight-XXXXXX").string();
+	if (mkdtemp(dir.data()) == nullptr)
+	{
+		bail("failed to create a directory for objects in `{}`\n\n{}",
+			base.string(),
+			cause(std::error_code {errno, std::system_category()}.message()));
+	}
+
+	return dir;
+}
+
+BuildPlan::BuildPlan(const Build& ctx, const CompileOptions& opts)
+	: ctx {&ctx},
+	  clangBase {compiler_command(ctx, opts)},
+	  digests {ctx.workspace->target_dir() / ".freight" / "digests"},
+	  scheduler {ctx.jobs}
+{
+	auto storeDir = ctx.workspace->target_dir() / ".freight" / "snapshot";
+	snapshot = SourceSnapshot::create(storeDir, snapshot_roots(ctx, opts), ctx.jobs);
+
+	if (ctx.objectStorage == ObjectStorage::Tmpfs)
+	{
+		tmpfsDir = create_tmpfs_dir();
+	}
+
+	if (opts.debugLevel != DebugInfo::LEVEL_0 &&
+		opts.debugCompression != DebugCompression::None)
+	{
+		// Passes `--compress-debug-sections` on to the linker
+		linkFlags.push_back(
+			std::format("-gz={}", debug_compression_to_str(opts.debugCompression)));
+	}
+
+	packDebugInfo = !ctx.check && uses_split_dwarf(ctx, opts) &&
+					opts.splitDebugInfo == SplitDebugInfo::Packed;
+
+	if (ctx.reproducible)
+	{
+		// Paths are recorded relative to the workspace, and the build directory is
+		// always called `target`. Later maps take precedence, so the build directory
+		// is mapped even when it's inside the workspace.
+		clangBase.add_arg(
+			std::format("-ffile-prefix-map={}=.", ctx.workspace->root().string()));
+
+		// Dependencies outside the workspace, like `../foo` or registry sources under
+		// the Freight home, are recorded as `deps/<name>-<version>`
+		for (auto *dependency : ctx.dependencies)
+		{
+			auto relative = dependency->root().lexically_relative(ctx.workspace->root());
+			if (relative.empty() || *relative.begin() == "..")
+			{
+				clangBase.add_arg(std::format("-ffile-prefix-map={}=deps/{}-{}",
+					dependency->root().string(),
+					dependency->name(),
+					dependency->version()));
+			}
+		}
+
+		clangBase.add_arg(std::format("-ffile-prefix-map={}=target",
+			ctx.workspace->build_dir().string()));
+		make_hermetic(clangBase);
+
+		// A build ID derived from the contents instead of a random one
+		linkFlags.push_back("-Wl,--build-id=sha1");
+	}
+
+	if (ctx.backend == CompileBackend::InProcess)
+	{
+		// Reads the snapshot directly instead of going through the overlay
+		inProcess =
+			std::make_unique<InProcessCompiler>(ctx.workspace->toolchain(), snapshot);
+		if (ctx.reproducible)
+		{
+			// Compiles don't go through `clangBase`'s environment
+			inProcess->set_source_date_epoch(source_date_epoch());
+		}
+
+		if (ctx.objectStorage == ObjectStorage::Memfd)
+		{
+			// Anonymous files can't be renamed into place
+			clangBase.add_arg("-fno-temp-file");
+		}
+	}
+	else
+	{
+		clangBase.add_arg("-ivfsoverlay");
+		clangBase.add_arg(snapshot.overlay());
+	}
+
+	// Unless keeping going, the first error stops the build: there's no point in
+	// spending CI capacity on a build that already failed
+	scheduler.set_fail_fast(!ctx.keepGoing);
+
+	// Dependencies are shared by every package depending on them, so they are built
+	// with the flags and include directories of the whole build
+	if (!ctx.dependencies.empty())
+	{
+		hash::Hasher stamp;
+		stamp.update(ctx.workspace->toolchain().identity());
+		// Terminated like in `Fingerprint::digest`, so `A=1`,`B` differs from `A=1B`
+		auto updateString = [&stamp](std::string_view str) {
+			stamp.update(str);
+			stamp.update(std::string_view {"\0", 1});
+		};
+
+		auto& args = clangBase.arguments();
+		for (std::size_t i = 1; i < args.size(); i++)
+		{
+			if (args[i] == "-ivfsoverlay")
+			{
+				i++;
+				continue;
+			}
+
+			updateString(args[i]);
+		}
+
+		for (auto& dir : opts.includeDirs)
+		{
+			auto absolute = std::filesystem::absolute(dir).lexically_normal();
+			stamp.update(snapshot.tree_digest(absolute));
+		}
+
+		for (auto *dependency : ctx.dependencies)
+		{
+			auto checksum = package_checksum(*dependency, snapshot);
+			checksums.emplace(dependency, checksum);
+			stamp.update(checksum);
+
+			if (auto defines = ctx.featureDefines.find(dependency);
+				defines != ctx.featureDefines.end())
+			{
+				for (auto& define : defines->second)
+				{
+					updateString(define);
+				}
+			}
+
+			if (auto script = ctx.scriptOutputs.find(dependency);
+				script != ctx.scriptOutputs.end())
+			{
+				for (auto& dir : script->second.includeDirs)
+				{
+					auto absolute = std::filesystem::absolute(dir).lexically_normal();
+					stamp.update(snapshot.tree_digest(absolute));
+				}
+
+				for (auto& define : script->second.defines)
+				{
+					updateString(define);
+				}
+			}
+		}
+
+		dependencyStamp = stamp.finish();
+	}
+
+	for (std::size_t i = 0; i < ctx.roots.size(); i++)
+	{
+		states.push_back(std::make_unique<UnitState>());
+	}
+
+	for (auto& library : ctx.prebuilt)
+	{
+		auto& state = *prebuiltStates.emplace_back(std::make_unique<UnitState>());
+		state.binary = library.archive;
+		state.linkJob = scheduler.add([] { return true; });
+	}
+
+	// Libraries are scheduled first, so the targets linking them can wait on them
+	auto isLibrary = [&ctx](std::size_t i) {
+		return ctx.roots[i].target->kind == TargetKind::Lib;
+	};
+
+	for (std::size_t i = 0; i < ctx.roots.size(); i++)
+	{
+		if (isLibrary(i))
+		{
+			schedule_unit(ctx.roots[i], *states[i], {});
+		}
+	}
+
+	for (std::size_t i = 0; i < ctx.roots.size(); i++)
+	{
+		if (isLibrary(i))
+		{
+			continue;
+		}
+
+		// Each unit links the library of its own package, then those of dependencies,
+		// all built with the same profile. Archives must come before the archives
+		// they depend on.
+		auto& unit = ctx.roots[i];
+		std::vector<const Package *> linked {unit.package};
+		linked.insert(linked.end(), ctx.dependencies.begin(), ctx.dependencies.end());
+
+		std::vector<UnitState *> libraries;
+		for (auto *package : linked)
+		{
+			for (std::size_t j = 0; j < ctx.roots.size(); j++)
+			{
+				if (isLibrary(j) && ctx.roots[j].package == package &&
+					ctx.roots[j].profile == unit.profile)
+				{
+					libraries.push_back(states[j].get());
+				}
+			}
+
+			for (std::size_t j = 0; j < ctx.prebuilt.size(); j++)
+			{
+				if (ctx.prebuilt[j].package == package &&
+					ctx.prebuilt[j].profile == unit.profile)
+				{
+					libraries.push_back(prebuiltStates[j].get());
+				}
+			}
+		}
+
+		schedule_unit(unit, *states[i], std::move(libraries));
+	}
+}
+
+BuildPlan::~BuildPlan()
+{
+	if (!tmpfsDir.empty())
+	{
+		std::error_code err;
+		std::filesystem::remove_all(tmpfsDir, err);
+	}
+}
+
+CompileResult BuildPlan::execute()
+{
+	bool succeeded = scheduler.run();
+	digests.save();
+
+	CompileResult compilation;
+	compilation.succeeded = succeeded;
+	compilation.inProcessCompiles = inProcessCompiles;
+	compilation.checksums = checksums;
+	for (std::size_t i = 0; i < ctx->roots.size(); i++)
+	{
+		auto& unit = ctx->roots[i];
+		auto& state = *states[i];
+		auto status = scheduler.status(state.linkJob);
+		if (dependencyStamp && status == jobs::JobStatus::Succeeded &&
+			!state.compileJobs.empty() &&
+			std::ranges::contains(ctx->dependencies, unit.package))
+		{
+			io::write_file_atomic(dependency_stamp_path(*ctx, unit),
+				hash::to_hex(*dependencyStamp));
+		}
+		for (auto& object : state.objects)
+		{
+			if (object.empty())
+			{
+				continue;
+			}
+
+			for (auto& file : {object, dwo_path(object)})
+			{
+				std::error_code err;
+				auto size = std::filesystem::file_size(file, err);
+				compilation.objectBytes += err ? 0 : size;
+			}
+		}
+
+		std::vector<std::filesystem::path> written;
+		if (state.linked)
+		{
+			written.push_back(state.binary);
+		}
+
+		if (state.linked && state.packageJob &&
+			scheduler.status(*state.packageJob) == jobs::JobStatus::Succeeded)
+		{
+			written.push_back(dwp_path(state.binary));
+		}
+
+		for (auto& file : written)
+		{
+			std::error_code err;
+			auto size = std::filesystem::file_size(file, err);
+			if (!err)
+			{
+				compilation.written.push_back({file, size});
+			}
+		}
+
+		// Units cancelled before any of their own steps failed didn't fail themselves
+		bool producesBinary = !ctx->check && unit.target->kind != TargetKind::Lib;
+		bool compileFailed = std::ranges::any_of(state.compileJobs, [this](auto job) {
+			return scheduler.status(job) == jobs::JobStatus::Failed;
+		});
+		if (status == jobs::JobStatus::Succeeded && !producesBinary)
+		{
+			continue;
+		}
+		else if (status == jobs::JobStatus::Succeeded)
+		{
+			compilation.binaries.push_back(state.binary);
+			compilation.binaryProfiles.push_back(*unit.profile);
+		}
+		else if (status == jobs::JobStatus::Skipped ||
+				 (status == jobs::JobStatus::Cancelled && compileFailed))
+		{
+			std::string binDescription = ctx->roots.size() > 1
+											 ? std::format("({} \"{}\")",
+												   target_kind_to_str(unit.target->kind),
+												   unit.target->name)
+											 : "";
+			print_error("could not compile `{}` {} due to error(s)",
+				unit.package->name(),
+				binDescription);
+		}
+	}
+
+	if (scheduler.cancelled())
+	{
+		print_error("stopped the build after the first error, pass `--keep-going` to "
+					"build everything not depending on it");
+	}
+
+	if (ctx->timeTrace)
+	{
+		write_time_trace_report(compilation);
+	}
+
+	return compilation;
+}
+
+void BuildPlan::write_time_trace_report(CompileResult& compilation)
+{
+	// Sources that were up to date still have the trace of their last compile
+	std::vector<std::filesystem::path> traces;
+	for (std::size_t i = 0; i < ctx->roots.size(); i++)
+	{
+		for (auto& source : states[i]->sources)
+		{
+			auto trace = time_trace_path(*ctx, ctx->roots[i], source);
+			if (std::filesystem::exists(trace))
+			{
+				traces.push_back(std::move(trace));
+			}
+		}
+	}
+
+	static constexpr std::size_t TOP_HOTSPOTS = 20;
+	auto report = TimeTraceReport::aggregate(traces, ctx->jobs);
+	auto dir = ctx->workspace->build_dir();
+	std::array<std::pair<std::filesystem::path, std::string>, 2> files {{
+		{dir / "time-trace.txt", report.to_text(TOP_HOTSPOTS)},
+		{dir / "time-trace.json", json::to_string(report.to_json(), true)},
+	}};
+
+	for (auto& [file, content] : files)
+	{
+		if (!io::write_file_atomic(file, content))
+		{
+			print_error("failed to write the time trace report to `{}`", file.string());
+			continue;
+		}
+
+		compilation.written.push_back({file, content.size()});
+	}
+}
+
+std::vector<IndexedSource> read_dependency_index(const Workspace& ws,
+	const Package& package)
+{
+	Build ctx {
+		.gctx = &ws.gctx(),
+		.workspace = &ws,
+		.roots = {},
+		.dependencies = {},
+		.prebuilt = {},
+		.featureDefines = {},
+		.scriptOutputs = {},
+		.jobs = 1,
+	};
+
+	std::vector<IndexedSource> index;
+	for (auto& target : package.targets())
+	{
+		BuildOptions buildOpts {
+			.release = false,
+			.jobs = {},
+		};
+		auto profile = package.manifest().profile(select_profile(buildOpts, target.kind));
+		Unit unit {
+			.package = &package,
+			.target = &target,
+			.profile = &profile,
+		};
+
+		for (auto& source : expand_linear_paths(target.paths))
+		{
+			// The first input is always the compiler, and the second the source
+			auto fingerprint = Fingerprint::load(compile_fingerprint_path(ctx, unit, source));
+			if (!fingerprint || fingerprint->inputs().size() < 2)
+			{
+				continue;
+			}
+
+			IndexedSource indexed {
+				.source = fingerprint->inputs()[1].path,
+				.headers = {},
+				.duration = {},
+			};
+			for (auto& input : fingerprint->inputs() | std::views::drop(2))
+			{
+				indexed.headers.push_back(input.path);
+			}
+
+			auto duration =
+				io::read_file(compile_duration_path(ctx, unit, source)).value_or("");
+			std::int64_t micros = 0;
+			auto [end, errc] =
+				std::from_chars(duration.data(), duration.data() + duration.size(), micros);
+			if (!duration.empty() && errc == std::errc {})
+			{
+				indexed.duration = std::chrono::microseconds {micros};
+			}
+
+			index.push_back(std::move(indexed));
+		}
+	}
+
+	return index;
+}
+
+CompileResult compile(const Build& ctx, const CompileOptions& opts)
+{
+	BuildPlan plan {ctx, opts};
+	return plan.execute();
+}
+
+template<class R, class P> static float to_milliseconds(std::chrono::duration<R, P> d)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+    constexpr static const double MILLISECONDS_PER_SECOND = 1000;
+	return static_cast<double>(duration_cast<milliseconds>(d).count()) / MILLISECONDS_PER_SECOND;
+}
+
+/**
+ * Whether the library of `dependency` can be taken prebuilt from the registry instead
+ * of being built for `profile`. Checks don't link, so for them it's enough that there
+ * is a prebuilt library; builds download it and add it to `bctx`. Libraries are
+ * published built with their own language standard, so that is the one looked up.
+ */
+static bool use_prebuilt(const Workspace& ws,
+	Build& bctx,
+	const Package& dependency,
+	const Profile& profile)
+{
+	auto *source = ws.registry_source(dependency);
+	if (source == nullptr)
+	{
+		return false;
+	}
+
+	auto defines = bctx.featureDefines.find(&dependency);
+	auto key = artifact_key(ws.toolchain(),
+		profile,
+		dependency.standard(),
+		defines != bctx.featureDefines.end() ? defines->second
+											 : std::vector<std::string> {});
+	if (bctx.check)
+	{
+		return source->artifacts.contains(key);
+	}
+
+	auto archive = fetch_artifact(*source, key);
+	if (!archive)
+	{
+		return false;
+	}
+
+	bctx.prebuilt.push_back({
+		.package = &dependency,
+		.profile = &profile,
+		.archive = std::move(*archive),
+	});
+	return true;
+}
+
+/**
+ * Locks the build directory of `profile`, which holds the outputs of build scripts,
+ * and those of its variants and platforms in `profiles` until the returned locks are
+ * destroyed, so concurrent Freight processes building into the same `target/`
+ * (an editor, `freight watch`, CI scripts) take turns instead of overwriting each
+ * other's objects and fingerprints. Builds of other profiles aren't held up, and the
+ * stores under `target/.freight` and `$FREIGHT_HOME` never make a build wait: they
+ * are content-addressed or only replaced by renaming, so they can be read at any time.
+ * Directories are locked in order, so builds needing several can't deadlock.
+ */
+static std::vector<io::FileLock> lock_build_dirs(const Workspace& ws,
+	const Profile& profile,
+	std::span<const Profile> profiles)
+{
+	std::vector<std::filesystem::path> dirs {ws.build_dir() / profile.target_subdir};
+	for (auto& variantProfile : profiles)
+	{
+		dirs.push_back(ws.build_dir() / variantProfile.target_subdir);
+	}
+
+	std::ranges::sort(dirs);
+	auto duplicates = std::ranges::unique(dirs);
+	dirs.erase(duplicates.begin(), duplicates.end());
+
+	std::vector<io::FileLock> locks;
+	for (auto& dir : dirs)
+	{
+		std::error_code errc;
+		std::filesystem::create_directories(dir, errc);
+		auto lock = io::FileLock::open(dir / ".freight-lock", errc);
+		if (!errc && !lock.try_lock())
+		{
+			print_status(" Blocking",
+				"waiting for file lock on build directory `{}`",
+				std::filesystem::relative(dir, ws.gctx().cwd()).string());
+			lock.lock(errc);
+		}
+
+		if (errc)
+		{
+			bail("failed to lock the build directory `{}`\n\n{}",
+				dir.string(),
+				cause(errc.message()));
+		}
+
+		locks.push_back(std::move(lock));
+	}
+
+	return locks;
+}
+
+CompileResult build_package(const Workspace& ws,
+	const Package& package,
+	const BuildOptions& buildOpts,
+	TargetKind kind,
+	std::vector<std::string> targetsToBuild)
+{
+	using std::chrono::steady_clock;
+
+	print_status(buildOpts.check ? " Checking" : "Compiling",
+		"{} ({})",
+		package.name(),
+		package.root().string());
+
+	auto startTime = steady_clock::now();
+
+	auto features = resolve_features(ws, package, buildOpts.features);
+	Build bctx {
+		.gctx = &ws.gctx(),
+		.workspace = &ws,
+		.roots = {},
+		.dependencies = ws.dependencies(package, features),
+		.prebuilt = {},
+		.featureDefines = {},
+		.scriptOutputs = {},
+		.jobs = buildOpts.jobs.value_or(jobs::Scheduler::default_jobs()),
+		.backend = buildOpts.backend,
+		.objectStorage = buildOpts.objectStorage,
+		.reproducible = buildOpts.reproducible,
+		.check = buildOpts.check,
+		.timeTrace = buildOpts.timeTrace,
+		.explain = buildOpts.explain,
+		.keepGoing = buildOpts.keepGoing,
+	};
+
+	for (auto *member : bctx.dependencies)
+	{
+		bctx.featureDefines.emplace(member, features.defines(*member));
+	}
+
+	bctx.featureDefines.emplace(&package, features.defines(package));
+
+	Profile profile = package.manifest().profile(select_profile(buildOpts, kind));
+
+	// Every variant for every platform is built by the same plan, so they share one
+	// job budget. Units point into `profiles`, so it must not reallocate.
+	auto variants = buildOpts.variants;
+	if (variants.empty())
+	{
+		variants.emplace_back();
+	}
+
+	std::vector<std::optional<Platform>> platforms;
+	for (auto& triple : buildOpts.targets)
+	{
+		platforms.push_back(package.platform(triple));
+	}
+
+	if (platforms.empty())
+	{
+		platforms.emplace_back();
+	}
+
+	std::vector<Profile> profiles;
+	profiles.reserve(platforms.size() * variants.size());
+	for (auto& platform : platforms)
+	{
+		for (auto& variant : variants)
+		{
+			auto variantProfile = profile.with_variant(variant);
+			profiles.push_back(
+				platform ? variantProfile.with_platform(*platform) : variantProfile);
+		}
+	}
+
+	// Held until the build finishes, including its build scripts and lockfile update
+	auto locks = lock_build_dirs(ws, profile, profiles);
+
+	for (auto& variantProfile : profiles)
+	{
+		// Dependencies without a library only export headers
+		for (auto *dependency : bctx.dependencies)
+		{
+			if (use_prebuilt(ws, bctx, *dependency, variantProfile))
+			{
+				continue;
+			}
+
+			for (auto& target : dependency->targets())
+			{
+				if (target.kind == TargetKind::Lib)
+				{
+					bctx.roots.emplace_back(Unit {
+						.package = dependency,
+						.target = &target,
+						.profile = &variantProfile,
+					});
+				}
+			}
+		}
+
+		for (auto& target : package.targets())
+		{
+			// The library of the package is linked into every other target of it
+			bool isLibrary = target.kind == TargetKind::Lib;
+			if (target.kind != kind && !isLibrary)
+			{
+				continue;
+			}
+
+			if (!isLibrary && !targetsToBuild.empty() &&
+				!std::ranges::contains(targetsToBuild, target.name))
+			{
+				continue;
+			}
+
+			bctx.roots.emplace_back(Unit {
+				.package = &package,
+				.target = &target,
+				.profile = &variantProfile,
+			});
+		}
+	}
+
+	CompileOptions opts = {
+		.debugLevel = profile.debug,
+		.optLevel = profile.optLevel,
+		.standard = package.standard(),
+		.includeDirs = {},
+		.defines = {},
+		.splitDebugInfo = profile.splitDebugInfo,
+		.debugCompression = profile.debugCompression,
+	};
+
+	if (kind == TargetKind::Bench)
+	{
+		opts.includeDirs.push_back(install_bench_harness(ws));
+	}
+
+	std::vector<const Package *> scripted {&package};
+	for (auto *dependency : bctx.dependencies)
+	{
+		std::ranges::move(dependency->exported_include_dirs(),
+			std::back_inserter(opts.includeDirs));
+
+		// Nothing of a library linked prebuilt for every profile is compiled, so
+		// neither is its build script
+		bool prebuilt =
+			std::ranges::contains(bctx.prebuilt, dependency, &PrebuiltLibrary::package);
+		bool compiled = std::ranges::contains(bctx.roots, dependency, &Unit::package);
+		if (!prebuilt || compiled)
+		{
+			scripted.push_back(dependency);
+		}
+	}
+
+	// Build scripts run before anything is compiled, since what they generate may be
+	// included by any source of their package. Only the package itself sees it:
+	// dependents get the exported include directories of a dependency, nothing more.
+	for (auto *owner : scripted)
+	{
+		ProcessBuilder scriptCompiler {ws.toolchain().clang.path};
+		scriptCompiler.add_arg(std::format("-std={}", standard_to_str(owner->standard())));
+		auto script = run_build_script(ws, *owner, profile, std::move(scriptCompiler));
+		bctx.scriptOutputs.insert_or_assign(owner, std::move(script));
+	}
+
+	CompileResult result = compile(bctx, opts);
+	update_lockfile(ws, bctx.dependencies, result.checksums);
+
+	auto endTime = steady_clock::now();
+	auto timePassed = endTime - startTime;
+
+	std::string description =
+		opts.optLevel == OptLevel::LEVEL_0 ? "unoptimized" : "optimized";
+
+	if (opts.debugLevel != DebugInfo::LEVEL_0)
+	{
+		description += " + debuginfo";
+	}
+
+	// Every translation unit compiled in-process would have paid for starting a
+	// compiler process otherwise
+	std::string saved;
+	if (result.inProcessCompiles > 0)
+	{
+		auto overhead = ws.toolchain().spawnOverhead * result.inProcessCompiles;
+		saved = std::format(" (~{:.3}s saved by compiling in-process)",
+			to_milliseconds(overhead));
+	}
+
+	auto objects = std::format(" ({} of objects {})",
+		format_bytes(result.objectBytes),
+		buildOpts.objectStorage == ObjectStorage::Disk ? "on disk" : "held in memory");
+	if (buildOpts.check)
+	{
+		objects.clear();
+	}
+
+	for (auto& artifact : result.written)
+	{
+		print_status("    Wrote",
+			"{} ({})",
+			std::filesystem::relative(artifact.file, ws.gctx().cwd()).string(),
+			format_bytes(artifact.bytes));
+	}
+
+	std::string variantNames;
+	if (variants.size() > 1 || !variants.front().name().empty())
+	{
+		for (auto& variant : variants)
+		{
+			auto name = variant.name();
+			variantNames += variantNames.empty() ? " as " : ", ";
+			variantNames += name.empty() ? "uninstrumented" : name;
+		}
+	}
+
+	std::string triples;
+	for (auto& triple : buildOpts.targets)
+	{
+		triples += triples.empty() ? " for " : ", ";
+		triples += triple;
+	}
+
+	print_status(" Finished",
+		"`{}` profile [{}] target(s){}{} in {:.3}s{}{}",
+		profile.name,
+		description,
+		triples,
+		variantNames,
+		to_milliseconds(timePassed),
+		objects,
+		saved);
+
+	return result;
+}
+
+bool verify_reproducible(Workspace& ws, const Package& package, BuildOptions buildOpts)
+{
+	buildOpts.reproducible = true;
+	auto first = build_package(ws, package, buildOpts);
+	auto firstDir = ws.build_dir();
+	if (!first.succeeded)
+	{
+		return false;
+	}
+
+	// A fresh directory, so nothing from the first build is reused
+	auto secondDir = ws.target_dir() / ".freight" / "verify";
+	std::error_code err;
+	std::filesystem::remove_all(secondDir, err);
+	ws.set_build_dir(secondDir);
+	auto second = build_package(ws, package, buildOpts);
+	ws.set_build_dir(firstDir);
+
+	if (!second.succeeded || first.binaries.size() != second.binaries.size())
+	{
+		print_error("could not build `{}` twice", package.name());
+		return false;
+	}
+
+	// Nothing compared proves nothing
+	if (first.binaries.empty())
+	{
+		print_error("`{}` has no artifacts to compare", package.name());
+		return false;
+	}
+
+	std::size_t mismatches = 0;
+	for (std::size_t i = 0; i < first.binaries.size(); i++)
+	{
+		auto firstDigest = hash::hash_file(first.binaries[i]);
+		auto secondDigest = hash::hash_file(second.binaries[i]);
+		if (!firstDigest || firstDigest != secondDigest)
+		{
+			print_error("`{}` differs between builds ({} and {})",
+				std::filesystem::relative(first.binaries[i], firstDir).string(),
+				firstDigest ? hash::to_hex(*firstDigest) : "unreadable",
+				secondDigest ? hash::to_hex(*secondDigest) : "unreadable");
+			mismatches++;
+		}
+	}
+
+	if (mismatches == 0)
+	{
+		print_status(" Verified",
+			"{} artifact(s) are bit-identical across builds",
+			first.binaries.size());
+	}
+
+	return mismatches == 0;
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BuildScript.h"
+#include "Cmds.h"
+#include "Fingerprint.h"
+#include "InProcessCompiler.h"
+#include "SourceSnapshot.h"
+#include "Support/DigestCache.h"
+#include "Support/Jobs.h"
+#include "Support/Util.h"
+#include "Workspace.h"
+
+struct CompileOptions
+{
+	DebugInfo debugLevel;
+	OptLevel optLevel;
+	Standard standard;
+	std::vector<std::filesystem::path> includeDirs;
+	// Passed as `-D`, like `NAME` or `NAME=VALUE`
+	std::vector<std::string> defines;
+	SplitDebugInfo splitDebugInfo = SplitDebugInfo::Off;
+	DebugCompression debugCompression = DebugCompression::None;
+};
+
+struct Unit
+{
+	const Package *package;
+	const Target *target;
+	const Profile *profile;
+};
+
+/**
+ * The library of a dependency, downloaded prebuilt from the registry instead of being
+ * built from source.
+ */
+struct PrebuiltLibrary
+{
+	const Package *package;
+	const Profile *profile;
+	std::filesystem::path archive;
+};
+
+struct Build
+{
+	const GlobalContext *gctx;
+	const Workspace *workspace;
+	std::vector<Unit> roots;
+	// Packages the roots depend on, before the packages they depend on in turn. Roots
+	// link the libraries of all of them, which are among the roots too.
+	std::vector<const Package *> dependencies;
+	// Libraries of dependencies that are linked as they are, with no unit of their own
+	std::vector<PrebuiltLibrary> prebuilt;
+	// Defines of the enabled features of each package, only passed to its own compiles
+	std::unordered_map<const Package *, std::vector<std::string>> featureDefines;
+	// What the build script of each package asked for, only passed to its own compiles
+	std::unordered_map<const Package *, BuildScriptOutput> scriptOutputs;
+	std::size_t jobs;
+	CompileBackend backend = CompileBackend::Process;
+	ObjectStorage objectStorage = ObjectStorage::Disk;
+	bool reproducible = false;
+	// Only type-check sources, without writing objects or linking
+	bool check = false;
+	// Have clang trace where compile time goes, and aggregate the traces into a report
+	bool timeTrace = false;
+	// Print why each compile and link step runs
+	bool explain = false;
+	// Build everything not depending on a failed step, instead of stopping at the
+	// first error
+	bool keepGoing = false;
+};
+
+struct WrittenArtifact
+{
+	std::filesystem::path file;
+	std::uint64_t bytes;
+};
+
+struct CompileResult
+{
+	// Whether every job of the build succeeded
+	bool succeeded = true;
+	std::vector<std::filesystem::path> binaries;
+	// The profile each of `binaries` was built with, including its variant and platform
+	std::vector<Profile> binaryProfiles;
+	// Binaries, archives, debug info packages and reports written by the build, leaving
+	// out those that were already up to date
+	std::vector<WrittenArtifact> written;
+	// Translation units compiled by the in-process backend
+	std::size_t inProcessCompiles = 0;
+	// Total size of the objects of the build, and of their `.dwo` files with split
+	// debug info. They stay in memory until the build finishes unless they are stored
+	// on disk.
+	std::uint64_t objectBytes = 0;
+	// The checksum of each dependency of the build, see `package_checksum`
+	std::unordered_map<const Package *, hash::Digest> checksums;
+};
+
+std::string_view target_kind_to_str(TargetKind kind);
+
+/**
+ * The profile targets of `kind` are built with. Benchmarks are always built with the
+ * release profile.
+ */
+Profile select_profile(const BuildOptions& opts, TargetKind kind = TargetKind::Bin);
+
+/**
+ * Labels binaries built for another platform or as an instrumented variant, like
+ * ` [aarch64-linux-gnu, asan]`. With `always`, uninstrumented host builds are labeled
+ * too, so they can be told apart in a matrix.
+ */
+std::string describe_build(const Profile& profile, bool always);
+
+/**
+ * The directory of `target/<profile>` that artifacts of `kind` are placed in.
+ */
+std::filesystem::path target_kind_subdir(TargetKind kind);
+
+/**
+ * The file name of the artifact of `target`. Libraries are archives named after their
+ * package, like `libfoo.a`.
+ */
+std::filesystem::path artifact_name(const Target& target);
+
+/**
+ * Writes the header-only benchmark harness (`<freight/bench.h>`) to `target/` and
+ * returns the include directory containing it.
+ */
+std::filesystem::path install_bench_harness(const Workspace& ws);
+
+struct UnitState;
+
+/**
+ * The job graph of a build: one compile job per source file and one link job per
+ * unit. Library units are archived instead, and linked into the other units. Jobs
+ * refer back into the plan, so it can't be copied or moved.
+ *
+ * Objects stored on disk are kept between builds, and each is only recompiled once its
+ * source, a header it included last time or its command line changes.
+ */
+class BuildPlan
+{
+public:
+	BuildPlan(const Build& ctx, const CompileOptions& opts);
+	~BuildPlan();
+	BuildPlan(const BuildPlan&) = delete;
+	BuildPlan& operator=(const BuildPlan&) = delete;
+	BuildPlan(BuildPlan&&) = delete;
+	BuildPlan& operator=(BuildPlan&&) = delete;
+
+	std::size_t job_count() const
+	{
+		return scheduler.size();
+	}
+
+	/**
+	 * Runs the plan. Errors are reported as they happen.
+	 */
+	CompileResult execute();
+private:
+	const Build *ctx;
+	ProcessBuilder clangBase;
+	SourceSnapshot snapshot;
+	// Digests of files outside the snapshot: headers and objects
+	hash::DigestCache digests;
+	// Only set when storing objects on tmpfs
+	std::filesystem::path tmpfsDir;
+	// Only set when compiling in-process
+	std::unique_ptr<InProcessCompiler> inProcess;
+	std::vector<std::string> linkFlags;
+	// Whether the debug info of binaries is packaged into `.dwp` files
+	bool packDebugInfo = false;
+	std::atomic<std::size_t> inProcessCompiles = 0;
+	jobs::Scheduler scheduler;
+	std::vector<std::unique_ptr<UnitState>> states;
+	// One per prebuilt library, only there to be linked
+	std::vector<std::unique_ptr<UnitState>> prebuiltStates;
+
+	// Digests everything the libraries of dependencies are built from. Only set if
+	// there are dependencies.
+	std::optional<hash::Digest> dependencyStamp;
+	std::unordered_map<const Package *, hash::Digest> checksums;
+
+	/**
+	 * Schedules compiling and linking `unit`, linking it against `libraries`.
+	 */
+	void schedule_unit(const Unit& unit,
+		UnitState& state,
+		std::vector<UnitState *> libraries);
+
+	/**
+	 * Whether `unit` is the library of a dependency that was built from the same
+	 * `dependencyStamp` last time, and can be reused without checking its sources.
+	 */
+	bool dependency_up_to_date(const Unit& unit, const UnitState& state) const;
+	std::filesystem::path object_path(const Unit& unit,
+		const std::filesystem::path& source) const;
+	bool compile_source(const Unit& unit, UnitState& state, std::size_t index);
+	bool package_debug_info(const Unit& unit, UnitState& state);
+
+	/**
+	 * Aggregates the time traces of every source in the plan into a report in the
+	 * build directory, as text and JSON.
+	 */
+	void write_time_trace_report(CompileResult& compilation);
+
+	/**
+	 * The fingerprint of compiling with `clang`, where `deps` are the source and the
+	 * headers it includes. Empty if one of them couldn't be read.
+	 */
+	std::optional<Fingerprint> compile_fingerprint(const ProcessBuilder& clang,
+		std::span<const std::filesystem::path> deps);
+};
+
+/**
+ * A source as recorded by the last build that compiled it.
+ */
+struct IndexedSource
+{
+	std::filesystem::path source;
+	// Every header the source included, directly or not
+	std::vector<std::filesystem::path> headers;
+	// How long compiling the source took, if it was recorded
+	std::optional<std::chrono::microseconds> duration;
+};
+
+/**
+ * Reads the dependencies of every source of `package` out of the fingerprints its last
+ * build left behind, without invoking the compiler. Sources that haven't been built
+ * yet are left out.
+ */
+std::vector<IndexedSource> read_dependency_index(const Workspace& ws,
+	const Package& package);
+
+CompileResult compile(const Build& ctx, const CompileOptions& opts);
+
+CompileResult build_package(const Workspace& ws,
+	const Package& package,
+	const BuildOptions& buildOpts,
+	TargetKind kind = TargetKind::Bin,
+	std::vector<std::string> targetsToBuild = {});
+
+/**
+ * Builds `package` reproducibly twice, the second time from scratch in another build
+ * directory, and compares the binaries. Returns whether both builds succeeded and
+ * produced at least one binary, all of them bit-identical.
+ */
+bool verify_reproducible(Workspace& ws, const Package& package, BuildOptions buildOpts);
@@ -0,0 +1,324 @@
+#include "Pch.h"
+
+#include "BuildScript.h"
+
+#include <algorithm>
+#include <optional>
+#include <span>
+
+#include "Depfile.h"
+#include "Fingerprint.h"
+#include "Support/Hash.h"
+#include "Support/Io.h"
+
+std::expected<BuildScriptOutput, std::string> parse_build_script_output(
+	std::string_view output,
+	const std::filesystem::path& root)
+{
+	static constexpr std::string_view PREFIX = "freight:";
+
+	BuildScriptOutput parsed;
+	for (auto lineRange : output | std::views::split('\n'))
+	{
+		std::string_view line {lineRange};
+		if (line.ends_with('\r'))
+		{
+			line.remove_suffix(1);
+		}
+
+		if (!line.starts_with(PREFIX))
+		{
+			continue;
+		}
+
+		line.remove_prefix(PREFIX.size());
+		auto equals = line.find('=');
+		if (equals == std::string_view::npos)
+		{
+			return std::unexpected {std::format("expected `=` in `freight:{}`", line)};
+		}
+
+		auto key = line.substr(0, equals);
+		auto value = line.substr(equals + 1);
+		if (key == "rerun-if-changed")
+		{
+			parsed.rerunIfChanged.push_back((root / value).lexically_normal());
+		}
+		else if (key == "define")
+		{
+			parsed.defines.emplace_back(value);
+		}
+		else if (key == "include-dir")
+		{
+			parsed.includeDirs.push_back((root / value).lexically_normal());
+		}
+		else if (key == "warning")
+		{
+			parsed.warnings.emplace_back(value);
+		}
+		else
+		{
+			return std::unexpected {std::format("unknown directive `freight:{}`", key)};
+		}
+	}
+
+	return parsed;
+}
+
+namespace
+{
+/**
+ * Everything the build script of a package leaves behind, in `target/<profile>`. Each
+ * package depended on has a build script of its own.
+ */
+struct ScriptPaths
+{
+	std::filesystem::path binary;
+	std::filesystem::path depfile;
+	std::filesystem::path compileFingerprint;
+	std::filesystem::path runFingerprint;
+	// Everything the last run printed
+	std::filesystem::path output;
+	// Where the script should write what it generates, passed on as `OUT_DIR`
+	std::filesystem::path outDir;
+};
+
+ScriptPaths script_paths(const Workspace& ws,
+	const Package& package,
+	const Profile& profile)
+{
+	auto dir = ws.build_dir() / profile.target_subdir / "build-script" / package.name();
+	return ScriptPaths {
+		.binary = dir / "build-script",
+		.depfile = dir / "build-script.d",
+		.compileFingerprint = dir / "compile.fingerprint",
+		.runFingerprint = dir / "run.fingerprint",
+		.output = dir / "output",
+		.outDir = dir / "out",
+	};
+}
+
+/**
+ * Adds `files` to `fingerprint` as inputs. Directories stand for every file in them.
+ * Empty if one of the files can't be read, e.g. because it was deleted. Bails if a
+ * directory can't be listed.
+ */
+std::optional<Fingerprint> add_inputs(Fingerprint fingerprint,
+	std::span<const std::filesystem::path> files)
+{
+	using namespace std::filesystem;
+
+	std::vector<path> expanded;
+	for (auto& file : files)
+	{
+		std::error_code errc;
+		if (!is_directory(file, errc))
+		{
+			expanded.push_back(file);
+			continue;
+		}
+
+		// Directories that can't be listed, or vanish while they are, can't be
+		// fingerprinted at all
+		auto first = expanded.size();
+		recursive_directory_iterator it {file, errc};
+		for (; !errc && it != recursive_directory_iterator {}; it.increment(errc))
+		{
+			if (it->is_regular_file(errc))
+			{
+				expanded.push_back(it->path());
+			}
+		}
+
+		if (errc)
+		{
+			bail("failed to list the files in `{}`\n\n{}",
+				file.string(),
+				cause(errc.message()));
+		}
+
+		std::sort(expanded.begin() + static_cast<std::ptrdiff_t>(first), expanded.end());
+	}
+
+	for (auto& file : expanded)
+	{
+		auto digest = hash::hash_file(file);
+		if (!digest)
+		{
+			return {};
+		}
+
+		fingerprint.add_input(file, *digest);
+	}
+
+	return fingerprint;
+}
+
+std::optional<Fingerprint> compile_fingerprint(const Workspace& ws,
+	const ProcessBuilder& compiler,
+	std::span<const std::filesystem::path> deps)
+{
+	auto& toolchain = ws.toolchain();
+
+	Fingerprint fingerprint;
+	fingerprint.add_input(toolchain.clang.path, toolchain.identity());
+	for (auto& arg : compiler.arguments() | std::views::drop(1))
+	{
+		fingerprint.add_arg(arg);
+	}
+
+	return add_inputs(std::move(fingerprint), deps);
+}
+
+/**
+ * Compiles the script into `paths.binary`, unless it's up to date. Returns whether the
+ * binary is ready to run.
+ */
+bool compile_script(const Workspace& ws,
+	const Package& package,
+	const std::filesystem::path& script,
+	const ScriptPaths& paths,
+	ProcessBuilder compiler)
+{
+	std::filesystem::create_directories(paths.binary.parent_path());
+	compiler.add_arg(script);
+	compiler.add_arg("-o");
+	compiler.add_arg(paths.binary);
+	compiler.add_arg("-MMD");
+	compiler.add_arg("-MF");
+	compiler.add_arg(paths.depfile);
+
+	// The first input is always the compiler
+	auto previous = Fingerprint::load(paths.compileFingerprint);
+	if (previous && !previous->inputs().empty() && std::filesystem::exists(paths.binary))
+	{
+		std::vector<std::filesystem::path> deps;
+		for (auto& input : previous->inputs() | std::views::drop(1))
+		{
+			deps.push_back(input.path);
+		}
+
+		if (compile_fingerprint(ws, compiler, deps) == previous)
+		{
+			return true;
+		}
+	}
+
+	std::error_code err;
+	std::filesystem::remove(paths.compileFingerprint, err);
+
+	print_status("Compiling", "build script of `{}`", package.name());
+	if (compiler.start() != 0)
+	{
+		return false;
+	}
+
+	auto deps = read_depfile(paths.depfile);
+	auto fingerprint = deps ? compile_fingerprint(ws, compiler, *deps) : std::nullopt;
+	if (fingerprint)
+	{
+		fingerprint->save(paths.compileFingerprint);
+	}
+
+	return true;
+}
+
+/**
+ * What the output of a run depends on, besides the files it declared: the script and
+ * the environment it runs in. Bails if the script can't be read.
+ */
+Fingerprint run_fingerprint(const Package& package,
+	const Profile& profile,
+	const ScriptPaths& paths)
+{
+	Fingerprint fingerprint;
+	fingerprint.add_arg(std::format("OUT_DIR={}", paths.outDir.string()));
+	fingerprint.add_arg(std::format("FREIGHT_MANIFEST_DIR={}", package.root().string()));
+	fingerprint.add_arg(std::format("FREIGHT_PROFILE={}", profile.name));
+	auto digest = hash::hash_file(paths.binary);
+	if (!digest)
+	{
+		bail("failed to read the build script of `{}` from `{}`",
+			package.name(),
+			paths.binary.string());
+	}
+
+	fingerprint.add_input(paths.binary, *digest);
+	return fingerprint;
+}
+} // namespace
+
+BuildScriptOutput run_build_script(const Workspace& ws,
+	const Package& package,
+	const Profile& profile,
+	ProcessBuilder compiler)
+{
+	auto script = package.build_script();
+	if (!script)
+	{
+		return {};
+	}
+
+	auto paths = script_paths(ws, package, profile);
+	if (!compile_script(ws, package, *script, paths, std::move(compiler)))
+	{
+		bail("could not compile the build script of `{}`", package.name());
+	}
+
+	// The files to watch are only known from the last run, which is reused as long as
+	// none of them changed
+	auto base = run_fingerprint(package, profile, paths);
+	auto previousRun = Fingerprint::load(paths.runFingerprint);
+	auto previousOutput = io::read_file(paths.output);
+	auto previous = previousOutput
+						? parse_build_script_output(*previousOutput, package.root())
+						: std::unexpected {std::string {}};
+	if (previous && previousRun &&
+		add_inputs(base, previous->rerunIfChanged) == previousRun)
+	{
+		return std::move(*previous);
+	}
+
+	std::error_code err;
+	std::filesystem::remove(paths.runFingerprint, err);
+	std::filesystem::create_directories(paths.outDir);
+
+	print_status("  Running", "build script of `{}`", package.name());
+	ProcessBuilder pb {paths.binary};
+	pb.set_working_dir(package.root());
+	pb.set_output_file(paths.output);
+	pb.set_env("OUT_DIR", paths.outDir.string());
+	pb.set_env("FREIGHT_MANIFEST_DIR", package.root().string());
+	pb.set_env("FREIGHT_PKG_NAME", package.name());
+	pb.set_env("FREIGHT_PROFILE", profile.name);
+	int exitCode = pb.start();
+
+	auto output = io::read_file(paths.output).value_or("");
+	if (exitCode != 0)
+	{
+		std::cerr << output;
+		bail("the build script of `{}` failed with exit code {}",
+			package.name(),
+			exitCode);
+	}
+
+	auto parsed = parse_build_script_output(output, package.root());
+	if (!parsed)
+	{
+		bail("failed to parse the output of the build script of `{}`\n\n{}",
+			package.name(),
+			cause(parsed.error()));
+	}
+
+	for (auto& warning : parsed->warnings)
+	{
+		std::println(std::cerr, "\033[33mwarning:\033[39m {}", warning);
+	}
+
+	if (auto fingerprint = add_inputs(base, parsed->rerunIfChanged))
+	{
+		fingerprint->save(paths.runFingerprint);
+	}
+
+	return std::move(*parsed);
+}
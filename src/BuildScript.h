@@ -0,0 +1,42 @@
+#pragma once
+
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Support/Util.h"
+#include "Workspace.h"
+
+/**
+ * What a build script asked for, through the `freight:` directives it printed.
+ */
+struct BuildScriptOutput
+{
+	// Files and directories that make the script run again when they change
+	std::vector<std::filesystem::path> rerunIfChanged;
+	// Passed to every compile of the package as `-D`, like `NAME` or `NAME=VALUE`
+	std::vector<std::string> defines;
+	std::vector<std::filesystem::path> includeDirs;
+	std::vector<std::string> warnings;
+};
+
+/**
+ * Parses the directives among the lines printed by a build script. Relative paths are
+ * resolved against `root`. Other lines are ignored.
+ */
+std::expected<BuildScriptOutput, std::string> parse_build_script_output(
+	std::string_view output,
+	const std::filesystem::path& root);
+
+/**
+ * Compiles and runs the build script of `package` with `compiler`, unless neither the
+ * script nor a file it declared with `freight:rerun-if-changed` changed since its last
+ * run, in which case the output of that run is reused. Returns an empty output if the
+ * package has no build script.
+ */
+BuildScriptOutput run_build_script(const Workspace& ws,
+	const Package& package,
+	const Profile& profile,
+	ProcessBuilder compiler);
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "Features.h"
 #include "Support/Util.h"
+#include "Workspace.h"
 
 struct InitOptions {
     std::optional<std::string> path;
@@ -10,15 +16,127 @@ struct NewOptions {
     std::string path;
 };
 
+enum class CompileBackend {
+    // Spawn a compiler process per translation unit
+    Process,
+    // Compile on Freight's own threads through the clang libraries
+    InProcess,
+};
+
+enum class ObjectStorage {
+    // Files in `target/<profile>/obj`, kept and reused between builds
+    Disk,
+    // Anonymous in-memory files, gone once the build finishes
+    Memfd,
+    // Files in a temporary directory on tmpfs, removed once the build finishes
+    Tmpfs,
+};
+
 struct BuildOptions {
     bool release;
+    // Maximum number of parallel jobs, defaults to the number of CPUs
+    std::optional<std::size_t> jobs;
+    CompileBackend backend = CompileBackend::Process;
+    ObjectStorage objectStorage = ObjectStorage::Disk;
+    // Variants to build side by side, only the uninstrumented one if empty
+    std::vector<Variant> variants {};
+    // Target triples to cross-compile for, only the host if empty
+    std::vector<std::string> targets {};
+    // Build bit-identical artifacts regardless of where and when the build runs
+    bool reproducible = false;
+    // Build twice in different directories and compare the artifacts
+    bool verifyReproducible = false;
+    // Only type-check sources, without writing objects or linking
+    bool check = false;
+    // Aggregate clang's `-ftime-trace` output into a report of compile-time hotspots
+    bool timeTrace = false;
+    // Print why each compile and link step runs, from its fingerprint
+    bool explain = false;
+    // Build everything not depending on a failed step, instead of cancelling the
+    // build at the first error
+    bool keepGoing = false;
+    // Features of the package to build with
+    FeatureSelection features {};
 };
 
 struct RunOptions {
     BuildOptions build_opts;
 };
 
+struct Shard {
+    // 1-based index of this shard
+    std::size_t index;
+    std::size_t count;
+};
+
+struct TestOptions {
+    BuildOptions build_opts;
+    // Only run tests whose name contains one of these
+    std::vector<std::string> filters;
+    std::optional<Shard> shard;
+    std::optional<std::chrono::seconds> timeout;
+    std::optional<std::string> junit_path;
+};
+
+struct BenchOptions {
+    BuildOptions build_opts;
+    // Passed on to the bench binaries, which only run benchmarks containing one of these
+    std::vector<std::string> filters;
+    // Compare against this saved baseline instead of the previous run
+    std::optional<std::string> baseline;
+    // Save the results under this name instead of `base`
+    std::optional<std::string> save_baseline;
+    std::optional<int> cpu;
+    std::optional<std::size_t> samples;
+};
+
+struct CheckOptions {
+    BuildOptions build_opts;
+};
+
+struct DepsOptions {
+    static constexpr std::size_t DEFAULT_TOP = 20;
+
+    // Rank headers by how many sources they rebuild instead of listing each source
+    bool headers = false;
+    // Number of headers to show, `DEFAULT_TOP` if unset
+    std::optional<std::size_t> top = {};
+};
+
+struct WatchOptions {
+    // The Freight command to rerun, with its arguments
+    std::vector<std::string> command;
+};
+
+struct FeaturesOptions {
+    FeatureSelection selection;
+};
+
+struct RegistryServeOptions {
+    static constexpr std::uint16_t DEFAULT_PORT = 8080;
+
+    // The registry directory to serve
+    std::string dir;
+    // 0 picks a free port
+    std::uint16_t port = DEFAULT_PORT;
+};
+
+struct RegistryPublishOptions {
+    // The registry directory to publish to
+    std::string dir;
+    // Prebuild the library with the release profile instead of the dev profile
+    bool release = false;
+};
+
 void exec_init(const InitOptions& opts);
 void exec_new(const NewOptions& opts);
 void exec_build(const BuildOptions& opts);
-void exec_run(const RunOptions& opts);
\ No newline at end of file
+void exec_run(const RunOptions& opts);
+void exec_test(const TestOptions& opts);
+void exec_bench(const BenchOptions& opts);
+void exec_check(const CheckOptions& opts);
+void exec_watch(const WatchOptions& opts);
+void exec_deps(const DepsOptions& opts);
+void exec_features(const FeaturesOptions& opts);
+void exec_registry_serve(const RegistryServeOptions& opts);
+void exec_registry_publish(const RegistryPublishOptions& opts);
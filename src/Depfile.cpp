@@ -0,0 +1,80 @@
+#include "Pch.h"
+
+#include "Depfile.h"
+
+#include <string>
+
+#include "Support/Io.h"
+
+std::vector<std::filesystem::path> parse_depfile(std::string_view text)
+{
+	std::vector<std::filesystem::path> prerequisites;
+	std::string current;
+	bool inTarget = true;
+
+	auto finishWord = [&] {
+		if (!current.empty() && !inTarget)
+		{
+			prerequisites.emplace_back(std::move(current));
+		}
+
+		current.clear();
+	};
+
+	for (std::size_t i = 0; i < text.size(); i++)
+	{
+		char c = text[i];
+		char next = i + 1 < text.size() ? text[i + 1] : '\0';
+
+		if (c == '\\' && (next == '\n' || next == '\r'))
+		{
+			// A line continuation
+			finishWord();
+			i += next == '\r' && i + 2 < text.size() && text[i + 2] == '\n' ? 2 : 1;
+		}
+		else if (c == '\\' && (next == ' ' || next == '#'))
+		{
+			current += next;
+			i++;
+		}
+		else if (c == '$' && next == '$')
+		{
+			current += '$';
+			i++;
+		}
+		else if (inTarget && c == ':' &&
+				 (next == ' ' || next == '\t' || next == '\n' || next == '\0'))
+		{
+			current.clear();
+			inTarget = false;
+		}
+		else if (c == '\n' && !inTarget)
+		{
+			// Only the first rule names the prerequisites of the object
+			break;
+		}
+		else if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+		{
+			finishWord();
+		}
+		else
+		{
+			current += c;
+		}
+	}
+
+	finishWord();
+	return prerequisites;
+}
+
+std::optional<std::vector<std::filesystem::path>> read_depfile(
+	const std::filesystem::path& file)
+{
+	auto text = io::read_file(file);
+	if (!text)
+	{
+		return {};
+	}
+
+	return parse_depfile(*text);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+/**
+ * Parses the Makefile rule clang writes with `-MD` or `-MMD`, returning its
+ * prerequisites in order. The first one is the source file itself.
+ */
+std::vector<std::filesystem::path> parse_depfile(std::string_view text);
+
+/**
+ * Reads and parses the depfile at `file`, or returns an empty optional if it couldn't
+ * be read.
+ */
+std::optional<std::vector<std::filesystem::path>> read_depfile(
+	const std::filesystem::path& file);
@@ -0,0 +1,334 @@
+#include "Pch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Build.h"
+#include "Cmds.h"
+#include "Support/Io.h"
+#include "Support/Util.h"
+#include "Workspace.h"
+
+namespace
+{
+using IncludeChain = std::vector<std::filesystem::path>;
+
+struct Include
+{
+	std::string name;
+	// `#include "name"` rather than `#include <name>`
+	bool quoted;
+};
+
+/**
+ * Lists the `#include` directives of a file. Conditional compilation is ignored, and
+ * includes naming a macro can't be followed.
+ */
+std::vector<Include> scan_includes(std::string_view text)
+{
+	static constexpr std::string_view WHITESPACE = " \t";
+
+	std::vector<Include> includes;
+	for (auto lineRange : text | std::views::split('\n'))
+	{
+		std::string_view line {lineRange};
+		line.remove_prefix(std::min(line.find_first_not_of(WHITESPACE), line.size()));
+		if (!line.starts_with('#'))
+		{
+			continue;
+		}
+
+		line.remove_prefix(1);
+		line.remove_prefix(std::min(line.find_first_not_of(WHITESPACE), line.size()));
+		if (!line.starts_with("include"))
+		{
+			continue;
+		}
+
+		line.remove_prefix(std::string_view {"include"}.size());
+		line.remove_prefix(std::min(line.find_first_not_of(WHITESPACE), line.size()));
+		if (line.empty() || (line.front() != '"' && line.front() != '<'))
+		{
+			continue;
+		}
+
+		char close = line.front() == '"' ? '"' : '>';
+		auto end = line.find(close, 1);
+		if (end != std::string_view::npos)
+		{
+			includes.push_back({
+				.name = std::string {line.substr(1, end - 1)},
+				.quoted = close == '"',
+			});
+		}
+	}
+
+	return includes;
+}
+
+/**
+ * The direct includes of each file, resolved against the headers a source is known to
+ * depend on. Files are only read once, however many sources include them.
+ */
+class IncludeGraph
+{
+public:
+	/**
+	 * The headers among `candidates` that `file` includes directly.
+	 */
+	std::vector<std::filesystem::path> includes(const std::filesystem::path& file,
+		std::span<const std::filesystem::path> candidates)
+	{
+		auto it = scanned.find(file);
+		if (it == scanned.end())
+		{
+			auto text = io::read_file(file).value_or("");
+			it = scanned.emplace(file, scan_includes(text)).first;
+		}
+
+		std::vector<std::filesystem::path> resolved;
+		for (auto& include : it->second)
+		{
+			if (auto header = resolve(file, include, candidates))
+			{
+				resolved.push_back(std::move(*header));
+			}
+		}
+
+		return resolved;
+	}
+private:
+	std::unordered_map<std::filesystem::path, std::vector<Include>> scanned;
+
+	/**
+	 * Quoted includes are looked up next to the including file first, like the
+	 * compiler does. Otherwise the first candidate whose path ends with the included
+	 * name is taken.
+	 */
+	static std::optional<std::filesystem::path> resolve(
+		const std::filesystem::path& file,
+		const Include& include,
+		std::span<const std::filesystem::path> candidates)
+	{
+		if (include.quoted)
+		{
+			auto sibling = (file.parent_path() / include.name).lexically_normal();
+			if (std::ranges::contains(candidates, sibling))
+			{
+				return sibling;
+			}
+		}
+
+		auto name = std::filesystem::path {include.name}.lexically_normal();
+		auto suffix = "/" + name.generic_string();
+		for (auto& candidate : candidates)
+		{
+			if (candidate.generic_string().ends_with(suffix))
+			{
+				return candidate;
+			}
+		}
+
+		return {};
+	}
+};
+
+struct HeaderImpact
+{
+	std::filesystem::path header;
+	// Sources that are recompiled when the header changes
+	std::size_t sources = 0;
+	// Sources among those whose compile time wasn't recorded
+	std::size_t unknownCost = 0;
+	std::chrono::microseconds cost {0};
+	// The shortest chain of includes from each source to the header
+	std::vector<IncludeChain> chains;
+};
+
+/**
+ * Finds the shortest include chain from `indexed.source` to each of its headers. Headers
+ * that can't be reached through the scanned includes get a chain without the headers
+ * in between.
+ */
+std::map<std::filesystem::path, IncludeChain> include_chains(const IndexedSource& indexed,
+	IncludeGraph& graph)
+{
+	std::map<std::filesystem::path, std::filesystem::path> parents;
+	std::deque<std::filesystem::path> queue {indexed.source};
+	while (!queue.empty())
+	{
+		auto file = std::move(queue.front());
+		queue.pop_front();
+		for (auto& header : graph.includes(file, indexed.headers))
+		{
+			if (header != indexed.source && parents.emplace(header, file).second)
+			{
+				queue.push_back(header);
+			}
+		}
+	}
+
+	std::map<std::filesystem::path, IncludeChain> chains;
+	for (auto& header : indexed.headers)
+	{
+		IncludeChain chain {header};
+		auto parent = parents.find(header);
+		while (parent != parents.end())
+		{
+			chain.push_back(parent->second);
+			parent = parents.find(parent->second);
+		}
+
+		if (chain.back() != indexed.source)
+		{
+			chain.push_back(indexed.source);
+		}
+
+		std::ranges::reverse(chain);
+		chains.emplace(header, std::move(chain));
+	}
+
+	return chains;
+}
+
+std::string format_duration(std::chrono::microseconds duration)
+{
+	return std::format("{:.2f}s", std::chrono::duration<double> {duration}.count());
+}
+
+std::string display_path(const Package& package, const std::filesystem::path& file)
+{
+	auto relative = file.lexically_relative(package.root());
+	return relative.empty() || *relative.begin() == ".." ? file.string()
+														 : relative.string();
+}
+
+void print_sources(const Package& package, std::span<const IndexedSource> index)
+{
+	for (auto& indexed : index)
+	{
+		std::println("{} ({} header(s){})",
+			display_path(package, indexed.source),
+			indexed.headers.size(),
+			indexed.duration ? ", " + format_duration(*indexed.duration) : "");
+		for (auto& header : indexed.headers)
+		{
+			std::println("    {}", display_path(package, header));
+		}
+	}
+}
+
+void print_header_impact(const Package& package,
+	std::span<const IndexedSource> index,
+	std::size_t top)
+{
+	static constexpr std::size_t CHAINS_PER_HEADER = 3;
+
+	IncludeGraph graph;
+	std::map<std::filesystem::path, HeaderImpact> impacts;
+	for (auto& indexed : index)
+	{
+		for (auto& [header, chain] : include_chains(indexed, graph))
+		{
+			auto& impact = impacts[header];
+			impact.header = header;
+			impact.sources++;
+			impact.chains.push_back(std::move(chain));
+			if (indexed.duration)
+			{
+				impact.cost += *indexed.duration;
+			}
+			else
+			{
+				impact.unknownCost++;
+			}
+		}
+	}
+
+	std::vector<HeaderImpact> ranked;
+	for (auto& [header, impact] : impacts)
+	{
+		ranked.push_back(std::move(impact));
+	}
+
+	std::ranges::sort(ranked, [](auto& a, auto& b) {
+		if (a.cost != b.cost)
+		{
+			return a.cost > b.cost;
+		}
+
+		return a.sources != b.sources ? a.sources > b.sources : a.header < b.header;
+	});
+
+	std::println("{} header(s) included by {} source(s)", ranked.size(), index.size());
+	for (auto& impact : ranked | std::views::take(top))
+	{
+		std::string unknown;
+		if (impact.unknownCost > 0)
+		{
+			unknown = std::format(" ({} not timed)", impact.unknownCost);
+		}
+
+		std::println("\n{}\n    rebuilds {} source(s), ~{} to recompile{}",
+			display_path(package, impact.header),
+			impact.sources,
+			format_duration(impact.cost),
+			unknown);
+
+		// Direct includes first, they are the easiest to cut
+		std::ranges::sort(impact.chains, [](auto& a, auto& b) {
+			return a.size() != b.size() ? a.size() < b.size() : a < b;
+		});
+		for (auto& chain : impact.chains | std::views::take(CHAINS_PER_HEADER))
+		{
+			std::string line;
+			for (auto& file : chain)
+			{
+				line += line.empty() ? "    " : " -> ";
+				line += display_path(package, file);
+			}
+
+			std::println("{}", line);
+		}
+
+		if (impact.chains.size() > CHAINS_PER_HEADER)
+		{
+			std::println("    ... and {} more", impact.chains.size() - CHAINS_PER_HEADER);
+		}
+	}
+}
+} // namespace
+
+void exec_deps(const DepsOptions& opts)
+{
+	using namespace std::filesystem;
+
+	auto cwd = current_path();
+	GlobalContext gctx {cwd};
+	Workspace ws {cwd / "Freight.toml", gctx};
+	auto& package = ws.current();
+
+	auto index = read_dependency_index(ws, package);
+	if (index.empty())
+	{
+		bail("no dependency information for `{}` yet\n\n{}",
+			package.name(),
+			cause("run `freight build` first"));
+	}
+
+	if (opts.headers)
+	{
+		print_header_impact(package, index, opts.top.value_or(DepsOptions::DEFAULT_TOP));
+	}
+	else
+	{
+		print_sources(package, index);
+	}
+}
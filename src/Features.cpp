@@ -0,0 +1,319 @@
+#include "Pch.h"
+
+#include "Features.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <print>
+#include <string_view>
+#include <unordered_set>
+
+#include "Cmds.h"
+#include "Support/Util.h"
+
+namespace
+{
+constexpr std::string_view COMMAND_LINE = "command line";
+
+class FeatureResolver
+{
+private:
+	const Workspace *ws;
+	FeatureResolution resolution;
+	std::unordered_set<const Package *> visited;
+public:
+	explicit FeatureResolver(const Workspace& ws) : ws {&ws}
+	{
+	}
+
+	void add_root(const Package& package,
+		const FeatureSelection& selection,
+		std::string_view reason)
+	{
+		visit(package);
+
+		if (selection.defaults)
+		{
+			enable(package, "default", reason);
+		}
+
+		for (auto& feature : selection.features)
+		{
+			enable(package, feature, reason);
+		}
+
+		if (selection.all)
+		{
+			for (auto& [feature, enables] : package.manifest().features())
+			{
+				enable(package, feature, reason);
+			}
+		}
+	}
+
+	FeatureResolution finish() &&
+	{
+		return std::move(resolution);
+	}
+private:
+	/**
+	 * Adds `package` and its required dependencies, with the features they ask for.
+	 */
+	void visit(const Package& package)
+	{
+		resolution.packages.try_emplace(&package);
+		if (!visited.insert(&package).second)
+		{
+			return;
+		}
+
+		for (auto& dependency : package.dependencies())
+		{
+			if (!dependency.optional)
+			{
+				add_dependency(package, dependency);
+			}
+		}
+	}
+
+	const Package& add_dependency(const Package& dependent, const Dependency& dependency)
+	{
+		auto& loaded = ws->resolve(dependent, dependency);
+		visit(loaded);
+
+		if (dependency.defaultFeatures)
+		{
+			enable(loaded, "default", dependent.name());
+		}
+
+		for (auto& feature : dependency.features)
+		{
+			enable(loaded, feature, dependent.name());
+		}
+
+		return loaded;
+	}
+
+	static const Dependency& find_dependency(const Package& package,
+		std::string_view name)
+	{
+		// Feature entries were checked against the dependencies when loading the manifest
+		auto dependencies = package.dependencies();
+		return *std::ranges::find(dependencies, name, &Dependency::name);
+	}
+
+	void enable(const Package& package, std::string_view feature, std::string_view reason)
+	{
+		auto& features = package.manifest().features();
+		auto declared = features.find(std::string {feature});
+		if (declared == features.end())
+		{
+			// Every package has default features, there just may be none
+			if (feature == "default")
+			{
+				return;
+			}
+
+			bail("failed to resolve the features of `{}`\n\n{}",
+				package.name(),
+				cause("`{}` asked for feature `{}`, but there is no such feature",
+					reason,
+					feature));
+		}
+
+		// Packages are only ever added, which doesn't move the others
+		auto& state = resolution.packages[&package];
+		state.enabledBy[declared->first].emplace(reason);
+		if (!state.enabled.insert(declared->first).second)
+		{
+			return;
+		}
+
+		auto self = std::format("{}/{}", package.name(), feature);
+		for (std::string_view entry : declared->second)
+		{
+			auto slash = entry.find('/');
+			if (entry.starts_with("dep:"))
+			{
+				auto& dependency = find_dependency(package, entry.substr(4));
+				if (state.optionalDependencies.insert(dependency.name).second)
+				{
+					add_dependency(package, dependency);
+				}
+			}
+			else if (slash != std::string_view::npos)
+			{
+				// Enabling a feature of an optional dependency enables the dependency
+				auto& dependency = find_dependency(package, entry.substr(0, slash));
+				if (dependency.optional &&
+					state.optionalDependencies.insert(dependency.name).second)
+				{
+					add_dependency(package, dependency);
+				}
+
+				enable(ws->resolve(package, dependency), entry.substr(slash + 1), self);
+			}
+			else
+			{
+				enable(package, entry, self);
+			}
+		}
+	}
+};
+
+/**
+ * Counts the sources of the library of `package`, which is what enabling it costs.
+ */
+std::size_t library_sources(const Package& package)
+{
+	std::size_t count = 0;
+	for (auto& target : package.targets())
+	{
+		if (target.kind != TargetKind::Lib)
+		{
+			continue;
+		}
+
+		for (auto& path : target.paths)
+		{
+			std::error_code errc;
+			if (!std::filesystem::is_directory(path, errc))
+			{
+				count++;
+				continue;
+			}
+
+			for (auto& entry : std::filesystem::recursive_directory_iterator {path, errc})
+			{
+				count += entry.is_regular_file() ? 1 : 0;
+			}
+		}
+	}
+
+	return count;
+}
+
+std::string join(const std::set<std::string>& strings)
+{
+	std::string joined;
+	for (auto& str : strings)
+	{
+		joined += joined.empty() ? "" : ", ";
+		joined += std::format("`{}`", str);
+	}
+
+	return joined;
+}
+} // namespace
+
+const PackageFeatures *FeatureResolution::find(const Package& package) const
+{
+	auto it = packages.find(&package);
+	return it != packages.end() ? &it->second : nullptr;
+}
+
+bool FeatureResolution::dependency_enabled(const Package& dependent,
+	const Dependency& dependency) const
+{
+	auto *features = find(dependent);
+	return features && features->optionalDependencies.contains(dependency.name);
+}
+
+std::vector<std::string> FeatureResolution::defines(const Package& package) const
+{
+	std::vector<std::string> defines;
+	auto *features = find(package);
+	if (features == nullptr)
+	{
+		return defines;
+	}
+
+	for (auto& feature : features->enabled)
+	{
+		auto define = std::format("FREIGHT_FEATURE_{}", feature);
+		std::ranges::transform(define, define.begin(), [](char c) {
+			return c == '-' ? '_' : static_cast<char>(std::toupper(c));
+		});
+		defines.push_back(std::move(define));
+	}
+
+	return defines;
+}
+
+FeatureResolution resolve_features(const Workspace& ws,
+	const Package& package,
+	const FeatureSelection& selection)
+{
+	FeatureResolver resolver {ws};
+	resolver.add_root(package, selection, COMMAND_LINE);
+
+	// Other members share `target/` with the package, so their dependencies are built
+	// with the features they need too, instead of being rebuilt when switching members
+	for (auto& member : ws.members())
+	{
+		if (&member != &package)
+		{
+			resolver.add_root(member, FeatureSelection {}, member.name());
+		}
+	}
+
+	return std::move(resolver).finish();
+}
+
+void exec_features(const FeaturesOptions& opts)
+{
+	using namespace std::filesystem;
+
+	auto cwd = current_path();
+	GlobalContext gctx {cwd};
+	Workspace ws {cwd / "Freight.toml", gctx};
+	auto& package = ws.current();
+
+	auto resolution = resolve_features(ws, package, opts.selection);
+	std::vector<const Package *> packages {&package};
+	std::ranges::copy(ws.dependencies(package, resolution), std::back_inserter(packages));
+
+	for (auto *member : packages)
+	{
+		auto& features = *resolution.find(*member);
+		std::println("{} v{}", member->name(), member->version());
+		for (auto& feature : features.enabled)
+		{
+			std::println("    {} (enabled by {})",
+				feature,
+				join(features.enabledBy.at(feature)));
+		}
+
+		// Optional dependencies are what features cost the most: whole libraries built
+		// and linked that wouldn't be otherwise
+		for (auto& dependency : member->dependencies())
+		{
+			if (!features.optionalDependencies.contains(dependency.name))
+			{
+				continue;
+			}
+
+			std::set<std::string> enabledBy;
+			for (auto& [feature, enables] : member->manifest().features())
+			{
+				auto enablesDependency = [&dependency](std::string_view entry) {
+					return entry == std::format("dep:{}", dependency.name) ||
+						   entry.starts_with(dependency.name + '/');
+				};
+				if (features.enabled.contains(feature) &&
+					std::ranges::any_of(enables, enablesDependency))
+				{
+					enabledBy.insert(std::format("{}/{}", member->name(), feature));
+				}
+			}
+
+			auto& loaded = ws.resolve(*member, dependency);
+			std::println("    \033[33mdep:{}\033[39m ({} library source(s), "
+						 "enabled by {})",
+				dependency.name,
+				library_sources(loaded),
+				join(enabledBy));
+		}
+	}
+}
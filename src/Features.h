@@ -0,0 +1,66 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Workspace.h"
+
+/**
+ * The features asked for on the command line, for the package being built.
+ */
+struct FeatureSelection
+{
+	std::vector<std::string> features;
+	// Enable every feature of the package
+	bool all = false;
+	// Enable the `default` feature of the package
+	bool defaults = true;
+};
+
+/**
+ * The features of one package, unified over everything depending on it.
+ */
+struct PackageFeatures
+{
+	std::set<std::string> enabled;
+	// The optional dependencies the enabled features turned on
+	std::set<std::string> optionalDependencies;
+	// What enabled each feature: the command line, a package depending on this one like
+	// `app`, or a feature like `app/full`
+	std::map<std::string, std::set<std::string>> enabledBy;
+};
+
+/**
+ * The features of every package in a build.
+ */
+struct FeatureResolution
+{
+	std::unordered_map<const Package *, PackageFeatures> packages;
+
+	const PackageFeatures *find(const Package& package) const;
+
+	/**
+	 * Whether the optional `dependency` of `dependent` was enabled by a feature.
+	 */
+	bool dependency_enabled(const Package& dependent, const Dependency& dependency) const;
+
+	/**
+	 * Defines `FREIGHT_FEATURE_<NAME>` for every enabled feature of `package`, with the
+	 * name uppercased and `-` replaced by `_`.
+	 */
+	std::vector<std::string> defines(const Package& package) const;
+};
+
+/**
+ * Resolves the features of `package` as selected on the command line, those of the
+ * other members of `ws` with their default features, and those of everything they
+ * depend on. Features are unified: each package gets the union of what everything
+ * depending on it asks for, so it is built once however many packages depend on it.
+ * Bails if a feature that was asked for doesn't exist.
+ */
+FeatureResolution resolve_features(const Workspace& ws,
+	const Package& package,
+	const FeatureSelection& selection);
@@ -0,0 +1,183 @@
+#include "Pch.h"
+
+#include "Fingerprint.h"
+
+#include <algorithm>
+
+#include "Support/Hash.h"
+#include "Support/Io.h"
+
+static constexpr std::string_view HEADER = "freight-fingerprint 1";
+
+hash::Digest Fingerprint::digest() const
+{
+	hash::Hasher hasher;
+	for (auto& arg : args_)
+	{
+		hasher.update(arg);
+		hasher.update(std::string_view {"\0", 1});
+	}
+
+	for (auto& input : inputs_)
+	{
+		hasher.update(input.path.string());
+		hasher.update(input.digest);
+	}
+
+	return hasher.finish();
+}
+
+Fingerprint::Diff Fingerprint::diff(const Fingerprint& previous) const
+{
+	Diff diff;
+
+	// Arguments are compared through their longest common subsequence, so a single
+	// inserted flag doesn't show every later argument as changed
+	auto& before = previous.args_;
+	auto& after = args_;
+	std::vector<std::vector<std::size_t>> common(
+		before.size() + 1, std::vector<std::size_t>(after.size() + 1));
+	for (std::size_t i = before.size(); i-- > 0;)
+	{
+		for (std::size_t j = after.size(); j-- > 0;)
+		{
+			common[i][j] = before[i] == after[j]
+							   ? common[i + 1][j + 1] + 1
+							   : std::max(common[i + 1][j], common[i][j + 1]);
+		}
+	}
+
+	std::size_t i = 0;
+	std::size_t j = 0;
+	while (i < before.size() || j < after.size())
+	{
+		if (i < before.size() && j < after.size() && before[i] == after[j])
+		{
+			i++;
+			j++;
+		}
+		else if (j == after.size() ||
+				 (i < before.size() && common[i + 1][j] >= common[i][j + 1]))
+		{
+			diff.removedArgs.push_back(before[i++]);
+		}
+		else
+		{
+			diff.addedArgs.push_back(after[j++]);
+		}
+	}
+
+	for (auto& input : inputs_)
+	{
+		auto old = std::ranges::find(previous.inputs_, input.path, &Input::path);
+		if (old == previous.inputs_.end())
+		{
+			diff.addedInputs.push_back(input.path);
+		}
+		else if (old->digest != input.digest)
+		{
+			diff.changedInputs.push_back(input.path);
+		}
+	}
+
+	for (auto& input : previous.inputs_)
+	{
+		if (std::ranges::find(inputs_, input.path, &Input::path) == inputs_.end())
+		{
+			diff.removedInputs.push_back(input.path);
+		}
+	}
+
+	return diff;
+}
+
+std::string Fingerprint::serialize() const
+{
+	std::string text {HEADER};
+	text += '\n';
+
+	for (auto& arg : args_)
+	{
+		text += std::format("arg {}\n", arg);
+	}
+
+	for (auto& input : inputs_)
+	{
+		text += std::format("input {} {}\n", hash::to_hex(input.digest), input.path.string());
+	}
+
+	return text;
+}
+
+std::optional<Fingerprint> Fingerprint::parse(std::string_view text)
+{
+	auto lines = text | std::views::split('\n');
+	auto it = lines.begin();
+	if (it == lines.end() || std::string_view {*it} != HEADER)
+	{
+		return {};
+	}
+
+	Fingerprint fingerprint;
+	for (++it; it != lines.end(); ++it)
+	{
+		std::string_view line {*it};
+		if (line.empty())
+		{
+			continue;
+		}
+
+		auto space = line.find(' ');
+		if (space == std::string_view::npos)
+		{
+			return {};
+		}
+
+		auto kind = line.substr(0, space);
+		auto rest = line.substr(space + 1);
+		if (kind == "arg")
+		{
+			fingerprint.add_arg(rest);
+		}
+		else if (kind == "input")
+		{
+			auto pathStart = rest.find(' ');
+			if (pathStart == std::string_view::npos)
+			{
+				return {};
+			}
+
+			auto digest = hash::from_hex(rest.substr(0, pathStart));
+			if (!digest)
+			{
+				return {};
+			}
+
+			fingerprint.add_input(rest.substr(pathStart + 1), *digest);
+		}
+		else
+		{
+			return {};
+		}
+	}
+
+	return fingerprint;
+}
+
+std::optional<Fingerprint> Fingerprint::load(const std::filesystem::path& file)
+{
+	auto text = io::read_file(file);
+	if (!text)
+	{
+		return {};
+	}
+
+	return parse(*text);
+}
+
+bool Fingerprint::save(const std::filesystem::path& file) const
+{
+	std::error_code err;
+	std::filesystem::create_directories(file.parent_path(), err);
+	return !err && io::write_file_atomic(file, serialize());
+}
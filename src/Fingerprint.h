@@ -0,0 +1,78 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Support/Hash.h"
+
+/**
+ * Everything a build step's output depends on: the arguments passed to the tool and
+ * the content hash of every input, in order. A step is up to date if the fingerprint
+ * recorded after its last successful run equals the one computed now.
+ */
+class Fingerprint
+{
+public:
+	struct Input
+	{
+		std::filesystem::path path;
+		hash::Digest digest;
+
+		bool operator==(const Input&) const = default;
+	};
+
+	Fingerprint() = default;
+
+	void add_arg(std::string_view arg)
+	{
+		args_.emplace_back(arg);
+	}
+
+	void add_input(const std::filesystem::path& path, hash::Digest digest)
+	{
+		inputs_.push_back({path, digest});
+	}
+
+	const std::vector<std::string>& args() const
+	{
+		return args_;
+	}
+
+	const std::vector<Input>& inputs() const
+	{
+		return inputs_;
+	}
+
+	hash::Digest digest() const;
+
+	std::string serialize() const;
+	static std::optional<Fingerprint> parse(std::string_view text);
+
+	static std::optional<Fingerprint> load(const std::filesystem::path& file);
+	bool save(const std::filesystem::path& file) const;
+
+	/**
+	 * How a fingerprint differs from the one recorded by the step's last run.
+	 */
+	struct Diff
+	{
+		// Arguments left out or added, in the order of the old and new fingerprint
+		std::vector<std::string> removedArgs;
+		std::vector<std::string> addedArgs;
+		// Inputs in both fingerprints, but with different contents
+		std::vector<std::filesystem::path> changedInputs;
+		std::vector<std::filesystem::path> removedInputs;
+		std::vector<std::filesystem::path> addedInputs;
+	};
+
+	Diff diff(const Fingerprint& previous) const;
+
+	bool operator==(const Fingerprint&) const = default;
+private:
+	std::vector<std::string> args_;
+	std::vector<Input> inputs_;
+};
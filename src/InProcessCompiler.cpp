@@ -0,0 +1,377 @@
+#include "Pch.h"
+
+#include "InProcessCompiler.h"
+
+#include "Support/Util.h"
+
+#ifdef FREIGHT_IN_PROCESS_CLANG
+
+	#include <mutex>
+	#include <optional>
+	#include <vector>
+
+	#include <unistd.h>
+
+	#include <clang/Basic/Diagnostic.h>
+	#include <clang/Basic/DiagnosticOptions.h>
+	#include <clang/CodeGen/CodeGenAction.h>
+	#include <clang/Driver/Compilation.h>
+	#include <clang/Driver/Driver.h>
+	#include <clang/Driver/Job.h>
+	#include <clang/Frontend/CompilerInstance.h>
+	#include <clang/Frontend/CompilerInvocation.h>
+	#include <clang/Frontend/FrontendActions.h>
+	#include <clang/Frontend/TextDiagnosticPrinter.h>
+	#include <clang/Lex/PreprocessorOptions.h>
+	#include <llvm/ADT/StringMap.h>
+	#include <llvm/Support/MemoryBuffer.h>
+	#include <llvm/Support/Path.h>
+	#include <llvm/Support/TargetSelect.h>
+	#include <llvm/Support/TimeProfiler.h>
+	#include <llvm/Support/VirtualFileSystem.h>
+	#include <llvm/Support/raw_ostream.h>
+
+namespace
+{
+/**
+ * A file whose contents were read by `SharedCachingFileSystem`.
+ */
+class CachedFile final : public llvm::vfs::File
+{
+public:
+	CachedFile(llvm::vfs::Status status, std::shared_ptr<const llvm::MemoryBuffer> buffer)
+		: status_ {std::move(status)},
+		  buffer {std::move(buffer)}
+	{
+	}
+
+	llvm::ErrorOr<llvm::vfs::Status> status() override
+	{
+		return status_;
+	}
+
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(const llvm::Twine& name,
+		int64_t,
+		bool requiresNullTerminator,
+		bool) override
+	{
+		// The shared buffer outlives the build, so handing out views of it is safe
+		return llvm::MemoryBuffer::getMemBuffer(buffer->getBuffer(),
+			name.str(),
+			requiresNullTerminator);
+	}
+
+	std::error_code close() override
+	{
+		return {};
+	}
+private:
+	llvm::vfs::Status status_;
+	std::shared_ptr<const llvm::MemoryBuffer> buffer;
+};
+
+/**
+ * Caches the status and contents of every file in front of the real filesystem, and
+ * serves files in the source snapshot from there instead. Each compile has its own
+ * `FileManager`, as those aren't thread-safe, but they all sit on top of this.
+ */
+class SharedCachingFileSystem final : public llvm::vfs::ProxyFileSystem
+{
+public:
+	explicit SharedCachingFileSystem(const SourceSnapshot& snapshot)
+		: ProxyFileSystem {llvm::vfs::getRealFileSystem()},
+		  snapshot {&snapshot}
+	{
+	}
+
+	llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override
+	{
+		auto key = path.str();
+		{
+			std::lock_guard lock {mutex};
+			if (auto it = statuses.find(key); it != statuses.end())
+			{
+				return it->second;
+			}
+		}
+
+		auto *snapshotted = find_in_snapshot(key);
+		auto result = snapshotted != nullptr
+						  ? ProxyFileSystem::status(snapshotted->blob.string())
+						  : ProxyFileSystem::status(key);
+		if (result && snapshotted != nullptr)
+		{
+			result = llvm::vfs::Status::copyWithNewName(*result, key);
+		}
+
+		std::lock_guard lock {mutex};
+		return statuses.try_emplace(key, result).first->second;
+	}
+
+	llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+		const llvm::Twine& path) override
+	{
+		auto key = path.str();
+		{
+			std::lock_guard lock {mutex};
+			if (auto it = files.find(key); it != files.end())
+			{
+				return std::make_unique<CachedFile>(it->second.status, it->second.buffer);
+			}
+		}
+
+		auto entry = read_entry(key);
+		if (!entry)
+		{
+			return entry.getError();
+		}
+
+		// Two threads may race to read the same file, in which case the first one wins
+		std::lock_guard lock {mutex};
+		auto& cached = files.try_emplace(key, std::move(*entry)).first->second;
+		return std::make_unique<CachedFile>(cached.status, cached.buffer);
+	}
+private:
+	struct Entry
+	{
+		llvm::vfs::Status status;
+		std::shared_ptr<const llvm::MemoryBuffer> buffer;
+	};
+
+	const SourceSnapshot *snapshot;
+	std::mutex mutex;
+	llvm::StringMap<llvm::ErrorOr<llvm::vfs::Status>> statuses;
+	llvm::StringMap<Entry> files;
+
+	const SourceSnapshot::File *find_in_snapshot(const std::string& path)
+	{
+		llvm::SmallString<256> absolute {path};
+		if (makeAbsolute(absolute))
+		{
+			return nullptr;
+		}
+
+		llvm::sys::path::remove_dots(absolute, true);
+		return snapshot->find(std::filesystem::path {absolute.str().str()});
+	}
+
+	llvm::ErrorOr<Entry> read_entry(const std::string& path)
+	{
+		auto *snapshotted = find_in_snapshot(path);
+		auto file = ProxyFileSystem::openFileForRead(
+			snapshotted != nullptr ? snapshotted->blob.string() : path);
+		if (!file)
+		{
+			return file.getError();
+		}
+
+		auto status = (*file)->status();
+		if (!status)
+		{
+			return status.getError();
+		}
+
+		if (snapshotted != nullptr)
+		{
+			// Mappings are zero-filled up to the end of their last page, which gives
+			// clang its null terminator for free, unless the file fills the page exactly
+			auto bytes = snapshotted->contents.bytes();
+			llvm::StringRef contents {reinterpret_cast<const char *>(bytes.data()),
+				bytes.size()};
+			auto pageSize = static_cast<std::size_t>(getpagesize());
+			return Entry {
+				.status = llvm::vfs::Status::copyWithNewName(*status, path),
+				.buffer = bytes.size() % pageSize != 0
+							  ? llvm::MemoryBuffer::getMemBuffer(contents, path, true)
+							  : llvm::MemoryBuffer::getMemBufferCopy(contents, path),
+			};
+		}
+
+		auto buffer = (*file)->getBuffer(path);
+		if (!buffer)
+		{
+			return buffer.getError();
+		}
+
+		return Entry {
+			.status = llvm::vfs::Status::copyWithNewName(*status, path),
+			.buffer = std::move(*buffer),
+		};
+	}
+};
+
+std::once_flag initializeTargetsOnce;
+// Keeps the diagnostics of concurrent compiles from interleaving
+std::mutex diagnosticsMutex;
+} // namespace
+
+struct InProcessCompiler::Impl
+{
+	std::string clangPath;
+	std::string triple;
+	llvm::IntrusiveRefCntPtr<SharedCachingFileSystem> fileSystem;
+	std::optional<std::uint64_t> sourceDateEpoch;
+};
+
+bool InProcessCompiler::available()
+{
+	return true;
+}
+
+InProcessCompiler::InProcessCompiler(const Toolchain& toolchain,
+	const SourceSnapshot& snapshot)
+	: impl {std::make_unique<Impl>(Impl {
+		  .clangPath = toolchain.clang.path.string(),
+		  .triple = toolchain.triple,
+		  .fileSystem = llvm::makeIntrusiveRefCnt<SharedCachingFileSystem>(snapshot),
+	  })}
+{
+	std::call_once(initializeTargetsOnce, [] {
+		llvm::InitializeAllTargets();
+		llvm::InitializeAllTargetMCs();
+		llvm::InitializeAllAsmPrinters();
+		llvm::InitializeAllAsmParsers();
+	});
+}
+
+InProcessCompiler::~InProcessCompiler() = default;
+
+bool InProcessCompiler::compile(std::span<const std::string> args)
+{
+	// Freight always drives clang as `clang++`, whatever the binary is called
+	std::vector<const char *> argv {args[0].c_str(), "--driver-mode=g++"};
+	for (auto& arg : args.subspan(1))
+	{
+		argv.push_back(arg.c_str());
+	}
+
+	std::string diagnostics;
+	llvm::raw_string_ostream diagnosticsStream {diagnostics};
+	auto diagOpts = llvm::makeIntrusiveRefCnt<clang::DiagnosticOptions>();
+	diagOpts->ShowColors = isatty(STDERR_FILENO) != 0;
+	auto *printer = new clang::TextDiagnosticPrinter {diagnosticsStream, diagOpts.get()};
+	clang::DiagnosticsEngine diags {
+		llvm::makeIntrusiveRefCnt<clang::DiagnosticIDs>(),
+		diagOpts,
+		printer,
+	};
+
+	auto report = [&](bool ok) {
+		diagnosticsStream.flush();
+		if (!diagnostics.empty())
+		{
+			std::lock_guard lock {diagnosticsMutex};
+			std::cerr << diagnostics;
+		}
+
+		return ok;
+	};
+
+	// Let the driver turn the command line into the single `-cc1` invocation it would
+	// have run
+	clang::driver::Driver driver {
+		impl->clangPath, impl->triple, diags, "freight", impl->fileSystem};
+	std::unique_ptr<clang::driver::Compilation> compilation {
+		driver.BuildCompilation(argv)};
+	if (!compilation || diags.hasErrorOccurred())
+	{
+		return report(false);
+	}
+
+	auto& jobs = compilation->getJobs();
+	if (jobs.size() != 1 || !llvm::isa<clang::driver::Command>(*jobs.begin()))
+	{
+		diagnosticsStream
+			<< "error: the in-process backend can only run a single compile\n";
+		return report(false);
+	}
+
+	auto& cc1Args = llvm::cast<clang::driver::Command>(*jobs.begin()).getArguments();
+
+	clang::CompilerInstance instance;
+	if (!clang::CompilerInvocation::CreateFromArgs(
+			instance.getInvocation(), cc1Args, diags, argv[0]))
+	{
+		return report(false);
+	}
+
+	if (impl->sourceDateEpoch)
+	{
+		instance.getPreprocessorOpts().SourceDateEpoch = impl->sourceDateEpoch;
+	}
+
+	instance.createDiagnostics(printer, false);
+	instance.createFileManager(impl->fileSystem);
+
+	// `clang -cc1` sets up `-ftime-trace` itself rather than the frontend action. The
+	// profiler is per thread, so concurrent compiles each get their own.
+	auto& frontendOpts = instance.getFrontendOpts();
+	bool tracing = !frontendOpts.TimeTracePath.empty();
+	if (tracing)
+	{
+		llvm::timeTraceProfilerInitialize(frontendOpts.TimeTraceGranularity, argv[0]);
+	}
+
+	bool ok = false;
+	if (frontendOpts.ProgramAction == clang::frontend::ParseSyntaxOnly)
+	{
+		// `freight check` only parses
+		clang::SyntaxOnlyAction action;
+		ok = instance.ExecuteAction(action);
+	}
+	else
+	{
+		clang::EmitObjAction action;
+		ok = instance.ExecuteAction(action);
+	}
+
+	if (tracing)
+	{
+		if (auto err = llvm::timeTraceProfilerWrite(
+				frontendOpts.TimeTracePath, frontendOpts.OutputFile))
+		{
+			diagnosticsStream << "error: failed to write the time trace: "
+							  << llvm::toString(std::move(err)) << "\n";
+			ok = false;
+		}
+
+		llvm::timeTraceProfilerCleanup();
+	}
+
+	return report(ok);
+}
+
+void InProcessCompiler::set_source_date_epoch(std::uint64_t seconds)
+{
+	impl->sourceDateEpoch = seconds;
+}
+
+#else
+
+struct InProcessCompiler::Impl
+{
+};
+
+bool InProcessCompiler::available()
+{
+	return false;
+}
+
+InProcessCompiler::InProcessCompiler(const Toolchain&, const SourceSnapshot&)
+{
+	bail("Freight was built without support for compiling in-process\n\n{}",
+		cause("rebuild Freight with `-DFREIGHT_IN_PROCESS_CLANG=ON`"));
+}
+
+InProcessCompiler::~InProcessCompiler() = default;
+
+bool InProcessCompiler::compile(std::span<const std::string>)
+{
+	return false;
+}
+
+void InProcessCompiler::set_source_date_epoch(std::uint64_t)
+{
+}
+
+#endif
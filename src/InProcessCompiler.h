@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "SourceSnapshot.h"
+#include "Toolchain.h"
+
+/**
+ * Compiles translation units through the clang libraries on the calling thread,
+ * instead of spawning a compiler process for each. All compiles share one caching
+ * filesystem, so every header is only stat'd and read once per build, and files in
+ * the build's source snapshot are read straight from its mappings.
+ *
+ * Only available if Freight was built with `-DFREIGHT_IN_PROCESS_CLANG=ON`.
+ */
+class InProcessCompiler
+{
+public:
+	static bool available();
+
+	/**
+	 * `snapshot` must outlive the compiler.
+	 */
+	InProcessCompiler(const Toolchain& toolchain, const SourceSnapshot& snapshot);
+	~InProcessCompiler();
+	InProcessCompiler(const InProcessCompiler&) = delete;
+	InProcessCompiler& operator=(const InProcessCompiler&) = delete;
+	InProcessCompiler(InProcessCompiler&&) = delete;
+	InProcessCompiler& operator=(InProcessCompiler&&) = delete;
+
+	/**
+	 * Compiles like running `args` with `clang++` would, where `args[0]` is the program
+	 * name. May be called from several threads at once; the diagnostics of each compile
+	 * are written to stderr in one piece once it finishes.
+	 */
+	bool compile(std::span<const std::string> args);
+
+	/**
+	 * Fixes the time `__DATE__` and `__TIME__` expand to, like `SOURCE_DATE_EPOCH` does
+	 * for a compiler process, without changing Freight's own environment.
+	 */
+	void set_source_date_epoch(std::uint64_t seconds);
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+};
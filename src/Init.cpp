@@ -73,7 +73,7 @@ static Manifest get_default_manifest([[maybe_unused]] const GlobalContext& gctx,
 {
 	std::string packageName = packageDir.string();
 	std::vector<Target> targets = {Target {.name = packageName, .paths = {"src"}}};
-	return {{}, packageName, std::move(targets), Standard::CXX23};
+	return {{}, packageName, std::move(targets), Standard::CXX23, {}};
 }
 
 static bool has_manifest(const std::filesystem::path& dir)
@@ -0,0 +1,225 @@
+#include "Pch.h"
+
+#include "Lockfile.h"
+
+#include <algorithm>
+
+#include "Support/Io.h"
+#include "Support/Util.h"
+#include "tomlplusplus/tomlplusplus.h"
+
+static constexpr std::int64_t LOCKFILE_VERSION = 2;
+
+const LockedPackage *Lockfile::find(std::string_view name) const
+{
+	auto it = std::ranges::find(packages, name, &LockedPackage::name);
+	return it != packages.end() ? &*it : nullptr;
+}
+
+std::optional<Lockfile> Lockfile::load(const std::filesystem::path& file)
+{
+	auto text = io::read_file(file);
+	if (!text)
+	{
+		return {};
+	}
+
+	toml::parse_result result = toml::parse(*text, file.string());
+	auto version = result ? result.table()["version"].value_or(std::int64_t {0}) : 0;
+	if (version != LOCKFILE_VERSION)
+	{
+		return {};
+	}
+
+	Lockfile lockfile;
+	auto *packages = result.table()["package"].as_array();
+	if (packages == nullptr)
+	{
+		return lockfile;
+	}
+
+	for (auto& node : *packages)
+	{
+		toml::node_view<toml::node> package {node};
+		if (!package["name"].is_string() || !package["source"].is_string())
+		{
+			return {};
+		}
+
+		LockedPackage locked {
+			.name = package["name"].as_string()->get(),
+			.version = package["version"].value_or(std::string {}),
+			.source = package["source"].as_string()->get(),
+			.checksum = {},
+			.contentHash = {},
+			.dependencies = {},
+		};
+
+		// Registry packages can't be verified without their checksum
+		if (auto checksum = package["checksum"].value<std::string_view>())
+		{
+			locked.checksum = sha256::from_hex(*checksum);
+			if (!locked.checksum)
+			{
+				return {};
+			}
+		}
+		else if (locked.source.starts_with("registry+"))
+		{
+			return {};
+		}
+
+		if (auto contentHash = package["content-hash"].value<std::string_view>())
+		{
+			locked.contentHash = hash::from_hex(*contentHash);
+			if (!locked.contentHash)
+			{
+				return {};
+			}
+		}
+
+		if (auto *dependencies = package["dependencies"].as_array())
+		{
+			for (auto& dependency : *dependencies)
+			{
+				if (auto *name = dependency.as_string())
+				{
+					locked.dependencies.push_back(name->get());
+				}
+			}
+		}
+
+		lockfile.packages.push_back(std::move(locked));
+	}
+
+	return lockfile;
+}
+
+static std::string quote(std::string_view str)
+{
+	std::string quoted = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+		}
+
+		quoted += c;
+	}
+
+	return quoted + '"';
+}
+
+std::string Lockfile::to_toml() const
+{
+	std::string text = std::format("# This file is generated by Freight, don't edit it.\n"
+								   "version = {}\n",
+		LOCKFILE_VERSION);
+	for (auto& package : packages)
+	{
+		text += std::format("\n[[package]]\nname = {}\nversion = {}\nsource = {}\n",
+			quote(package.name),
+			quote(package.version),
+			quote(package.source));
+		if (package.checksum)
+		{
+			text += std::format("checksum = \"{}\"\n", sha256::to_hex(*package.checksum));
+		}
+
+		if (package.contentHash)
+		{
+			text += std::format(
+				"content-hash = \"{}\"\n", hash::to_hex(*package.contentHash));
+		}
+
+		if (!package.dependencies.empty())
+		{
+			text += "dependencies = [\n";
+			for (auto& dependency : package.dependencies)
+			{
+				text += std::format("    {},\n", quote(dependency));
+			}
+
+			text += "]\n";
+		}
+	}
+
+	return text;
+}
+
+hash::Digest package_checksum(const Package& package, const SourceSnapshot& snapshot)
+{
+	hash::Hasher hasher;
+	hasher.update(hash::hash_file(package.manifest_path()).value_or(0));
+	hasher.update(snapshot.tree_digest(package.root()));
+	return hasher.finish();
+}
+
+void update_lockfile(const Workspace& ws,
+	std::span<const Package *const> dependencies,
+	const std::unordered_map<const Package *, hash::Digest>& checksums)
+{
+	auto file = ws.lockfile_path();
+	auto previous = Lockfile::load(file);
+	if (dependencies.empty() && !previous)
+	{
+		return;
+	}
+
+	Lockfile lockfile;
+	for (auto *package : dependencies)
+	{
+		auto checksum = checksums.find(package);
+		auto source = package->root().lexically_relative(ws.root());
+		LockedPackage locked {
+			.name = package->name(),
+			.version = package->version(),
+			.source = std::format("path+{}", source.generic_string()),
+			.checksum = {},
+			.contentHash = {},
+			.dependencies = {},
+		};
+
+		if (checksum != checksums.end())
+		{
+			locked.contentHash = checksum->second;
+		}
+
+		// Registry packages are pinned to the version and archive they were resolved to
+		if (auto *registry = ws.registry_source(*package))
+		{
+			locked.version = registry->version;
+			locked.source = std::format("registry+{}", registry->registry);
+			locked.checksum = registry->checksum;
+			locked.contentHash.reset();
+		}
+
+		// Optional dependencies no enabled feature asked for aren't part of the build
+		for (auto& dependency : package->dependencies())
+		{
+			auto enabled = std::ranges::any_of(dependencies, [&dependency](auto *loaded) {
+				return loaded->name() == dependency.name;
+			});
+			if (enabled)
+			{
+				locked.dependencies.push_back(dependency.name);
+			}
+		}
+
+		std::ranges::sort(locked.dependencies);
+		lockfile.packages.push_back(std::move(locked));
+	}
+
+	std::ranges::sort(lockfile.packages, {}, &LockedPackage::name);
+	if (previous == lockfile)
+	{
+		return;
+	}
+
+	print_status("  Locking", "{} package(s)", lockfile.packages.size());
+	if (!io::write_file_atomic(file, lockfile.to_toml()))
+	{
+		bail("failed to write the lockfile to `{}`", file.string());
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "SourceSnapshot.h"
+#include "Support/Hash.h"
+#include "Support/Sha256.h"
+#include "Workspace.h"
+
+/**
+ * A dependency as resolved by the build that wrote `Freight.lock`.
+ */
+struct LockedPackage
+{
+	std::string name;
+	std::string version;
+	// Where the package comes from, like `path+../foo` for a path dependency or
+	// `registry+https://example.com` for a registry package
+	std::string source;
+	// SHA-256 of the source archive, only for registry packages. Resolving fails if the
+	// registry lists the version with another one.
+	std::optional<sha256::Digest> checksum;
+	// See `package_checksum`, only for path packages. Only tells whether they changed.
+	std::optional<hash::Digest> contentHash;
+	// The names of the packages it depends on directly, sorted
+	std::vector<std::string> dependencies;
+
+	bool operator==(const LockedPackage&) const = default;
+};
+
+struct Lockfile
+{
+	// Sorted by name
+	std::vector<LockedPackage> packages;
+
+	const LockedPackage *find(std::string_view name) const;
+
+	/**
+	 * Reads the lockfile at `file`. Empty if it doesn't exist or can't be parsed, in
+	 * which case it is rewritten from scratch.
+	 */
+	static std::optional<Lockfile> load(const std::filesystem::path& file);
+
+	std::string to_toml() const;
+
+	bool operator==(const Lockfile&) const = default;
+};
+
+/**
+ * Digests the manifest of `package` and every file of it in `snapshot`: its sources,
+ * tests, benchmarks and headers.
+ */
+hash::Digest package_checksum(const Package& package, const SourceSnapshot& snapshot);
+
+/**
+ * Records `dependencies`, with their `checksums`, in the lockfile of `ws`. The lockfile
+ * is only rewritten if something changed, and not created for packages without
+ * dependencies.
+ */
+void update_lockfile(const Workspace& ws,
+	std::span<const Package *const> dependencies,
+	const std::unordered_map<const Package *, hash::Digest>& checksums);
@@ -1,6 +1,10 @@
 #include "Pch.h"
 
+#include <algorithm>
 #include <any>
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cstddef>
 #include <deque>
 #include <expected>
@@ -8,6 +12,7 @@
 #include <functional>
 #include <optional>
 #include <print>
+#include <ranges>
 #include <span>
 #include <stdexcept>
 #include <string_view>
@@ -50,6 +55,35 @@ std::string error_no_such_command(std::string_view arg)
 	return std::format("no such command `{}`", arg);
 }
 
+std::string error_missing_value(std::string_view arg)
+{
+	return std::format(
+		"a value is required for '\033[36m{}\033[39m' but none was supplied",
+		arg);
+}
+
+std::string error_invalid_value(std::string_view value,
+	std::string_view arg,
+	std::string_view reason)
+{
+	return std::format("invalid value '\033[33m{}\033[39m' for '\033[36m{}\033[39m': {}",
+		value,
+		arg,
+		reason);
+}
+
+template<class T> std::optional<T> parse_number(std::string_view str)
+{
+	T value {};
+	auto [end, errc] = std::from_chars(str.data(), str.data() + str.size(), value);
+	if (errc != std::errc {} || end != str.data() + str.size())
+	{
+		return {};
+	}
+
+	return value;
+}
+
 template<class T> using Expected = std::expected<T, error::Error>;
 
 class StringDeque
@@ -176,6 +210,8 @@ enum class MatchOptResult
 	Match,
 	Done,
 	UnexpectedArg,
+	// The option takes a value, but `take_value` found none
+	MissingValue,
 };
 
 enum class MatchArgResult
@@ -209,12 +245,30 @@ protected:
 	{
 		return MatchArgResult::UnexpectedArg;
 	}
+
+	/**
+	 * Takes the value of the option being matched by `match_opt`, either from
+	 * `--opt=value` or from the argument following the option.
+	 */
+	std::optional<std::string> take_value()
+	{
+		if (inlineValue)
+		{
+			return std::exchange(inlineValue, {});
+		}
+
+		return remaining->pop_front();
+	}
 private:
 	bool foundDoubleDash = false;
+	StringDeque *remaining = nullptr;
+	std::optional<std::string> inlineValue;
 };
 
 Expected<void> CommandParser::parse(StringDeque& args)
 {
+	remaining = &args;
+
 	for (auto argOpt = args.pop_front(); argOpt.has_value(); argOpt = args.pop_front())
 	{
 		const auto& arg = *argOpt;
@@ -230,7 +284,20 @@ Expected<void> CommandParser::parse(StringDeque& args)
 			std::optional<MatchOptResult> result;
 			if (arg.starts_with("--"))
 			{
-				result = match_opt(std::string_view {arg}.substr(2), true);
+				auto opt = std::string_view {arg}.substr(2);
+				if (auto eq = opt.find('='); eq != std::string_view::npos)
+				{
+					inlineValue = std::string {opt.substr(eq + 1)};
+					opt = opt.substr(0, eq);
+				}
+
+				result = match_opt(opt, true);
+
+				if (std::exchange(inlineValue, {}) && result == MatchOptResult::Match)
+				{
+					return std::unexpected<error::Error>(
+						std::format("{}\n\n{}", error_unexepected_arg(arg), MORE_INFO));
+				}
 			}
 			else if (arg.starts_with('-'))
 			{
@@ -263,6 +330,11 @@ Expected<void> CommandParser::parse(StringDeque& args)
 					return std::unexpected<error::Error>(
 						std::format("{}\n\n", error_unexepected_arg(arg), MORE_INFO));
 				}
+				else if (result == MatchOptResult::MissingValue)
+				{
+					return std::unexpected<error::Error>(
+						std::format("{}\n\n{}", error_missing_value(arg), MORE_INFO));
+				}
 			}
 		}
 
@@ -320,22 +392,657 @@ private:
 	}
 };
 
+/**
+ * Options selecting the features of the package.
+ */
+class FeatureFlags
+{
+public:
+	MatchOptResult match(std::string_view arg,
+		bool isLong,
+		const std::function<std::optional<std::string>()>& takeValue)
+	{
+		if ((!isLong && arg == "F") || (isLong && arg == "features"))
+		{
+			auto list = takeValue();
+			if (!list)
+			{
+				return MatchOptResult::MissingValue;
+			}
+
+			// Separated by commas or spaces, like `--features "json tls"`
+			for (auto part : *list | std::views::split(','))
+			{
+				for (auto name : part | std::views::split(' '))
+				{
+					std::string feature {name.begin(), name.end()};
+					auto& features = selection.features;
+					if (!feature.empty() && !std::ranges::contains(features, feature))
+					{
+						features.push_back(std::move(feature));
+					}
+				}
+			}
+
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "all-features")
+		{
+			selection.all = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "no-default-features")
+		{
+			selection.defaults = false;
+			return MatchOptResult::Match;
+		}
+
+		return MatchOptResult::UnexpectedArg;
+	}
+
+	const FeatureSelection& parse() const
+	{
+		return selection;
+	}
+private:
+	FeatureSelection selection;
+};
+
+/**
+ * Options accepted by every command that builds the package.
+ */
+class BuildFlags
+{
+public:
+	BuildFlags() = default;
+
+	/**
+	 * `verifiable` accepts `--verify-reproducible`, which only `freight build` acts on.
+	 */
+	explicit BuildFlags(bool verifiable) : verifiable {verifiable}
+	{
+	}
+
+	MatchOptResult match(std::string_view arg,
+		bool isLong,
+		const std::function<std::optional<std::string>()>& takeValue)
+	{
+		std::optional<std::string> *value = nullptr;
+		if ((!isLong && arg == "j") || (isLong && arg == "jobs"))
+		{
+			value = &jobs;
+		}
+		else if (isLong && arg == "backend")
+		{
+			value = &backend;
+		}
+		else if (isLong && arg == "object-storage")
+		{
+			value = &objectStorage;
+		}
+		else if (isLong && arg == "sanitize")
+		{
+			auto sanitizers = takeValue();
+			if (!sanitizers)
+			{
+				return MatchOptResult::MissingValue;
+			}
+
+			sanitize.push_back(std::move(*sanitizers));
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "coverage")
+		{
+			coverage = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "reproducible")
+		{
+			reproducible = true;
+			return MatchOptResult::Match;
+		}
+		else if (verifiable && isLong && arg == "verify-reproducible")
+		{
+			verifyReproducible = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "keep-going")
+		{
+			keepGoing = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "explain")
+		{
+			explain = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "time-trace")
+		{
+			timeTrace = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "target")
+		{
+			auto triple = takeValue();
+			if (!triple)
+			{
+				return MatchOptResult::MissingValue;
+			}
+
+			targets.push_back(std::move(*triple));
+			return MatchOptResult::Match;
+		}
+		else
+		{
+			return featureFlags.match(arg, isLong, takeValue);
+		}
+
+		*value = takeValue();
+		return *value ? MatchOptResult::Match : MatchOptResult::MissingValue;
+	}
+
+	Expected<BuildOptions> parse(bool release) const
+	{
+		BuildOptions opts {
+			.release = release,
+			.jobs = {},
+		};
+
+		if (jobs)
+		{
+			auto count = parse_number<std::size_t>(*jobs);
+			if (!count || *count == 0)
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(*jobs, "--jobs <N>", "expected a positive integer"),
+					MORE_INFO));
+			}
+
+			opts.jobs = *count;
+		}
+
+		if (backend)
+		{
+			if (*backend == "process")
+			{
+				opts.backend = CompileBackend::Process;
+			}
+			else if (*backend == "in-process")
+			{
+				opts.backend = CompileBackend::InProcess;
+			}
+			else
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(*backend,
+						"--backend <BACKEND>",
+						"expected `process` or `in-process`"),
+					MORE_INFO));
+			}
+		}
+
+		if (objectStorage)
+		{
+			if (*objectStorage == "disk")
+			{
+				opts.objectStorage = ObjectStorage::Disk;
+			}
+			else if (*objectStorage == "memfd")
+			{
+				opts.objectStorage = ObjectStorage::Memfd;
+			}
+			else if (*objectStorage == "tmpfs")
+			{
+				opts.objectStorage = ObjectStorage::Tmpfs;
+			}
+			else
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(*objectStorage,
+						"--object-storage <STORAGE>",
+						"expected `disk`, `memfd` or `tmpfs`"),
+					MORE_INFO));
+			}
+		}
+
+		// Every `--sanitize` adds a variant, and `--coverage` instruments all of them
+		for (auto& list : sanitize)
+		{
+			auto variant = parse_variant(list);
+			if (!variant)
+			{
+				return std::unexpected {std::move(variant.error())};
+			}
+
+			variant->coverage = coverage;
+			if (!std::ranges::contains(opts.variants, *variant))
+			{
+				opts.variants.push_back(std::move(*variant));
+			}
+		}
+
+		if (sanitize.empty() && coverage)
+		{
+			opts.variants.push_back(Variant {.sanitizers = {}, .coverage = true});
+		}
+
+		opts.reproducible = reproducible || verifyReproducible;
+		opts.verifyReproducible = verifyReproducible;
+		opts.timeTrace = timeTrace;
+		opts.explain = explain;
+		opts.keepGoing = keepGoing;
+		opts.features = featureFlags.parse();
+
+		for (auto& triple : targets)
+		{
+			if (triple.empty() || triple.contains('/'))
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(triple,
+						"--target <TRIPLE>",
+						"expected a target triple like `aarch64-linux-gnu`"),
+					MORE_INFO));
+			}
+
+			if (!std::ranges::contains(opts.targets, triple))
+			{
+				opts.targets.push_back(triple);
+			}
+		}
+
+		return opts;
+	}
+private:
+	std::optional<std::string> jobs;
+	std::optional<std::string> backend;
+	std::optional<std::string> objectStorage;
+	std::vector<std::string> sanitize;
+	bool coverage = false;
+	std::vector<std::string> targets;
+	bool reproducible = false;
+	bool verifiable = false;
+	bool verifyReproducible = false;
+	bool timeTrace = false;
+	bool explain = false;
+	bool keepGoing = false;
+	FeatureFlags featureFlags;
+
+	/**
+	 * Parses a comma-separated list of sanitizers. `none` stands for the
+	 * uninstrumented variant, so it can be part of a matrix.
+	 */
+	static Expected<Variant> parse_variant(std::string_view list)
+	{
+		static constexpr std::array SANITIZERS = {
+			std::pair {"address", Sanitizer::Address},
+			std::pair {"undefined", Sanitizer::Undefined},
+			std::pair {"thread", Sanitizer::Thread},
+			std::pair {"memory", Sanitizer::Memory},
+			std::pair {"leak", Sanitizer::Leak},
+		};
+
+		Variant variant;
+		if (list == "none")
+		{
+			return variant;
+		}
+
+		for (auto part : list | std::views::split(','))
+		{
+			std::string_view name {part.begin(), part.end()};
+			auto it = std::ranges::find(SANITIZERS, name, [](auto& sanitizer) {
+				return std::string_view {sanitizer.first};
+			});
+			if (it == SANITIZERS.end())
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(list,
+						"--sanitize <SANITIZERS>",
+						"expected `none` or a comma-separated list of `address`, "
+						"`undefined`, `thread`, `memory` and `leak`"),
+					MORE_INFO));
+			}
+
+			variant.sanitizers.push_back(it->second);
+		}
+
+		std::ranges::sort(variant.sanitizers);
+		auto [first, last] = std::ranges::unique(variant.sanitizers);
+		variant.sanitizers.erase(first, last);
+
+		// The thread and memory sanitizers each need the whole address space to
+		// themselves
+		auto has = [&](Sanitizer sanitizer) {
+			return std::ranges::contains(variant.sanitizers, sanitizer);
+		};
+		bool exclusive = has(Sanitizer::Thread) || has(Sanitizer::Memory);
+		bool others = has(Sanitizer::Address) || has(Sanitizer::Leak) ||
+					  (has(Sanitizer::Thread) && has(Sanitizer::Memory));
+		if (exclusive && others)
+		{
+			return std::unexpected<error::Error>(std::format("{}\n\n{}",
+				error_invalid_value(list,
+					"--sanitize <SANITIZERS>",
+					"`thread` and `memory` can only be combined with `undefined`"),
+				MORE_INFO));
+		}
+
+		return variant;
+	}
+};
+
 class BuildParser final : public CommandParser
 {
 public:
 	BuildParser() = default;
 private:
+	BuildFlags buildFlags {true};
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		return buildFlags.match(arg, isLong, [this] { return take_value(); });
+	}
+
 	Expected<void> execute(StringDeque&) override
 	{
-		BuildOptions opts {
-			.release = false,
+		auto opts = buildFlags.parse(false);
+		if (!opts)
+		{
+			return std::unexpected {std::move(opts.error())};
+		}
+
+		exec_build(*opts);
+		return {};
+	}
+};
+
+class CheckParser final : public CommandParser
+{
+public:
+	CheckParser() = default;
+private:
+	BuildFlags buildFlags;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		return buildFlags.match(arg, isLong, [this] { return take_value(); });
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		auto buildOpts = buildFlags.parse(false);
+		if (!buildOpts)
+		{
+			return std::unexpected {std::move(buildOpts.error())};
+		}
+
+		CheckOptions opts {
+			.build_opts = *buildOpts,
+		};
+
+		exec_check(opts);
+		return {};
+	}
+};
+
+class WatchParser final : public CommandParser
+{
+public:
+	WatchParser() = default;
+private:
+	std::vector<std::string> command;
+
+	// Everything from the command on is passed on to it untouched
+	MatchArgResult match_arg(const std::string& arg) override
+	{
+		command.push_back(arg);
+		return MatchArgResult::Done;
+	}
+
+	Expected<void> execute(StringDeque& args) override
+	{
+		if (command.empty())
+		{
+			return std::unexpected<error::Error>(
+				std::format("{}\n\n{}", error_missing_arg("<COMMAND>"), MORE_INFO));
+		}
+
+		if (command.front() == "watch")
+		{
+			return std::unexpected<error::Error>(std::format("{}\n\n{}",
+				error_invalid_value(command.front(), "<COMMAND>", "can't watch `watch`"),
+				MORE_INFO));
+		}
+
+		while (auto arg = args.pop_front())
+		{
+			command.push_back(std::move(*arg));
+		}
+
+		WatchOptions opts {
+			.command = std::move(command),
 		};
 
-		exec_build(opts);
+		exec_watch(opts);
 		return {};
 	}
 };
 
+class DepsParser final : public CommandParser
+{
+public:
+	DepsParser() = default;
+private:
+	bool headers = false;
+	std::optional<std::string> top;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		if (isLong && arg == "headers")
+		{
+			headers = true;
+			return MatchOptResult::Match;
+		}
+		else if (isLong && arg == "top")
+		{
+			top = take_value();
+			return top ? MatchOptResult::Match : MatchOptResult::MissingValue;
+		}
+
+		return MatchOptResult::UnexpectedArg;
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		DepsOptions opts {
+			.headers = headers,
+			.top = {},
+		};
+
+		if (top)
+		{
+			auto count = parse_number<std::size_t>(*top);
+			if (!count || *count == 0)
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(*top, "--top <N>", "expected a positive integer"),
+					MORE_INFO));
+			}
+
+			opts.top = *count;
+		}
+
+		exec_deps(opts);
+		return {};
+	}
+};
+
+class FeaturesParser final : public CommandParser
+{
+public:
+	FeaturesParser() = default;
+private:
+	FeatureFlags featureFlags;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		return featureFlags.match(arg, isLong, [this] { return take_value(); });
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		FeaturesOptions opts {
+			.selection = featureFlags.parse(),
+		};
+
+		exec_features(opts);
+		return {};
+	}
+};
+
+class RegistryServeParser final : public CommandParser
+{
+public:
+	RegistryServeParser() = default;
+private:
+	std::optional<std::string> dir;
+	std::optional<std::string> port;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		if ((!isLong && arg == "p") || (isLong && arg == "port"))
+		{
+			port = take_value();
+			return port ? MatchOptResult::Match : MatchOptResult::MissingValue;
+		}
+
+		return MatchOptResult::UnexpectedArg;
+	}
+
+	MatchArgResult match_arg(const std::string& arg) override
+	{
+		if (dir)
+		{
+			return MatchArgResult::UnexpectedArg;
+		}
+
+		dir = arg;
+		return MatchArgResult::Match;
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		if (!dir)
+		{
+			return std::unexpected<error::Error>(
+				std::format("{}\n\n{}", error_missing_arg("<DIR>"), MORE_INFO));
+		}
+
+		RegistryServeOptions opts {
+			.dir = std::move(*dir),
+		};
+
+		if (port)
+		{
+			auto number = parse_number<std::uint16_t>(*port);
+			if (!number)
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(*port, "--port <PORT>", "expected a port number"),
+					MORE_INFO));
+			}
+
+			opts.port = *number;
+		}
+
+		exec_registry_serve(opts);
+		return {};
+	}
+};
+
+class RegistryPublishParser final : public CommandParser
+{
+public:
+	RegistryPublishParser() = default;
+private:
+	std::optional<std::string> dir;
+	bool release = false;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		if ((!isLong && arg == "r") || (isLong && arg == "release"))
+		{
+			release = true;
+			return MatchOptResult::Match;
+		}
+
+		return MatchOptResult::UnexpectedArg;
+	}
+
+	MatchArgResult match_arg(const std::string& arg) override
+	{
+		if (dir)
+		{
+			return MatchArgResult::UnexpectedArg;
+		}
+
+		dir = arg;
+		return MatchArgResult::Match;
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		if (!dir)
+		{
+			return std::unexpected<error::Error>(
+				std::format("{}\n\n{}", error_missing_arg("<DIR>"), MORE_INFO));
+		}
+
+		RegistryPublishOptions opts {
+			.dir = std::move(*dir),
+			.release = release,
+		};
+
+		exec_registry_publish(opts);
+		return {};
+	}
+};
+
+class RegistryParser final : public CommandParser
+{
+public:
+	RegistryParser() = default;
+private:
+	std::optional<std::string> command;
+
+	MatchArgResult match_arg(const std::string& arg) override
+	{
+		command = arg;
+		return MatchArgResult::Done;
+	}
+
+	Expected<void> execute(StringDeque& args) override
+	{
+		if (!command)
+		{
+			return std::unexpected<error::Error>(
+				std::format("{}\n\n{}", error_missing_arg("<COMMAND>"), MORE_INFO));
+		}
+		else if (*command == "serve")
+		{
+			return RegistryServeParser {}.parse(args);
+		}
+		else if (*command == "publish")
+		{
+			return RegistryPublishParser {}.parse(args);
+		}
+
+		return std::unexpected<error::Error>(std::format("{}\n\n{}",
+			error_no_such_command(std::format("registry {}", *command)),
+			MORE_INFO));
+	}
+};
+
 class InitParser final : public CommandParser
 {
 public:
@@ -368,6 +1075,218 @@ private:
 	}
 };
 
+class TestParser final : public CommandParser
+{
+public:
+	TestParser() = default;
+private:
+	BuildFlags buildFlags;
+	std::optional<std::string> shard;
+	std::optional<std::string> timeout;
+	std::optional<std::string> junitPath;
+	std::vector<std::string> filters;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		std::optional<std::string> *value = nullptr;
+		if (isLong && arg == "shard")
+		{
+			value = &shard;
+		}
+		else if (isLong && arg == "timeout")
+		{
+			value = &timeout;
+		}
+		else if (isLong && arg == "junit")
+		{
+			value = &junitPath;
+		}
+		else
+		{
+			return buildFlags.match(arg, isLong, [this] { return take_value(); });
+		}
+
+		*value = take_value();
+		return *value ? MatchOptResult::Match : MatchOptResult::MissingValue;
+	}
+
+	MatchArgResult match_arg(const std::string& arg) override
+	{
+		filters.push_back(arg);
+		return MatchArgResult::Match;
+	}
+
+	Expected<std::optional<Shard>> parse_shard() const
+	{
+		if (!shard)
+		{
+			return std::optional<Shard> {};
+		}
+
+		auto slash = shard->find('/');
+		if (slash != std::string::npos)
+		{
+			auto index = parse_number<std::size_t>(std::string_view {*shard}.substr(0, slash));
+			auto count = parse_number<std::size_t>(std::string_view {*shard}.substr(slash + 1));
+			if (index && count && *index >= 1 && *index <= *count)
+			{
+				return Shard {.index = *index, .count = *count};
+			}
+		}
+
+		return std::unexpected<error::Error>(std::format("{}\n\n{}",
+			error_invalid_value(*shard,
+				"--shard <INDEX/COUNT>",
+				"expected `i/n` with 1 <= i <= n"),
+			MORE_INFO));
+	}
+
+	Expected<std::optional<std::chrono::seconds>> parse_timeout() const
+	{
+		if (!timeout)
+		{
+			return std::optional<std::chrono::seconds> {};
+		}
+
+		auto seconds = parse_number<std::size_t>(*timeout);
+		if (!seconds || *seconds == 0)
+		{
+			return std::unexpected<error::Error>(std::format("{}\n\n{}",
+				error_invalid_value(*timeout,
+					"--timeout <SECONDS>",
+					"expected a positive number of seconds"),
+				MORE_INFO));
+		}
+
+		return std::chrono::seconds {*seconds};
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		auto buildOpts = buildFlags.parse(false);
+		if (!buildOpts)
+		{
+			return std::unexpected {std::move(buildOpts.error())};
+		}
+
+		auto shardOpt = parse_shard();
+		if (!shardOpt)
+		{
+			return std::unexpected {std::move(shardOpt.error())};
+		}
+
+		auto timeoutOpt = parse_timeout();
+		if (!timeoutOpt)
+		{
+			return std::unexpected {std::move(timeoutOpt.error())};
+		}
+
+		TestOptions opts {
+			.build_opts = *buildOpts,
+			.filters = std::move(filters),
+			.shard = *shardOpt,
+			.timeout = *timeoutOpt,
+			.junit_path = std::move(junitPath),
+		};
+
+		exec_test(opts);
+		return {};
+	}
+};
+
+class BenchParser final : public CommandParser
+{
+public:
+	BenchParser() = default;
+private:
+	BuildFlags buildFlags;
+	std::optional<std::string> baseline;
+	std::optional<std::string> saveBaseline;
+	std::optional<std::string> cpu;
+	std::optional<std::string> samples;
+	std::vector<std::string> filters;
+
+	MatchOptResult match_opt(std::string_view arg, bool isLong) override
+	{
+		std::optional<std::string> *value = nullptr;
+		if (isLong && arg == "baseline")
+		{
+			value = &baseline;
+		}
+		else if (isLong && arg == "save-baseline")
+		{
+			value = &saveBaseline;
+		}
+		else if (isLong && arg == "cpu")
+		{
+			value = &cpu;
+		}
+		else if (isLong && arg == "samples")
+		{
+			value = &samples;
+		}
+		else
+		{
+			return buildFlags.match(arg, isLong, [this] { return take_value(); });
+		}
+
+		*value = take_value();
+		return *value ? MatchOptResult::Match : MatchOptResult::MissingValue;
+	}
+
+	MatchArgResult match_arg(const std::string& arg) override
+	{
+		filters.push_back(arg);
+		return MatchArgResult::Match;
+	}
+
+	Expected<void> execute(StringDeque&) override
+	{
+		auto buildOpts = buildFlags.parse(true);
+		if (!buildOpts)
+		{
+			return std::unexpected {std::move(buildOpts.error())};
+		}
+
+		std::optional<int> cpuIndex;
+		if (cpu)
+		{
+			cpuIndex = parse_number<int>(*cpu);
+			if (!cpuIndex || *cpuIndex < 0)
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(*cpu, "--cpu <CPU>", "expected a CPU index"),
+					MORE_INFO));
+			}
+		}
+
+		std::optional<std::size_t> sampleCount;
+		if (samples)
+		{
+			sampleCount = parse_number<std::size_t>(*samples);
+			if (!sampleCount || *sampleCount < 2)
+			{
+				return std::unexpected<error::Error>(std::format("{}\n\n{}",
+					error_invalid_value(
+						*samples, "--samples <N>", "expected at least 2 samples"),
+					MORE_INFO));
+			}
+		}
+
+		BenchOptions opts {
+			.build_opts = *buildOpts,
+			.filters = std::move(filters),
+			.baseline = std::move(baseline),
+			.save_baseline = std::move(saveBaseline),
+			.cpu = cpuIndex,
+			.samples = sampleCount,
+		};
+
+		exec_bench(opts);
+		return {};
+	}
+};
+
 class MainParser final : public CommandParser
 {
 public:
@@ -434,6 +1353,34 @@ private:
 			{
 				return RunParser {}.parse(args);
 			}
+			else if (cmd == "test" || cmd == "t")
+			{
+				return TestParser {}.parse(args);
+			}
+			else if (cmd == "bench")
+			{
+				return BenchParser {}.parse(args);
+			}
+			else if (cmd == "check" || cmd == "c")
+			{
+				return CheckParser {}.parse(args);
+			}
+			else if (cmd == "watch")
+			{
+				return WatchParser {}.parse(args);
+			}
+			else if (cmd == "deps")
+			{
+				return DepsParser {}.parse(args);
+			}
+			else if (cmd == "features")
+			{
+				return FeaturesParser {}.parse(args);
+			}
+			else if (cmd == "registry")
+			{
+				return RegistryParser {}.parse(args);
+			}
 			else
 			{
 				return std::unexpected(std::format("{}\n\n{}", error_no_such_command(cmd), MORE_INFO));
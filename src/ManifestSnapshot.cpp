@@ -0,0 +1,540 @@
+#include "Pch.h"
+
+#include "ManifestSnapshot.h"
+
+#include <concepts>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Support/Hash.h"
+#include "Support/Io.h"
+#include "Toml.h"
+#include "Workspace.h"
+
+// Snapshots are machine-local caches, so integers are stored in native byte order
+static constexpr std::string_view MAGIC = "freight-manifest-snapshot";
+static constexpr std::uint32_t FORMAT_VERSION = 8;
+
+namespace
+{
+using Stamp = io::FileStamp;
+
+struct DirStamp
+{
+	std::filesystem::path path;
+	Stamp stamp;
+};
+
+/**
+ * The directories whose listings `read_manifest` infers targets from. Adding or
+ * removing an entry changes a directory's mtime, so comparing these is enough to
+ * know that inferred targets are unchanged.
+ */
+std::vector<DirStamp> inference_dir_stamps(const std::filesystem::path& root)
+{
+	using namespace std::filesystem;
+
+	std::vector<path> dirs {root};
+	for (auto name : {"src", "src/bin", "tests", "benches"})
+	{
+		if (is_directory(root / name))
+		{
+			dirs.push_back(root / name);
+		}
+	}
+
+	// Targets made of directories have their top-level entries listed too
+	for (auto name : {"src/bin", "tests", "benches"})
+	{
+		std::error_code errc;
+		for (auto& entry : directory_iterator {root / name, errc})
+		{
+			if (entry.is_directory())
+			{
+				dirs.push_back(entry.path());
+			}
+		}
+	}
+
+	std::vector<DirStamp> stamps;
+	for (auto& dir : dirs)
+	{
+		if (auto stamp = io::stamp_file(dir))
+		{
+			stamps.push_back({dir, *stamp});
+		}
+	}
+
+	return stamps;
+}
+
+class SnapshotWriter
+{
+public:
+	template<std::integral T> void write_int(T value)
+	{
+		data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	void write_string(std::string_view str)
+	{
+		write_int(static_cast<std::uint32_t>(str.size()));
+		data.append(str);
+	}
+
+	void write_optional_string(const std::optional<std::string>& str)
+	{
+		write_int<std::uint8_t>(str.has_value());
+		if (str)
+		{
+			write_string(*str);
+		}
+	}
+
+	void write_strings(std::span<const std::string> strings)
+	{
+		write_int(static_cast<std::uint32_t>(strings.size()));
+		for (auto& str : strings)
+		{
+			write_string(str);
+		}
+	}
+
+	void write_paths(std::span<const std::filesystem::path> paths)
+	{
+		write_int(static_cast<std::uint32_t>(paths.size()));
+		for (auto& path : paths)
+		{
+			write_string(path.native());
+		}
+	}
+
+	const std::string& finish() const
+	{
+		return data;
+	}
+private:
+	std::string data;
+};
+
+/**
+ * Reads values written by `SnapshotWriter`. Reading past the end of a truncated or
+ * corrupted snapshot sets a sticky failure flag instead of throwing.
+ */
+class SnapshotReader
+{
+public:
+	explicit SnapshotReader(std::span<const std::byte> bytes) : bytes {bytes}
+	{
+	}
+
+	template<std::integral T> T read_int()
+	{
+		T value {};
+		if (failed || bytes.size() - pos < sizeof(value))
+		{
+			failed = true;
+			return value;
+		}
+
+		std::memcpy(&value, bytes.data() + pos, sizeof(value));
+		pos += sizeof(value);
+		return value;
+	}
+
+	std::string read_string()
+	{
+		auto size = read_int<std::uint32_t>();
+		if (failed || bytes.size() - pos < size)
+		{
+			failed = true;
+			return {};
+		}
+
+		std::string str {reinterpret_cast<const char *>(bytes.data() + pos), size};
+		pos += size;
+		return str;
+	}
+
+	std::optional<std::string> read_optional_string()
+	{
+		if (read_int<std::uint8_t>() == 0)
+		{
+			return {};
+		}
+
+		return read_string();
+	}
+
+	std::vector<std::string> read_strings()
+	{
+		std::vector<std::string> strings;
+		auto count = read_int<std::uint32_t>();
+		for (std::uint32_t i = 0; i < count && !failed; i++)
+		{
+			strings.push_back(read_string());
+		}
+
+		return strings;
+	}
+
+	std::vector<std::filesystem::path> read_paths()
+	{
+		std::vector<std::filesystem::path> paths;
+		auto count = read_int<std::uint32_t>();
+		for (std::uint32_t i = 0; i < count && !failed; i++)
+		{
+			paths.emplace_back(read_string());
+		}
+
+		return paths;
+	}
+
+	void fail()
+	{
+		failed = true;
+	}
+
+	bool ok() const
+	{
+		return !failed;
+	}
+
+	bool at_end() const
+	{
+		return pos == bytes.size();
+	}
+private:
+	std::span<const std::byte> bytes;
+	std::size_t pos = 0;
+	bool failed = false;
+};
+
+void write_stamp(SnapshotWriter& writer, const Stamp& stamp)
+{
+	writer.write_int(stamp.device);
+	writer.write_int(stamp.inode);
+	writer.write_int(stamp.mtime);
+	writer.write_int(stamp.size);
+}
+
+Stamp read_stamp(SnapshotReader& reader)
+{
+	Stamp stamp {};
+	stamp.device = reader.read_int<std::uint64_t>();
+	stamp.inode = reader.read_int<std::uint64_t>();
+	stamp.mtime = reader.read_int<std::int64_t>();
+	stamp.size = reader.read_int<std::uint64_t>();
+	return stamp;
+}
+
+void write_manifest(SnapshotWriter& writer, const Manifest& manifest)
+{
+	auto& toml = manifest.toml();
+	writer.write_int<std::uint8_t>(toml.package.has_value());
+	if (toml.package)
+	{
+		writer.write_optional_string(toml.package->name);
+		writer.write_optional_string(toml.package->version);
+		writer.write_optional_string(toml.package->standard);
+	}
+
+	writer.write_int<std::uint8_t>(toml.bin.has_value());
+	if (toml.bin)
+	{
+		writer.write_int(static_cast<std::uint32_t>(toml.bin->size()));
+		for (auto& target : *toml.bin)
+		{
+			writer.write_optional_string(target.name);
+			writer.write_int<std::uint8_t>(target.paths.has_value());
+			if (target.paths)
+			{
+				writer.write_paths(*target.paths);
+			}
+		}
+	}
+
+	writer.write_int(static_cast<std::uint32_t>(toml.profile.size()));
+	for (auto& [name, profile] : toml.profile)
+	{
+		writer.write_string(name);
+		writer.write_optional_string(profile.splitDebugInfo);
+		writer.write_optional_string(profile.debugCompression);
+	}
+
+	writer.write_int(static_cast<std::uint32_t>(toml.target.size()));
+	for (auto& [triple, platform] : toml.target)
+	{
+		writer.write_string(triple);
+		writer.write_optional_string(platform.sysroot);
+		writer.write_optional_string(platform.linker);
+		writer.write_strings(platform.flags);
+		writer.write_strings(platform.linkFlags);
+	}
+
+	writer.write_int(static_cast<std::uint32_t>(toml.dependencies.size()));
+	for (auto& [name, dependency] : toml.dependencies)
+	{
+		writer.write_string(name);
+		writer.write_optional_string(dependency.path);
+		writer.write_optional_string(dependency.version);
+		writer.write_int<std::uint8_t>(dependency.optional);
+		writer.write_strings(dependency.features);
+		writer.write_int<std::uint8_t>(dependency.defaultFeatures);
+	}
+
+	writer.write_int(static_cast<std::uint32_t>(toml.features.size()));
+	for (auto& [feature, enables] : toml.features)
+	{
+		writer.write_string(feature);
+		writer.write_strings(enables);
+	}
+
+	writer.write_string(manifest.name());
+	writer.write_int(static_cast<std::uint8_t>(manifest.standard()));
+
+	writer.write_int(static_cast<std::uint32_t>(manifest.targets().size()));
+	for (auto& target : manifest.targets())
+	{
+		writer.write_string(target.name);
+		writer.write_int(static_cast<std::uint8_t>(target.kind));
+		writer.write_paths(target.paths);
+	}
+
+	writer.write_int(static_cast<std::uint32_t>(manifest.dependencies().size()));
+	for (auto& dependency : manifest.dependencies())
+	{
+		writer.write_string(dependency.name);
+		writer.write_string(dependency.manifest.native());
+		writer.write_optional_string(dependency.version);
+		writer.write_int<std::uint8_t>(dependency.optional);
+		writer.write_strings(dependency.features);
+		writer.write_int<std::uint8_t>(dependency.defaultFeatures);
+	}
+}
+
+std::optional<Manifest> read_manifest_payload(SnapshotReader& reader)
+{
+	TomlManifest toml;
+	if (reader.read_int<std::uint8_t>() != 0)
+	{
+		toml.package = TomlPackage {};
+		toml.package->name = reader.read_optional_string();
+		toml.package->version = reader.read_optional_string();
+		toml.package->standard = reader.read_optional_string();
+	}
+
+	if (reader.read_int<std::uint8_t>() != 0)
+	{
+		toml.bin.emplace();
+		auto count = reader.read_int<std::uint32_t>();
+		for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+		{
+			TomlTarget target;
+			target.name = reader.read_optional_string();
+			if (reader.read_int<std::uint8_t>() != 0)
+			{
+				target.paths = reader.read_paths();
+			}
+
+			toml.bin->push_back(std::move(target));
+		}
+	}
+
+	auto profileCount = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < profileCount && reader.ok(); i++)
+	{
+		auto profileName = reader.read_string();
+		TomlProfile profile;
+		profile.splitDebugInfo = reader.read_optional_string();
+		profile.debugCompression = reader.read_optional_string();
+		toml.profile.emplace(std::move(profileName), std::move(profile));
+	}
+
+	auto platformCount = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < platformCount && reader.ok(); i++)
+	{
+		auto triple = reader.read_string();
+		TomlPlatform platform;
+		platform.sysroot = reader.read_optional_string();
+		platform.linker = reader.read_optional_string();
+		platform.flags = reader.read_strings();
+		platform.linkFlags = reader.read_strings();
+		toml.target.emplace(std::move(triple), std::move(platform));
+	}
+
+	auto tomlDependencyCount = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < tomlDependencyCount && reader.ok(); i++)
+	{
+		auto dependencyName = reader.read_string();
+		TomlDependency dependency;
+		dependency.path = reader.read_optional_string();
+		dependency.version = reader.read_optional_string();
+		dependency.optional = reader.read_int<std::uint8_t>() != 0;
+		dependency.features = reader.read_strings();
+		dependency.defaultFeatures = reader.read_int<std::uint8_t>() != 0;
+		toml.dependencies.emplace(std::move(dependencyName), std::move(dependency));
+	}
+
+	auto featureCount = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < featureCount && reader.ok(); i++)
+	{
+		auto feature = reader.read_string();
+		toml.features.emplace(std::move(feature), reader.read_strings());
+	}
+
+	auto name = reader.read_string();
+	auto standard = reader.read_int<std::uint8_t>();
+	if (standard > static_cast<std::uint8_t>(Standard::CXX23))
+	{
+		reader.fail();
+	}
+
+	std::vector<Target> targets;
+	auto count = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+	{
+		Target target;
+		target.name = reader.read_string();
+		auto kind = reader.read_int<std::uint8_t>();
+		if (kind > static_cast<std::uint8_t>(TargetKind::Lib))
+		{
+			reader.fail();
+		}
+
+		target.kind = static_cast<TargetKind>(kind);
+		target.paths = reader.read_paths();
+		targets.push_back(std::move(target));
+	}
+
+	std::vector<Dependency> dependencies;
+	auto dependencyCount = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < dependencyCount && reader.ok(); i++)
+	{
+		Dependency dependency;
+		dependency.name = reader.read_string();
+		dependency.manifest = reader.read_string();
+		dependency.version = reader.read_optional_string();
+		dependency.optional = reader.read_int<std::uint8_t>() != 0;
+		dependency.features = reader.read_strings();
+		dependency.defaultFeatures = reader.read_int<std::uint8_t>() != 0;
+		dependencies.push_back(std::move(dependency));
+	}
+
+	if (!reader.ok() || !reader.at_end())
+	{
+		return {};
+	}
+
+	return Manifest {
+		std::move(toml),
+		name,
+		std::move(targets),
+		static_cast<Standard>(standard),
+		std::move(dependencies),
+	};
+}
+
+std::optional<Manifest> load_snapshot(const std::filesystem::path& manifestPath,
+	const std::filesystem::path& snapshotFile)
+{
+	auto mapped = io::MappedFile::open(snapshotFile);
+	if (!mapped)
+	{
+		return {};
+	}
+
+	SnapshotReader reader {mapped->bytes()};
+	if (reader.read_string() != MAGIC || reader.read_int<std::uint32_t>() != FORMAT_VERSION)
+	{
+		return {};
+	}
+
+	// Cheap checks first, so a stale snapshot is usually rejected without reading the
+	// manifest
+	auto manifestStamp = read_stamp(reader);
+	auto manifestDigest = reader.read_int<hash::Digest>();
+	if (!reader.ok() || io::stamp_file(manifestPath) != manifestStamp)
+	{
+		return {};
+	}
+
+	auto dirCount = reader.read_int<std::uint32_t>();
+	for (std::uint32_t i = 0; i < dirCount && reader.ok(); i++)
+	{
+		std::filesystem::path dir = reader.read_string();
+		auto stamp = read_stamp(reader);
+		if (reader.ok() && io::stamp_file(dir) != stamp)
+		{
+			return {};
+		}
+	}
+
+	// The mtime has a limited resolution, so an edit right after the snapshot was
+	// written could go unnoticed without comparing the contents too
+	if (!reader.ok() || hash::hash_file(manifestPath) != manifestDigest)
+	{
+		return {};
+	}
+
+	return read_manifest_payload(reader);
+}
+
+void save_snapshot(const std::filesystem::path& snapshotFile,
+	const Stamp& manifestStamp,
+	hash::Digest manifestDigest,
+	std::span<const DirStamp> dirStamps,
+	const Manifest& manifest)
+{
+	SnapshotWriter writer;
+	writer.write_string(MAGIC);
+	writer.write_int(FORMAT_VERSION);
+	write_stamp(writer, manifestStamp);
+	writer.write_int(manifestDigest);
+
+	writer.write_int(static_cast<std::uint32_t>(dirStamps.size()));
+	for (auto& [dir, stamp] : dirStamps)
+	{
+		writer.write_string(dir.native());
+		write_stamp(writer, stamp);
+	}
+
+	write_manifest(writer, manifest);
+
+	// Concurrent Freight processes may load the snapshot while it is rewritten. Failing
+	// to write it isn't an error, the manifest is just parsed again next time.
+	io::write_file_atomic(snapshotFile, writer.finish());
+}
+} // namespace
+
+Manifest load_manifest(GlobalContext& gctx,
+	const std::filesystem::path& manifestPath,
+	const std::filesystem::path& snapshotFile)
+{
+	if (auto manifest = load_snapshot(manifestPath, snapshotFile))
+	{
+		return std::move(*manifest);
+	}
+
+	// The snapshot usually lives in `target/` next to the manifest, so creating it must
+	// not change the stamp of the package root
+	std::error_code errc;
+	std::filesystem::create_directories(snapshotFile.parent_path(), errc);
+
+	// Everything is stamped before parsing, so edits made while parsing leave a stale
+	// snapshot behind rather than one that looks fresh
+	auto manifestStamp = io::stamp_file(manifestPath);
+	auto manifestDigest = hash::hash_file(manifestPath);
+	auto dirStamps = inference_dir_stamps(manifestPath.parent_path());
+
+	Manifest manifest = read_manifest(gctx, manifestPath);
+	if (manifestStamp && manifestDigest)
+	{
+		save_snapshot(snapshotFile, *manifestStamp, *manifestDigest, dirStamps, manifest);
+	}
+
+	return manifest;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <filesystem>
+
+#include "Workspace.h"
+
+/**
+ * Loads the manifest at `manifestPath` from the binary snapshot at `snapshotFile`, or
+ * parses it with `read_manifest` and writes a new snapshot if the snapshot is missing
+ * or stale.
+ *
+ * A snapshot is only used if the manifest's mtime, size and content hash are the same
+ * as when it was written, and so are the mtimes of every directory targets were
+ * inferred from.
+ */
+Manifest load_manifest(GlobalContext& gctx,
+	const std::filesystem::path& manifestPath,
+	const std::filesystem::path& snapshotFile);
@@ -0,0 +1,207 @@
+#include "Pch.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "Build.h"
+#include "Cmds.h"
+#include "Features.h"
+#include "Registry.h"
+#include "Support/Io.h"
+#include "Support/Json.h"
+#include "Support/Sha256.h"
+#include "Support/Util.h"
+#include "Workspace.h"
+
+namespace
+{
+/**
+ * Runs `pb`, writing to a temporary file that is renamed to `file` once it succeeded.
+ * Returns the SHA-256 of `file`.
+ */
+sha256::Digest write_with(ProcessBuilder pb,
+	const std::filesystem::path& temp,
+	const std::filesystem::path& file)
+{
+	std::error_code errc;
+	std::filesystem::create_directories(file.parent_path());
+	std::filesystem::remove(temp, errc);
+
+	auto digest = pb.start() == 0 ? sha256::hash_file(temp) : std::nullopt;
+	if (!digest)
+	{
+		std::filesystem::remove(temp, errc);
+		bail("failed to write `{}`", file.string());
+	}
+
+	std::filesystem::rename(temp, file);
+	return *digest;
+}
+
+/**
+ * The entry of `version` in the versions of a registry index, or a new one.
+ */
+json::Value& version_entry(json::Array& versions, const std::string& version)
+{
+	auto it = std::ranges::find_if(versions, [&version](const json::Value& entry) {
+		auto *name = entry.find("version") ? entry.find("version")->as_string() : nullptr;
+		return name != nullptr && *name == version;
+	});
+	if (it != versions.end())
+	{
+		return *it;
+	}
+
+	return versions.emplace_back(json::Object {
+		{"version", version},
+		{"artifacts", json::Object {}},
+	});
+}
+} // namespace
+
+void exec_registry_publish(const RegistryPublishOptions& opts)
+{
+	using namespace std::filesystem;
+
+	auto cwd = current_path();
+	GlobalContext gctx {cwd};
+	Workspace ws {cwd / "Freight.toml", gctx};
+	auto& package = ws.current();
+	auto& name = package.name();
+	auto version = package.version();
+
+	// Path dependencies only exist on the machine publishing the package
+	for (auto& dependency : package.dependencies())
+	{
+		if (!dependency.version)
+		{
+			bail("failed to publish `{}`\n\n{}",
+				name,
+				cause("dependency `{}` has no `version`, only packages whose "
+					  "dependencies come from the registry can be published",
+					dependency.name));
+		}
+	}
+
+	auto registry = absolute(opts.dir).lexically_normal();
+	auto indexPath = registry / "index" / (name + ".json");
+	json::Value index {json::Object {}};
+	if (exists(indexPath))
+	{
+		auto parsed = json::parse(io::read_file(indexPath).value_or(""));
+		if (!parsed || parsed->as_object() == nullptr)
+		{
+			bail("failed to parse the registry index at `{}`", indexPath.string());
+		}
+
+		index = std::move(*parsed);
+	}
+
+	json::Array versions;
+	if (auto *existing = index.find("versions"); existing && existing->as_array())
+	{
+		versions = *existing->as_array();
+	}
+
+	// Sources are never replaced, lockfiles pin their checksum. Publishing a version
+	// again only adds the prebuilt library for another profile. Versions published
+	// before checksums were SHA-256 can't be verified, so they are packaged again.
+	auto& entry = version_entry(versions, version);
+	auto *checksum = entry.find("checksum");
+	if (checksum == nullptr || checksum->as_string() == nullptr ||
+		!sha256::from_hex(*checksum->as_string()))
+	{
+		print_status("Packaging", "{} v{}", name, version);
+
+		auto archive = registry / "packages" / name / (version + ".tar");
+		auto temp = io::temp_path(archive);
+		ProcessBuilder tar {find_tool("tar")};
+		tar.add_arg("-cf");
+		tar.add_arg(temp);
+		tar.add_arg("-C");
+		tar.add_arg(package.root());
+		for (auto file : {"Freight.toml", "build.cpp", "src", "include"})
+		{
+			if (exists(package.root() / file))
+			{
+				tar.add_arg(file);
+			}
+		}
+
+		entry.set("checksum", sha256::to_hex(write_with(std::move(tar), temp, archive)));
+	}
+	else
+	{
+		std::println(std::cerr,
+			"\033[33mwarning:\033[39m `{}` v{} is already published, keeping its sources",
+			name,
+			version);
+	}
+
+	BuildOptions buildOpts {
+		.release = opts.release,
+		.jobs = {},
+	};
+
+	auto targets = package.targets();
+	auto library = std::ranges::find(targets, TargetKind::Lib, &Target::kind);
+	if (library != targets.end())
+	{
+		auto result = build_package(ws, package, buildOpts, TargetKind::Lib);
+		if (!result.succeeded)
+		{
+			std::exit(1);
+		}
+
+		auto& toolchain = ws.toolchain();
+		if (toolchain.ar.path.empty())
+		{
+			bail("could not find `llvm-ar` next to `{}`", toolchain.clang.path.string());
+		}
+
+		// The library is built as a thin archive, which only makes sense next to its
+		// objects, so its members are copied into a regular one
+		Profile profile =
+			package.manifest().profile(select_profile(buildOpts, TargetKind::Lib));
+		auto thin = ws.build_dir() / profile.target_subdir / artifact_name(*library);
+		auto features = resolve_features(ws, package, buildOpts.features);
+		auto key = artifact_key(toolchain,
+			profile,
+			package.standard(),
+			features.defines(package));
+		auto artifact = registry / "artifacts" / name / version / (key + ".a");
+		print_status("Archiving",
+			"{} v{} for `{}` ({})",
+			name,
+			version,
+			profile.name,
+			key);
+
+		auto temp = io::temp_path(artifact);
+		ProcessBuilder ar {toolchain.ar.path};
+		ar.add_arg("qcsLD");
+		ar.add_arg(temp);
+		ar.add_arg(thin);
+
+		json::Object artifacts;
+		if (auto *existing = entry.find("artifacts"); existing && existing->as_object())
+		{
+			artifacts = *existing->as_object();
+		}
+
+		json::Value artifactsValue {std::move(artifacts)};
+		artifactsValue.set(key, sha256::to_hex(write_with(std::move(ar), temp, artifact)));
+		entry.set("artifacts", std::move(artifactsValue));
+	}
+
+	index.set("versions", std::move(versions));
+	if (!io::write_file_atomic(indexPath, json::to_string(index, true)))
+	{
+		bail("failed to write the registry index to `{}`", indexPath.string());
+	}
+
+	print_status("Published", "{} v{} to `{}`", name, version, registry.string());
+}
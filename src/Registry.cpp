@@ -0,0 +1,580 @@
+#include "Pch.h"
+
+#include "Registry.h"
+
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "Support/Hash.h"
+#include "Support/Io.h"
+#include "Support/Json.h"
+#include "Support/Sha256.h"
+#include "Support/Util.h"
+
+namespace
+{
+struct Version
+{
+	std::uint64_t major = 0;
+	std::uint64_t minor = 0;
+	std::uint64_t patch = 0;
+
+	auto operator<=>(const Version&) const = default;
+};
+
+struct ParsedVersion
+{
+	Version version;
+	// How many of major, minor and patch were given
+	std::size_t parts = 0;
+};
+
+/**
+ * Parses `MAJOR[.MINOR[.PATCH]]`. Pre-release and build metadata aren't supported.
+ */
+std::optional<ParsedVersion> parse_version(std::string_view text)
+{
+	ParsedVersion parsed;
+	std::array fields {
+		&parsed.version.major,
+		&parsed.version.minor,
+		&parsed.version.patch,
+	};
+
+	for (auto partRange : text | std::views::split('.'))
+	{
+		std::string_view part {partRange};
+		if (parsed.parts == fields.size() || part.empty())
+		{
+			return {};
+		}
+
+		auto *end = part.data() + part.size();
+		auto [ptr, errc] = std::from_chars(part.data(), end, *fields[parsed.parts]);
+		if (errc != std::errc {} || ptr != end)
+		{
+			return {};
+		}
+
+		parsed.parts++;
+	}
+
+	if (parsed.parts == 0)
+	{
+		return {};
+	}
+
+	return parsed;
+}
+
+std::filesystem::path freight_home()
+{
+	if (const char *home = std::getenv("FREIGHT_HOME"); home != nullptr && *home != '\0')
+	{
+		return home;
+	}
+
+	if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0')
+	{
+		return std::filesystem::path {home} / ".freight";
+	}
+
+	bail("failed to locate the Freight home directory\n\n{}",
+		cause("set `FREIGHT_HOME` or `HOME`"));
+}
+
+/**
+ * Parses the index of `name` in `registry`, or returns an empty optional if `text`
+ * isn't one. Versions that can't be parsed are left out.
+ */
+std::optional<std::vector<RegistrySource>> parse_index(const Registry& registry,
+	const std::string& name,
+	std::string_view text)
+{
+	auto index = json::parse(text);
+	auto *versions =
+		index && index->find("versions") ? index->find("versions")->as_array() : nullptr;
+	if (versions == nullptr)
+	{
+		return {};
+	}
+
+	std::vector<RegistrySource> sources;
+	for (auto& entry : *versions)
+	{
+		auto *version =
+			entry.find("version") ? entry.find("version")->as_string() : nullptr;
+		auto *checksum =
+			entry.find("checksum") ? entry.find("checksum")->as_string() : nullptr;
+		auto digest = checksum ? sha256::from_hex(*checksum) : std::nullopt;
+		if (version == nullptr || !parse_version(*version) || !digest)
+		{
+			continue;
+		}
+
+		RegistrySource source {
+			.name = name,
+			.version = *version,
+			.registry = registry.location(),
+			.checksum = *digest,
+			.artifacts = {},
+		};
+
+		auto *artifacts = entry.find("artifacts");
+		if (artifacts != nullptr && artifacts->as_object() != nullptr)
+		{
+			for (auto& [key, value] : *artifacts->as_object())
+			{
+				auto *hex = value.as_string();
+				if (auto artifact = hex ? sha256::from_hex(*hex) : std::nullopt)
+				{
+					source.artifacts.emplace(key, *artifact);
+				}
+			}
+		}
+
+		sources.push_back(std::move(source));
+	}
+
+	return sources;
+}
+
+/**
+ * Where the index of `name` fetched from `registry` last is kept. Registries are told
+ * apart by their location, since they may list the same package differently.
+ */
+std::filesystem::path cached_index_path(const Registry& registry, const std::string& name)
+{
+	hash::Hasher hasher;
+	hasher.update(registry.location());
+	return freight_home() / "registry" / "index" / hash::to_hex(hasher.finish()) /
+		   (name + ".json");
+}
+
+/**
+ * The versions of `name` in the index of `registry` as it was last fetched, if it was.
+ */
+std::optional<std::vector<RegistrySource>> read_cached_index(const Registry& registry,
+	const std::string& name)
+{
+	auto text = io::read_file(cached_index_path(registry, name));
+	return text ? parse_index(registry, name, *text) : std::nullopt;
+}
+
+/**
+ * Fetches the versions of `name` from the index of `registry`, and caches the index
+ * for `read_cached_index`.
+ */
+std::vector<RegistrySource> fetch_index(const Registry& registry, const std::string& name)
+{
+	auto cached = cached_index_path(registry, name);
+	auto file = io::temp_path(cached);
+	if (!registry.download(std::format("index/{}.json", name), file))
+	{
+		bail("failed to fetch `{}` from the registry at `{}`\n\n{}",
+			name,
+			registry.location(),
+			cause("there is no such package, or the registry couldn't be reached"));
+	}
+
+	auto text = io::read_file(file);
+	auto versions = parse_index(registry, name, text.value_or(""));
+	std::error_code errc;
+	if (!versions)
+	{
+		std::filesystem::remove(file, errc);
+		bail("failed to parse the registry index of `{}`", name);
+	}
+
+	// Only a valid index replaces the cached one
+	std::filesystem::rename(file, cached, errc);
+	if (errc)
+	{
+		std::filesystem::remove(file, errc);
+	}
+
+	return std::move(*versions);
+}
+
+/**
+ * The directory the sources of `version` of `name` are unpacked into. Package names
+ * are inferred from their directory, so each version gets a directory of its own with
+ * the package inside.
+ */
+std::filesystem::path sources_dir(const std::string& name, const std::string& version)
+{
+	return freight_home() / "registry" / "src" / std::format("{}-{}", name, version);
+}
+
+/**
+ * `locked` as listed by the index cached when it was last fetched, if its sources are
+ * unpacked already and the index lists it with the checksum the lockfile pins.
+ */
+std::optional<RegistrySource> resolve_locked(const Registry& registry,
+	const std::string& name,
+	const LockedPackage& locked)
+{
+	auto cached = read_cached_index(registry, name);
+	if (!cached || !locked.checksum)
+	{
+		return {};
+	}
+
+	auto it = std::ranges::find(*cached, locked.version, &RegistrySource::version);
+	if (it == cached->end() || it->checksum != *locked.checksum)
+	{
+		return {};
+	}
+
+	auto checksum = io::read_file(sources_dir(name, locked.version) / ".checksum");
+	if (checksum != sha256::to_hex(it->checksum))
+	{
+		return {};
+	}
+
+	return std::move(*it);
+}
+
+/**
+ * Downloads, verifies and unpacks the sources of `source` into `dir`, next to a
+ * `.checksum` file telling which archive they came from. Unpacking happens in a
+ * temporary directory, which is then renamed into place, so other Freight processes
+ * never see half of the sources.
+ */
+void unpack_sources(const Registry& registry,
+	const RegistrySource& source,
+	const std::filesystem::path& dir)
+{
+	print_status(" Fetching", "{} v{}", source.name, source.version);
+
+	auto archive = io::temp_path(dir);
+	archive += ".tar";
+	auto path = std::format("packages/{}/{}.tar", source.name, source.version);
+	if (!registry.download(path, archive))
+	{
+		bail("failed to download `{}` v{} from the registry at `{}`",
+			source.name,
+			source.version,
+			registry.location());
+	}
+
+	std::error_code errc;
+	auto checksum = sha256::hash_file(archive);
+	if (checksum != source.checksum)
+	{
+		std::filesystem::remove(archive, errc);
+		bail("failed to verify `{}` v{}\n\n{}",
+			source.name,
+			source.version,
+			cause("its checksum is {}, but the registry index says {}",
+				checksum ? sha256::to_hex(*checksum) : "unknown",
+				sha256::to_hex(source.checksum)));
+	}
+
+	auto staging = io::temp_path(dir);
+	std::filesystem::remove_all(staging, errc);
+	std::filesystem::create_directories(staging / source.name);
+
+	ProcessBuilder tar {find_tool("tar")};
+	tar.add_arg("-xf");
+	tar.add_arg(archive);
+	tar.add_arg("-C");
+	tar.add_arg(staging / source.name);
+	int exitCode = tar.start();
+	std::filesystem::remove(archive, errc);
+	if (exitCode != 0 || !io::write_file(staging / ".checksum", sha256::to_hex(*checksum)))
+	{
+		std::filesystem::remove_all(staging, errc);
+		bail("failed to unpack `{}` v{}", source.name, source.version);
+	}
+
+	// Another Freight process may have unpacked the same archive meanwhile, and be
+	// building from it already, so only stale sources are replaced
+	if (io::read_file(dir / ".checksum") == sha256::to_hex(*checksum))
+	{
+		std::filesystem::remove_all(staging, errc);
+		return;
+	}
+
+	std::filesystem::remove_all(dir, errc);
+	std::filesystem::rename(staging, dir, errc);
+	if (errc)
+	{
+		// Another Freight process unpacked the same version first
+		std::filesystem::remove_all(staging, errc);
+	}
+}
+} // namespace
+
+std::optional<Registry> Registry::from_env()
+{
+	const char *location = std::getenv("FREIGHT_REGISTRY");
+	if (location == nullptr || *location == '\0')
+	{
+		return {};
+	}
+
+	// Locations are recorded in the lockfile, so they are normalized
+	Registry registry {location};
+	if (!registry.remote())
+	{
+		registry.location_ = std::filesystem::absolute(location).lexically_normal();
+	}
+
+	while (registry.location_.size() > 1 && registry.location_.ends_with('/'))
+	{
+		registry.location_.pop_back();
+	}
+
+	return registry;
+}
+
+bool Registry::download(std::string_view path, const std::filesystem::path& file) const
+{
+	std::error_code errc;
+	std::filesystem::create_directories(file.parent_path(), errc);
+
+	if (!remote())
+	{
+		std::filesystem::copy_file(std::filesystem::path {location_} / path,
+			file,
+			std::filesystem::copy_options::overwrite_existing,
+			errc);
+		return !errc;
+	}
+
+	ProcessBuilder curl {find_tool("curl")};
+	curl.add_arg("--fail");
+	curl.add_arg("--silent");
+	curl.add_arg("--show-error");
+	curl.add_arg("--location");
+	curl.add_arg("--output");
+	curl.add_arg(file);
+	curl.add_arg(std::format("{}/{}", location_, path));
+	if (curl.start() != 0)
+	{
+		std::filesystem::remove(file, errc);
+		return false;
+	}
+
+	return true;
+}
+
+bool version_requirement_valid(std::string_view requirement)
+{
+	if (requirement.starts_with('='))
+	{
+		requirement.remove_prefix(1);
+	}
+
+	return requirement == "*" || parse_version(requirement).has_value();
+}
+
+bool version_matches(std::string_view requirement, std::string_view version)
+{
+	auto candidate = parse_version(version);
+	if (!candidate)
+	{
+		return false;
+	}
+	else if (requirement == "*")
+	{
+		return true;
+	}
+
+	bool exact = requirement.starts_with('=');
+	auto required = parse_version(exact ? requirement.substr(1) : requirement);
+	if (!required)
+	{
+		return false;
+	}
+
+	auto& v = candidate->version;
+	auto& r = required->version;
+	if (exact)
+	{
+		// Parts left out match anything, so `=1.2` is any `1.2.x`
+		return v.major == r.major && (required->parts < 2 || v.minor == r.minor) &&
+			   (required->parts < 3 || v.patch == r.patch);
+	}
+
+	// Anything up to the leftmost nonzero part given is considered breaking
+	Version upper;
+	if (r.major > 0 || required->parts == 1)
+	{
+		upper = {.major = r.major + 1, .minor = 0, .patch = 0};
+	}
+	else if (r.minor > 0 || required->parts == 2)
+	{
+		upper = {.major = 0, .minor = r.minor + 1, .patch = 0};
+	}
+	else
+	{
+		upper = {.major = 0, .minor = 0, .patch = r.patch + 1};
+	}
+
+	return r <= v && v < upper;
+}
+
+ResolvedPackage resolve_package(const Registry& registry,
+	const std::string& name,
+	const std::string& requirement,
+	const LockedPackage *locked)
+{
+	// A locked version that is unpacked already resolves without the registry, so
+	// builds only reach it once something changed, and can run offline
+	if (locked && version_matches(requirement, locked->version))
+	{
+		if (auto source = resolve_locked(registry, name, *locked))
+		{
+			return ResolvedPackage {
+				.manifest = sources_dir(name, source->version) / name / "Freight.toml",
+				.source = std::move(*source),
+			};
+		}
+	}
+
+	auto versions = fetch_index(registry, name);
+
+	// The locked version is kept for as long as it matches, even once newer ones are
+	// published
+	const RegistrySource *selected = nullptr;
+	for (auto& candidate : versions)
+	{
+		if (!version_matches(requirement, candidate.version))
+		{
+			continue;
+		}
+
+		if (locked && candidate.version == locked->version)
+		{
+			// A version republished with other sources is a different package
+			if (candidate.checksum != locked->checksum)
+			{
+				bail("failed to verify `{}` v{}\n\n{}",
+					name,
+					candidate.version,
+					cause("the registry at `{}` lists it with checksum {}, but "
+						  "`Freight.lock` pins {}; remove its entry from "
+						  "`Freight.lock` to accept the new sources",
+						registry.location(),
+						sha256::to_hex(candidate.checksum),
+						sha256::to_hex(*locked->checksum)));
+			}
+
+			selected = &candidate;
+			break;
+		}
+
+		if (selected == nullptr || parse_version(candidate.version)->version >
+									   parse_version(selected->version)->version)
+		{
+			selected = &candidate;
+		}
+	}
+
+	if (selected == nullptr)
+	{
+		bail("failed to resolve dependency `{}`\n\n{}",
+			name,
+			cause("no version matching `{}` in the registry at `{}`",
+				requirement,
+				registry.location()));
+	}
+
+	auto dir = sources_dir(name, selected->version);
+	if (io::read_file(dir / ".checksum") != sha256::to_hex(selected->checksum))
+	{
+		unpack_sources(registry, *selected, dir);
+	}
+
+	return ResolvedPackage {
+		.manifest = dir / name / "Freight.toml",
+		.source = *selected,
+	};
+}
+
+std::string artifact_key(const Toolchain& toolchain,
+	const Profile& profile,
+	Standard standard,
+	std::span<const std::string> features)
+{
+	hash::Hasher hasher;
+	hasher.update(toolchain.identity());
+	if (profile.platform)
+	{
+		hasher.update(profile.platform->triple);
+		for (auto& flag : profile.platform->flags)
+		{
+			hasher.update(flag);
+		}
+	}
+	else
+	{
+		hasher.update(toolchain.triple);
+	}
+
+	// Profiles can be tuned in the manifest, so their flags count rather than their name
+	hasher.update(profile.name);
+	hasher.update(profile.variant.name());
+	for (int flag : {static_cast<int>(profile.optLevel),
+			 static_cast<int>(profile.debug),
+			 static_cast<int>(profile.debug_assertions),
+			 static_cast<int>(profile.splitDebugInfo),
+			 static_cast<int>(standard)})
+	{
+		hasher.update(std::to_string(flag));
+	}
+
+	for (auto& feature : features)
+	{
+		hasher.update(feature);
+	}
+
+	return hash::to_hex(hasher.finish());
+}
+
+std::optional<std::filesystem::path> fetch_artifact(const RegistrySource& source,
+	const std::string& key)
+{
+	auto checksum = source.artifacts.find(key);
+	if (checksum == source.artifacts.end())
+	{
+		return {};
+	}
+
+	auto file = freight_home() / "registry" / "artifacts" /
+				std::format("{}-{}", source.name, source.version) / (key + ".a");
+	if (sha256::hash_file(file) == checksum->second)
+	{
+		return file;
+	}
+
+	print_status(" Fetching", "{} v{} (prebuilt)", source.name, source.version);
+
+	auto temp = io::temp_path(file);
+	auto path = std::format("artifacts/{}/{}/{}.a", source.name, source.version, key);
+	std::error_code errc;
+	if (!Registry {source.registry}.download(path, temp) ||
+		sha256::hash_file(temp) != checksum->second)
+	{
+		std::filesystem::remove(temp, errc);
+		std::println(std::cerr,
+			"\033[33mwarning:\033[39m failed to download the prebuilt library of "
+			"`{}` v{}, building it from source",
+			source.name,
+			source.version);
+		return {};
+	}
+
+	std::filesystem::rename(temp, file, errc);
+	if (errc)
+	{
+		std::filesystem::remove(temp, errc);
+		return {};
+	}
+
+	return file;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "Lockfile.h"
+#include "Toolchain.h"
+#include "Workspace.h"
+
+/**
+ * A package registry, in a local directory or served over HTTP, for instance by
+ * `freight registry serve`. Laid out as:
+ *
+ *     index/<name>.json                      the versions of a package
+ *     packages/<name>/<version>.tar          the sources of a version
+ *     artifacts/<name>/<version>/<key>.a     its library, prebuilt for `artifact_key`
+ *
+ * Every file is verified against its checksum in the index before it is used.
+ */
+class Registry
+{
+public:
+	explicit Registry(std::string location) : location_ {std::move(location)}
+	{
+	}
+
+	/**
+	 * The registry named by `FREIGHT_REGISTRY`, if it is set.
+	 */
+	static std::optional<Registry> from_env();
+
+	/**
+	 * The directory or URL of the registry.
+	 */
+	const std::string& location() const
+	{
+		return location_;
+	}
+
+	/**
+	 * Copies the file at `path` in the registry to `file`. Returns false if there is no
+	 * such file or it couldn't be fetched.
+	 */
+	bool download(std::string_view path, const std::filesystem::path& file) const;
+private:
+	std::string location_;
+
+	bool remote() const
+	{
+		return location_.starts_with("http://") || location_.starts_with("https://");
+	}
+};
+
+struct ResolvedPackage
+{
+	std::filesystem::path manifest;
+	RegistrySource source;
+};
+
+/**
+ * Whether `requirement` is a version, optionally prefixed with `=` to ask for exactly
+ * that version, or `*`.
+ */
+bool version_requirement_valid(std::string_view requirement);
+
+/**
+ * Whether `version` satisfies `requirement`. Requirements are caret requirements
+ * unless prefixed with `=`: `1.2` matches `1.2.0` up to but excluding `2.0.0`, and
+ * `0.2` matches `0.2.0` up to but excluding `0.3.0`.
+ */
+bool version_matches(std::string_view requirement, std::string_view version);
+
+/**
+ * Picks the newest version of `name` in `registry` matching `requirement`, or the
+ * version of `locked` if it still matches, and downloads and unpacks its sources
+ * unless they are cached already. The index is cached under the Freight home, and a
+ * locked version whose sources are unpacked is resolved from that cache without
+ * reaching the registry. Bails if there is no such version, it can't be downloaded,
+ * or the registry lists the locked version with another checksum than `locked` pins.
+ */
+ResolvedPackage resolve_package(const Registry& registry,
+	const std::string& name,
+	const std::string& requirement,
+	const LockedPackage *locked);
+
+/**
+ * Names the ABI prebuilt libraries are compatible with: the compiler, the target
+ * triple and its flags, the profile with its variant and the flags it compiles with,
+ * the language standard, and the defines of the package's enabled features.
+ */
+std::string artifact_key(const Toolchain& toolchain,
+	const Profile& profile,
+	Standard standard,
+	std::span<const std::string> features);
+
+/**
+ * Downloads the prebuilt library of `source` for `key`, unless it is cached already.
+ * Empty if the registry has none or it couldn't be downloaded, in which case the
+ * package is built from source.
+ */
+std::optional<std::filesystem::path> fetch_artifact(const RegistrySource& source,
+	const std::string& key);
@@ -0,0 +1,157 @@
+#include "Pch.h"
+
+#include <arpa/inet.h>
+#include <array>
+#include <filesystem>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Cmds.h"
+#include "Support/Io.h"
+#include "Support/Util.h"
+
+namespace
+{
+/**
+ * Reads the request line and headers of a request, up to a limit.
+ */
+std::string read_request(int fd)
+{
+	static constexpr std::size_t MAX_REQUEST_SIZE = 8192;
+
+	std::string request;
+	std::array<char, 1024> buffer;
+	while (!request.contains("\r\n\r\n") && request.size() < MAX_REQUEST_SIZE)
+	{
+		auto size = read(fd, buffer.data(), buffer.size());
+		if (size <= 0)
+		{
+			break;
+		}
+
+		request.append(buffer.data(), static_cast<std::size_t>(size));
+	}
+
+	return request;
+}
+
+void write_all(int fd, std::string_view data)
+{
+	while (!data.empty())
+	{
+		// Clients hanging up early mustn't take the server down with `SIGPIPE`
+		auto written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+		if (written <= 0)
+		{
+			return;
+		}
+
+		data.remove_prefix(static_cast<std::size_t>(written));
+	}
+}
+
+void respond(int fd, std::string_view status, std::string_view body)
+{
+	write_all(fd,
+		std::format("HTTP/1.1 {}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n",
+			status,
+			body.size()));
+	write_all(fd, body);
+}
+
+/**
+ * Answers a single request for a file in `root`. Only `GET` is supported, and paths
+ * can't leave `root`.
+ */
+void serve_request(int fd, const std::filesystem::path& root)
+{
+	auto request = read_request(fd);
+	std::string_view line {request};
+	line = line.substr(0, line.find("\r\n"));
+
+	auto method = line.substr(0, line.find(' '));
+	auto target = line.substr(std::min(method.size() + 1, line.size()));
+	target = target.substr(0, target.find(' '));
+	target = target.substr(0, target.find('?'));
+
+	std::string_view status = "200 OK";
+	std::optional<std::string> body;
+	if (method != "GET")
+	{
+		status = "405 Method Not Allowed";
+	}
+	else if (!target.starts_with('/') || target.contains(".."))
+	{
+		status = "400 Bad Request";
+	}
+	else if (body = io::read_file(root / target.substr(1)); !body)
+	{
+		status = "404 Not Found";
+	}
+
+	print_status("  Serving", "{} {} {}", method, target, status.substr(0, 3));
+	respond(fd, status, body.value_or(""));
+}
+} // namespace
+
+void exec_registry_serve(const RegistryServeOptions& opts)
+{
+	auto root = std::filesystem::absolute(opts.dir).lexically_normal();
+	if (!std::filesystem::is_directory(root))
+	{
+		bail("failed to serve the registry at `{}`\n\n{}",
+			root.string(),
+			cause("no such directory"));
+	}
+
+	auto fail = [](std::string_view what) {
+		bail("failed to {}\n\n{}",
+			what,
+			cause(std::error_code {errno, std::system_category()}.message()));
+	};
+
+	int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener == -1)
+	{
+		fail("create a socket");
+	}
+
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	// Only reachable from this machine, it's a stand-in for tests and CI caches
+	sockaddr_in address {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(opts.port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	auto *addressPtr = reinterpret_cast<sockaddr *>(&address);
+	socklen_t addressSize = sizeof(address);
+	if (bind(listener, addressPtr, addressSize) == -1 ||
+		listen(listener, SOMAXCONN) == -1 ||
+		getsockname(listener, addressPtr, &addressSize) == -1)
+	{
+		fail(std::format("listen on port {}", opts.port));
+	}
+
+	print_status("  Serving",
+		"`{}` at http://127.0.0.1:{}",
+		root.string(),
+		ntohs(address.sin_port));
+
+	// One request at a time is plenty for a local registry
+	while (true)
+	{
+		int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (client == -1)
+		{
+			continue;
+		}
+
+		serve_request(client, root);
+		close(client);
+	}
+}
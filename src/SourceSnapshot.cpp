@@ -0,0 +1,303 @@
+#include "Pch.h"
+
+#include "SourceSnapshot.h"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "Support/DigestCache.h"
+#include "Support/Hash.h"
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+#include "Support/Json.h"
+#include "Support/Util.h"
+
+static std::vector<std::filesystem::path> collect_files(
+	std::span<const std::filesystem::path> roots)
+{
+	using namespace std::filesystem;
+
+	std::vector<path> files;
+	for (auto& root : roots)
+	{
+		if (is_regular_file(root))
+		{
+			files.push_back(absolute(root).lexically_normal());
+			continue;
+		}
+
+		std::error_code errc;
+		auto options = directory_options::skip_permission_denied;
+		for (auto& entry : recursive_directory_iterator {root, options, errc})
+		{
+			if (entry.is_regular_file())
+			{
+				files.push_back(absolute(entry.path()).lexically_normal());
+			}
+		}
+	}
+
+	// Roots may overlap, e.g. `src/` and an include directory inside it
+	std::ranges::sort(files);
+	auto [first, last] = std::ranges::unique(files);
+	files.erase(first, last);
+	return files;
+}
+
+// The snapshots whose blobs survive pruning, the most recently used. The store is only
+// pruned once twice as many have piled up, so most builds just list it.
+static constexpr std::size_t KEPT_SNAPSHOTS = 8;
+
+/**
+ * Deletes the overlays of all but the `KEPT_SNAPSHOTS` most recently used snapshots,
+ * then every blob the remaining overlays don't refer to. Must only run while no other
+ * build uses the store. Blobs a later build misses are simply copied again.
+ */
+static void prune_store(const std::filesystem::path& storeDir)
+{
+	using namespace std::filesystem;
+
+	std::vector<std::pair<file_time_type, path>> overlays;
+	std::vector<path> blobs;
+	std::error_code errc;
+	directory_iterator it {storeDir, errc};
+	for (; !errc && it != directory_iterator {}; it.increment(errc))
+	{
+		auto name = it->path().filename().string();
+		if (name.starts_with("overlay-"))
+		{
+			std::error_code timeErrc;
+			overlays.emplace_back(it->last_write_time(timeErrc), it->path());
+		}
+		else if (name != "digests" && name != ".lock")
+		{
+			// Temporary files left behind by crashed builds go too
+			blobs.push_back(it->path());
+		}
+	}
+
+	if (errc || overlays.size() <= 2 * KEPT_SNAPSHOTS)
+	{
+		return;
+	}
+
+	std::ranges::sort(overlays, std::greater {});
+	std::unordered_set<std::string> referenced;
+	for (auto& [time, overlay] : overlays | std::views::take(KEPT_SNAPSHOTS))
+	{
+		auto parsed = json::parse(io::read_file(overlay).value_or(""));
+		auto *roots = parsed && parsed->find("roots") ? parsed->find("roots")->as_array()
+													  : nullptr;
+		if (roots == nullptr)
+		{
+			// Without knowing what the overlay refers to, nothing can be deleted
+			return;
+		}
+
+		for (auto& root : *roots)
+		{
+			auto *contents = root.find("external-contents");
+			if (contents && contents->as_string())
+			{
+				referenced.insert(path {*contents->as_string()}.filename().string());
+			}
+		}
+	}
+
+	for (auto& [time, overlay] : overlays | std::views::drop(KEPT_SNAPSHOTS))
+	{
+		remove(overlay, errc);
+	}
+
+	for (auto& blob : blobs)
+	{
+		if (!referenced.contains(blob.filename().string()))
+		{
+			remove(blob, errc);
+		}
+	}
+}
+
+/**
+ * Blobs are keyed on the path too, so identical files don't share a copy. Clang would
+ * take two paths with the same inode to be the same file.
+ */
+static std::filesystem::path blob_path(const std::filesystem::path& storeDir,
+	const std::filesystem::path& file,
+	hash::Digest digest)
+{
+	hash::Hasher pathHasher;
+	pathHasher.update(file.native());
+	return storeDir /
+		   std::format("{}-{}", hash::to_hex(digest), hash::to_hex(pathHasher.finish()));
+}
+
+static std::optional<SourceSnapshot::File> snapshot_file(
+	const std::filesystem::path& storeDir,
+	const std::filesystem::path& file,
+	hash::DigestCache& digests)
+{
+	// Files that didn't change since the last build already have a copy in the store,
+	// so they don't even need to be read
+	auto stamp = io::stamp_file(file);
+	if (auto digest = stamp ? digests.find(*stamp) : std::nullopt)
+	{
+		auto blob = blob_path(storeDir, file, *digest);
+		if (auto mapped = io::MappedFile::open(blob))
+		{
+			return SourceSnapshot::File {
+				.digest = *digest,
+				.blob = std::move(blob),
+				.contents = std::move(*mapped),
+			};
+		}
+	}
+
+	// Hashing and copying the same buffer guarantees the copy has the hashed contents,
+	// even if the file is being written to
+	auto contents = io::read_file(file);
+	if (!contents)
+	{
+		return {};
+	}
+
+	auto digest = hash::hash_bytes(std::as_bytes(std::span {*contents}));
+	auto blob = blob_path(storeDir, file, digest);
+	if (!std::filesystem::exists(blob) && !io::write_file_atomic(blob, *contents))
+	{
+		return {};
+	}
+
+	auto mapped = io::MappedFile::open(blob);
+	if (!mapped)
+	{
+		return {};
+	}
+
+	if (stamp && io::stamp_file(file) == stamp)
+	{
+		digests.insert(*stamp, digest);
+	}
+
+	return SourceSnapshot::File {
+		.digest = digest,
+		.blob = std::move(blob),
+		.contents = std::move(*mapped),
+	};
+}
+
+SourceSnapshot SourceSnapshot::create(const std::filesystem::path& storeDir,
+	std::span<const std::filesystem::path> roots,
+	std::size_t jobs)
+{
+	std::error_code errc;
+	std::filesystem::create_directories(storeDir, errc);
+
+	// Other builds hold the store shared for as long as they run, so getting it
+	// exclusively means nothing refers to the blobs but the overlays
+	SourceSnapshot snapshot;
+	snapshot.storeLock = io::FileLock::open(storeDir / ".lock", errc);
+	if (!errc && snapshot.storeLock.try_lock())
+	{
+		prune_store(storeDir);
+	}
+
+	if (!errc)
+	{
+		snapshot.storeLock.lock_shared(errc);
+	}
+
+	auto paths = collect_files(roots);
+	std::vector<std::optional<File>> snapshots(paths.size());
+	hash::DigestCache digests {storeDir / "digests"};
+
+	jobs::Scheduler scheduler {jobs};
+	for (std::size_t i = 0; i < paths.size(); i++)
+	{
+		scheduler.add([&storeDir, &paths, &snapshots, &digests, i] {
+			snapshots[i] = snapshot_file(storeDir, paths[i], digests);
+			return true;
+		});
+	}
+	scheduler.run();
+	digests.save();
+
+	json::Array overlayRoots;
+	for (std::size_t i = 0; i < paths.size(); i++)
+	{
+		// Files that couldn't be snapshotted are read from the working tree instead
+		if (!snapshots[i])
+		{
+			continue;
+		}
+
+		overlayRoots.push_back(json::Object {
+			{"type", "file"},
+			{"name", paths[i].string()},
+			{"external-contents", snapshots[i]->blob.string()},
+		});
+		snapshot.files.emplace(paths[i], std::move(*snapshots[i]));
+	}
+
+	// Diagnostics, `__FILE__` and depfiles should name the original files, not the
+	// copies
+	auto overlay = json::to_string(json::Object {
+		{"version", 0},
+		{"case-sensitive", true},
+		{"use-external-names", false},
+		{"roots", std::move(overlayRoots)},
+	});
+
+	// The overlay is content-addressed like the blobs, so concurrent builds never
+	// overwrite each other's
+	auto overlayDigest = hash::hash_bytes(std::as_bytes(std::span {overlay}));
+	snapshot.overlay_ =
+		storeDir / std::format("overlay-{}.json", hash::to_hex(overlayDigest));
+	if (std::filesystem::exists(snapshot.overlay_))
+	{
+		// Pruning keeps the snapshots used last, not those taken last
+		std::filesystem::last_write_time(snapshot.overlay_,
+			std::filesystem::file_time_type::clock::now(),
+			errc);
+	}
+	else if (!io::write_file_atomic(snapshot.overlay_, overlay))
+	{
+		bail("failed to write the source snapshot overlay to `{}`",
+			snapshot.overlay_.string());
+	}
+
+	return snapshot;
+}
+
+const SourceSnapshot::File *SourceSnapshot::find(const std::filesystem::path& file) const
+{
+	auto it = files.find(file);
+	return it != files.end() ? &it->second : nullptr;
+}
+
+hash::Digest SourceSnapshot::tree_digest(const std::filesystem::path& dir) const
+{
+	std::vector<std::pair<std::filesystem::path, hash::Digest>> entries;
+	for (auto& [path, file] : files)
+	{
+		auto relative = path.lexically_relative(dir);
+		if (!relative.empty() && *relative.begin() != "..")
+		{
+			entries.emplace_back(std::move(relative), file.digest);
+		}
+	}
+
+	std::ranges::sort(entries);
+
+	hash::Hasher hasher;
+	for (auto& [relative, digest] : entries)
+	{
+		hasher.update(relative.native());
+		hasher.update(digest);
+	}
+
+	return hasher.finish();
+}
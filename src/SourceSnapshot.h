@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <unordered_map>
+
+#include "Support/Hash.h"
+#include "Support/Io.h"
+
+/**
+ * A read-only copy of a build's sources, taken once when the build starts. Compilers
+ * read the snapshot instead of the working tree, so every compile sees the same bytes
+ * that were hashed for incremental checks, even if files are edited mid-build, and
+ * each file is only read and hashed once per build.
+ *
+ * Copies live in a content-addressed store, so only files that changed since the last
+ * build are written. Builds share the store; whichever finds no other build using it
+ * prunes what the recent snapshots don't refer to. Process compiles read them through the clang VFS overlay from
+ * `overlay()`, passed with `-ivfsoverlay`; the in-process backend reads `find()`
+ * directly.
+ */
+class SourceSnapshot
+{
+public:
+	struct File
+	{
+		hash::Digest digest;
+		// The copy of the file in the store
+		std::filesystem::path blob;
+		io::MappedFile contents;
+	};
+
+	/**
+	 * Snapshots every file under `roots` into the store at `storeDir`, hashing them on
+	 * `jobs` threads.
+	 */
+	static SourceSnapshot create(const std::filesystem::path& storeDir,
+		std::span<const std::filesystem::path> roots,
+		std::size_t jobs);
+
+	/**
+	 * Looks up the snapshot of `file`, which must be absolute and lexically normal.
+	 */
+	const File *find(const std::filesystem::path& file) const;
+
+	std::optional<hash::Digest> digest(const std::filesystem::path& file) const
+	{
+		auto *entry = find(file);
+		return entry != nullptr ? std::optional {entry->digest} : std::nullopt;
+	}
+
+	/**
+	 * Digests every snapshotted file under `dir`, which must be absolute and lexically
+	 * normal, along with its path relative to `dir`. Moving the directory doesn't
+	 * change the digest.
+	 */
+	hash::Digest tree_digest(const std::filesystem::path& dir) const;
+
+	/**
+	 * The clang VFS overlay mapping every snapshotted file to its copy.
+	 */
+	const std::filesystem::path& overlay() const
+	{
+		return overlay_;
+	}
+
+	std::size_t size() const
+	{
+		return files.size();
+	}
+private:
+	std::unordered_map<std::filesystem::path, File> files;
+	std::filesystem::path overlay_;
+	// Held shared while the snapshot is in use, which keeps its blobs from being pruned
+	io::FileLock storeLock;
+};
@@ -0,0 +1,192 @@
+#include "../Pch.h"
+
+#include "Support/DigestCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#include "Support/Jobs.h"
+
+namespace hash
+{
+// Memos are machine-local caches, so they are stored in native byte order: a header
+// followed by fixed-size records
+static constexpr std::string_view MAGIC = "freight-digests";
+static constexpr std::uint32_t FORMAT_VERSION = 1;
+
+namespace
+{
+struct Header
+{
+	char magic[16];
+	std::uint32_t version;
+	std::uint32_t recordSize;
+	std::uint64_t count;
+};
+
+struct Record
+{
+	std::uint64_t device;
+	std::uint64_t inode;
+	std::int64_t mtime;
+	std::uint64_t size;
+	Digest digest;
+};
+} // namespace
+
+std::size_t DigestCache::StampHash::operator()(const io::FileStamp& stamp) const
+{
+	Hasher hasher;
+	hasher.update(stamp.device);
+	hasher.update(stamp.inode);
+	hasher.update(static_cast<Digest>(stamp.mtime));
+	hasher.update(stamp.size);
+	return hasher.finish();
+}
+
+DigestCache::DigestCache(std::filesystem::path file) : file {std::move(file)}
+{
+	auto mapped = io::MappedFile::open(this->file);
+	if (!mapped || mapped->bytes().size() < sizeof(Header))
+	{
+		return;
+	}
+
+	auto bytes = mapped->bytes();
+	Header header;
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (std::memcmp(header.magic, MAGIC.data(), MAGIC.size()) != 0 ||
+		header.version != FORMAT_VERSION ||
+		header.recordSize != sizeof(Record) ||
+		(bytes.size() - sizeof(Header)) / sizeof(Record) != header.count)
+	{
+		return;
+	}
+
+	entries.reserve(header.count);
+	for (std::uint64_t i = 0; i < header.count; i++)
+	{
+		Record record;
+		std::memcpy(&record,
+			bytes.data() + sizeof(Header) + i * sizeof(Record),
+			sizeof(record));
+		io::FileStamp stamp {
+			.device = record.device,
+			.inode = record.inode,
+			.mtime = record.mtime,
+			.size = record.size,
+		};
+		entries.emplace(stamp, Entry {.digest = record.digest, .used = false});
+	}
+}
+
+std::optional<Digest> DigestCache::find(const io::FileStamp& stamp)
+{
+	std::lock_guard lock {mutex};
+	auto it = entries.find(stamp);
+	if (it == entries.end())
+	{
+		return {};
+	}
+
+	it->second.used = true;
+	return it->second.digest;
+}
+
+void DigestCache::insert(const io::FileStamp& stamp, Digest digest)
+{
+	using namespace std::chrono;
+
+	// Like git's "racily clean" entries, a file written to twice within the mtime
+	// granularity of its filesystem would keep a stale digest
+	static constexpr std::int64_t RACY_WINDOW_NANOS = 1'000'000'000;
+	auto now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+	if (stamp.mtime > now - RACY_WINDOW_NANOS)
+	{
+		return;
+	}
+
+	std::lock_guard lock {mutex};
+	entries.insert_or_assign(stamp, Entry {.digest = digest, .used = true});
+}
+
+std::optional<Digest> DigestCache::hash_file(const std::filesystem::path& file)
+{
+	auto stamp = io::stamp_file(file);
+	if (!stamp)
+	{
+		return {};
+	}
+
+	if (auto digest = find(*stamp))
+	{
+		return digest;
+	}
+
+	auto digest = hash::hash_file(file);
+
+	// Only memoize the digest if the file didn't change while it was hashed
+	if (digest && io::stamp_file(file) == stamp)
+	{
+		insert(*stamp, *digest);
+	}
+
+	return digest;
+}
+
+std::vector<std::optional<Digest>> DigestCache::hash_files(
+	std::span<const std::filesystem::path> files,
+	std::size_t jobs)
+{
+	std::vector<std::optional<Digest>> digests(files.size());
+
+	jobs::Scheduler scheduler {jobs};
+	for (std::size_t i = 0; i < files.size(); i++)
+	{
+		scheduler.add([this, &files, &digests, i] {
+			digests[i] = hash_file(files[i]);
+			return true;
+		});
+	}
+	scheduler.run();
+
+	return digests;
+}
+
+bool DigestCache::save() const
+{
+	std::lock_guard lock {mutex};
+
+	std::vector<Record> records;
+	for (auto& [stamp, entry] : entries)
+	{
+		if (entry.used)
+		{
+			records.push_back({
+				.device = stamp.device,
+				.inode = stamp.inode,
+				.mtime = stamp.mtime,
+				.size = stamp.size,
+				.digest = entry.digest,
+			});
+		}
+	}
+
+	Header header {};
+	std::memcpy(header.magic, MAGIC.data(), MAGIC.size());
+	header.version = FORMAT_VERSION;
+	header.recordSize = sizeof(Record);
+	header.count = records.size();
+
+	std::string content(sizeof(Header) + records.size() * sizeof(Record), '\0');
+	std::memcpy(content.data(), &header, sizeof(header));
+	std::memcpy(content.data() + sizeof(Header),
+		records.data(),
+		records.size() * sizeof(Record));
+
+	std::error_code errc;
+	std::filesystem::create_directories(file.parent_path(), errc);
+	return io::write_file_atomic(file, content);
+}
+} // namespace hash
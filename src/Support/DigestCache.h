@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "Support/Hash.h"
+#include "Support/Io.h"
+
+namespace hash
+{
+/**
+ * A persistent memo of file digests, keyed by the device, inode, mtime and size of
+ * each file. Files whose stamp hasn't changed since they were last hashed don't need
+ * to be read again. May be used from several threads at once.
+ */
+class DigestCache
+{
+public:
+	/**
+	 * Loads the memo saved at `file`, or starts an empty one if there is none or it
+	 * can't be read.
+	 */
+	explicit DigestCache(std::filesystem::path file);
+
+	std::optional<Digest> find(const io::FileStamp& stamp);
+
+	/**
+	 * Memoizes the digest of a file with `stamp`. Files modified in the last second are
+	 * skipped: they may be written to again without their mtime changing.
+	 */
+	void insert(const io::FileStamp& stamp, Digest digest);
+
+	/**
+	 * Like `hash::hash_file`, but only reads the file if its digest isn't memoized.
+	 */
+	std::optional<Digest> hash_file(const std::filesystem::path& file);
+
+	/**
+	 * Like `hash::hash_files`, but only reads files whose digest isn't memoized.
+	 */
+	std::vector<std::optional<Digest>> hash_files(
+		std::span<const std::filesystem::path> files,
+		std::size_t jobs);
+
+	/**
+	 * Writes the memo back to its file, keeping only the entries used since it was
+	 * loaded.
+	 */
+	bool save() const;
+private:
+	struct StampHash
+	{
+		std::size_t operator()(const io::FileStamp& stamp) const;
+	};
+
+	struct Entry
+	{
+		Digest digest;
+		bool used;
+	};
+
+	std::filesystem::path file;
+	mutable std::mutex mutex;
+	std::unordered_map<io::FileStamp, Entry, StampHash> entries;
+};
+} // namespace hash
@@ -0,0 +1,544 @@
+#include "../Pch.h"
+
+#include "Support/Hash.h"
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+#if defined(__x86_64__)
+	#include <immintrin.h>
+#endif
+
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+
+namespace hash
+{
+void Hasher::update(std::span<const std::byte> bytes)
+{
+	for (auto byte : bytes)
+	{
+		state ^= static_cast<Digest>(byte);
+		state *= PRIME;
+	}
+}
+
+// XXH3-64 with the default secret and a seed of 0, as specified by
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md. Inputs of up to 240
+// bytes have scalar paths. Longer ones run 64-byte stripes through eight 64-bit
+// accumulators, which is what the SIMD kernels speed up.
+namespace
+{
+constexpr std::uint64_t PRIME32_1 = 0x9E3779B1;
+constexpr std::uint64_t PRIME32_2 = 0x85EBCA77;
+constexpr std::uint64_t PRIME32_3 = 0xC2B2AE3D;
+constexpr std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87;
+constexpr std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4F;
+constexpr std::uint64_t PRIME64_3 = 0x165667B19E3779F9;
+constexpr std::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63;
+constexpr std::uint64_t PRIME64_5 = 0x27D4EB2F165667C5;
+constexpr std::uint64_t PRIME_MX1 = 0x165667919E3779F9;
+constexpr std::uint64_t PRIME_MX2 = 0x9FB21C651E98DF25;
+
+constexpr std::size_t SECRET_SIZE = 192;
+constexpr std::size_t STRIPE_LEN = 64;
+constexpr std::size_t SECRET_CONSUME_RATE = 8;
+constexpr std::size_t ACC_NB = STRIPE_LEN / sizeof(std::uint64_t);
+constexpr std::size_t STRIPES_PER_BLOCK =
+	(SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE;
+constexpr std::size_t BLOCK_LEN = STRIPE_LEN * STRIPES_PER_BLOCK;
+constexpr std::size_t SECRET_LASTACC_START = 7;
+constexpr std::size_t SECRET_MERGEACCS_START = 11;
+constexpr std::size_t MIDSIZE_MAX = 240;
+constexpr std::size_t MIDSIZE_STARTOFFSET = 3;
+constexpr std::size_t MIDSIZE_LASTOFFSET = 17;
+constexpr std::size_t SECRET_SIZE_MIN = 136;
+
+alignas(64) constexpr std::array<unsigned char, SECRET_SIZE> SECRET_BYTES = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21,
+	0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4,
+	0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a,
+	0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21, 0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e,
+	0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3,
+	0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+	0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8, 0xa8, 0xfa,
+	0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78,
+	0x73, 0x64, 0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff,
+	0xfa, 0x13, 0x63, 0xeb, 0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16,
+	0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+	0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16,
+	0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+const std::byte *const SECRET = reinterpret_cast<const std::byte *>(SECRET_BYTES.data());
+
+std::uint64_t read64(const std::byte *p)
+{
+	std::uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return std::endian::native == std::endian::little ? value : std::byteswap(value);
+}
+
+std::uint32_t read32(const std::byte *p)
+{
+	std::uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return std::endian::native == std::endian::little ? value : std::byteswap(value);
+}
+
+std::uint64_t mul128_fold64(std::uint64_t lhs, std::uint64_t rhs)
+{
+	auto product = static_cast<unsigned __int128>(lhs) * rhs;
+	return static_cast<std::uint64_t>(product) ^
+		   static_cast<std::uint64_t>(product >> 64);
+}
+
+std::uint64_t xxh64_avalanche(std::uint64_t h)
+{
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	return h ^ (h >> 32);
+}
+
+std::uint64_t avalanche(std::uint64_t h)
+{
+	h ^= h >> 37;
+	h *= PRIME_MX1;
+	return h ^ (h >> 32);
+}
+
+std::uint64_t rrmxmx(std::uint64_t h, std::uint64_t len)
+{
+	h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+	h *= PRIME_MX2;
+	h ^= (h >> 35) + len;
+	h *= PRIME_MX2;
+	return h ^ (h >> 28);
+}
+
+std::uint64_t mix16(const std::byte *input, const std::byte *secret)
+{
+	return mul128_fold64(read64(input) ^ read64(secret),
+		read64(input + 8) ^ read64(secret + 8));
+}
+
+Digest hash_0to16(const std::byte *input, std::size_t len)
+{
+	if (len > 8)
+	{
+		auto lo = read64(input) ^ (read64(SECRET + 24) ^ read64(SECRET + 32));
+		auto hi = read64(input + len - 8) ^ (read64(SECRET + 40) ^ read64(SECRET + 48));
+		return avalanche(len + std::byteswap(lo) + hi + mul128_fold64(lo, hi));
+	}
+	else if (len >= 4)
+	{
+		auto combined = read32(input + len - 4) + (std::uint64_t {read32(input)} << 32);
+		return rrmxmx(combined ^ (read64(SECRET + 8) ^ read64(SECRET + 16)), len);
+	}
+	else if (len > 0)
+	{
+		auto c1 = std::to_integer<std::uint32_t>(input[0]);
+		auto c2 = std::to_integer<std::uint32_t>(input[len >> 1]);
+		auto c3 = std::to_integer<std::uint32_t>(input[len - 1]);
+		std::uint32_t combined = (c1 << 16) | (c2 << 24) | c3 | (len << 8);
+		return xxh64_avalanche(combined ^ (read32(SECRET) ^ read32(SECRET + 4)));
+	}
+
+	return xxh64_avalanche(read64(SECRET + 56) ^ read64(SECRET + 64));
+}
+
+Digest hash_17to128(const std::byte *input, std::size_t len)
+{
+	std::uint64_t acc = len * PRIME64_1;
+	if (len > 32)
+	{
+		if (len > 64)
+		{
+			if (len > 96)
+			{
+				acc += mix16(input + 48, SECRET + 96);
+				acc += mix16(input + len - 64, SECRET + 112);
+			}
+
+			acc += mix16(input + 32, SECRET + 64);
+			acc += mix16(input + len - 48, SECRET + 80);
+		}
+
+		acc += mix16(input + 16, SECRET + 32);
+		acc += mix16(input + len - 32, SECRET + 48);
+	}
+
+	acc += mix16(input, SECRET);
+	acc += mix16(input + len - 16, SECRET + 16);
+	return avalanche(acc);
+}
+
+Digest hash_129to240(const std::byte *input, std::size_t len)
+{
+	std::uint64_t acc = len * PRIME64_1;
+	for (std::size_t i = 0; i < 8; i++)
+	{
+		acc += mix16(input + 16 * i, SECRET + 16 * i);
+	}
+
+	std::uint64_t accEnd =
+		mix16(input + len - 16, SECRET + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET);
+	acc = avalanche(acc);
+	for (std::size_t i = 8; i < len / 16; i++)
+	{
+		accEnd += mix16(input + 16 * i, SECRET + 16 * (i - 8) + MIDSIZE_STARTOFFSET);
+	}
+
+	return avalanche(acc + accEnd);
+}
+
+/**
+ * Runs `stripes` stripes of `input` through the accumulators. The key of each stripe
+ * starts `SECRET_CONSUME_RATE` bytes further into `secret` than the previous one's.
+ */
+using AccumulateFn = void (*)(std::uint64_t *acc,
+	const std::byte *input,
+	const std::byte *secret,
+	std::size_t stripes);
+// Mixes the accumulators at the end of every block
+using ScrambleFn = void (*)(std::uint64_t *acc, const std::byte *secret);
+
+void accumulate_scalar(std::uint64_t *acc,
+	const std::byte *input,
+	const std::byte *secret,
+	std::size_t stripes)
+{
+	for (std::size_t n = 0; n < stripes; n++)
+	{
+		auto *stripe = input + n * STRIPE_LEN;
+		auto *key = secret + n * SECRET_CONSUME_RATE;
+		for (std::size_t i = 0; i < ACC_NB; i++)
+		{
+			auto data = read64(stripe + 8 * i);
+			auto dataKey = data ^ read64(key + 8 * i);
+			acc[i ^ 1] += data;
+			acc[i] += (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+		}
+	}
+}
+
+void scramble_scalar(std::uint64_t *acc, const std::byte *secret)
+{
+	for (std::size_t i = 0; i < ACC_NB; i++)
+	{
+		auto value = acc[i];
+		value ^= value >> 47;
+		value ^= read64(secret + 8 * i);
+		acc[i] = value * PRIME32_1;
+	}
+}
+
+#if defined(__x86_64__)
+// The vector kernels compute exactly what the scalar ones do, a lane per accumulator.
+// SSE2 is part of x86-64, so it needs no target attribute.
+
+void accumulate_sse2(std::uint64_t *acc,
+	const std::byte *input,
+	const std::byte *secret,
+	std::size_t stripes)
+{
+	static constexpr std::size_t LANES = STRIPE_LEN / sizeof(__m128i);
+
+	__m128i vacc[LANES];
+	std::memcpy(vacc, acc, STRIPE_LEN);
+	for (std::size_t n = 0; n < stripes; n++)
+	{
+		auto *stripe = reinterpret_cast<const __m128i *>(input + n * STRIPE_LEN);
+		auto *key = reinterpret_cast<const __m128i *>(secret + n * SECRET_CONSUME_RATE);
+		for (std::size_t i = 0; i < LANES; i++)
+		{
+			auto data = _mm_loadu_si128(stripe + i);
+			auto dataKey = _mm_xor_si128(data, _mm_loadu_si128(key + i));
+			auto dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+			auto product = _mm_mul_epu32(dataKey, dataKeyHi);
+			auto dataSwap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+			vacc[i] = _mm_add_epi64(vacc[i], _mm_add_epi64(product, dataSwap));
+		}
+	}
+	std::memcpy(acc, vacc, STRIPE_LEN);
+}
+
+void scramble_sse2(std::uint64_t *acc, const std::byte *secret)
+{
+	static constexpr std::size_t LANES = STRIPE_LEN / sizeof(__m128i);
+
+	auto prime = _mm_set1_epi32(static_cast<int>(PRIME32_1));
+	auto *key = reinterpret_cast<const __m128i *>(secret);
+	for (std::size_t i = 0; i < LANES; i++)
+	{
+		auto value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc) + i);
+		value = _mm_xor_si128(value, _mm_srli_epi64(value, 47));
+		auto dataKey = _mm_xor_si128(value, _mm_loadu_si128(key + i));
+		auto dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+		auto productLo = _mm_mul_epu32(dataKey, prime);
+		auto productHi = _mm_mul_epu32(dataKeyHi, prime);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(acc) + i,
+			_mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32)));
+	}
+}
+
+__attribute__((target("avx2"))) void accumulate_avx2(std::uint64_t *acc,
+	const std::byte *input,
+	const std::byte *secret,
+	std::size_t stripes)
+{
+	static constexpr std::size_t LANES = STRIPE_LEN / sizeof(__m256i);
+
+	__m256i vacc[LANES];
+	std::memcpy(vacc, acc, STRIPE_LEN);
+	for (std::size_t n = 0; n < stripes; n++)
+	{
+		auto *stripe = reinterpret_cast<const __m256i *>(input + n * STRIPE_LEN);
+		auto *key = reinterpret_cast<const __m256i *>(secret + n * SECRET_CONSUME_RATE);
+		for (std::size_t i = 0; i < LANES; i++)
+		{
+			auto data = _mm256_loadu_si256(stripe + i);
+			auto dataKey = _mm256_xor_si256(data, _mm256_loadu_si256(key + i));
+			auto product = _mm256_mul_epu32(dataKey, _mm256_srli_epi64(dataKey, 32));
+			auto dataSwap = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+			vacc[i] = _mm256_add_epi64(vacc[i], _mm256_add_epi64(product, dataSwap));
+		}
+	}
+	std::memcpy(acc, vacc, STRIPE_LEN);
+}
+
+__attribute__((target("avx2"))) void scramble_avx2(std::uint64_t *acc,
+	const std::byte *secret)
+{
+	static constexpr std::size_t LANES = STRIPE_LEN / sizeof(__m256i);
+
+	auto prime = _mm256_set1_epi32(static_cast<int>(PRIME32_1));
+	auto *key = reinterpret_cast<const __m256i *>(secret);
+	for (std::size_t i = 0; i < LANES; i++)
+	{
+		auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc) + i);
+		value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+		auto dataKey = _mm256_xor_si256(value, _mm256_loadu_si256(key + i));
+		auto productLo = _mm256_mul_epu32(dataKey, prime);
+		auto productHi = _mm256_mul_epu32(_mm256_srli_epi64(dataKey, 32), prime);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(acc) + i,
+			_mm256_add_epi64(productLo, _mm256_slli_epi64(productHi, 32)));
+	}
+}
+
+__attribute__((target("avx512f"))) void accumulate_avx512(std::uint64_t *acc,
+	const std::byte *input,
+	const std::byte *secret,
+	std::size_t stripes)
+{
+	auto vacc = _mm512_loadu_si512(acc);
+	for (std::size_t n = 0; n < stripes; n++)
+	{
+		auto data = _mm512_loadu_si512(input + n * STRIPE_LEN);
+		auto dataKey =
+			_mm512_xor_si512(data, _mm512_loadu_si512(secret + n * SECRET_CONSUME_RATE));
+		auto product = _mm512_mul_epu32(dataKey, _mm512_srli_epi64(dataKey, 32));
+		auto dataSwap = _mm512_shuffle_epi32(data, _MM_PERM_BADC);
+		vacc = _mm512_add_epi64(vacc, _mm512_add_epi64(product, dataSwap));
+	}
+	_mm512_storeu_si512(acc, vacc);
+}
+
+__attribute__((target("avx512f"))) void scramble_avx512(std::uint64_t *acc,
+	const std::byte *secret)
+{
+	auto prime = _mm512_set1_epi32(static_cast<int>(PRIME32_1));
+	auto value = _mm512_loadu_si512(acc);
+	value = _mm512_xor_si512(value, _mm512_srli_epi64(value, 47));
+	auto dataKey = _mm512_xor_si512(value, _mm512_loadu_si512(secret));
+	auto productLo = _mm512_mul_epu32(dataKey, prime);
+	auto productHi = _mm512_mul_epu32(_mm512_srli_epi64(dataKey, 32), prime);
+	_mm512_storeu_si512(acc,
+		_mm512_add_epi64(productLo, _mm512_slli_epi64(productHi, 32)));
+}
+#endif
+
+Digest hash_long(const std::byte *input, std::size_t len, Kernel kernel)
+{
+	AccumulateFn accumulate = accumulate_scalar;
+	ScrambleFn scramble = scramble_scalar;
+#if defined(__x86_64__)
+	switch (kernel)
+	{
+	case Kernel::Scalar:
+		break;
+	case Kernel::Sse2:
+		accumulate = accumulate_sse2;
+		scramble = scramble_sse2;
+		break;
+	case Kernel::Avx2:
+		accumulate = accumulate_avx2;
+		scramble = scramble_avx2;
+		break;
+	case Kernel::Avx512:
+		accumulate = accumulate_avx512;
+		scramble = scramble_avx512;
+		break;
+	}
+#else
+	(void)kernel;
+#endif
+
+	alignas(64) std::array<std::uint64_t, ACC_NB> acc = {
+		PRIME32_3,
+		PRIME64_1,
+		PRIME64_2,
+		PRIME64_3,
+		PRIME64_4,
+		PRIME32_2,
+		PRIME64_5,
+		PRIME32_1,
+	};
+
+	std::size_t blocks = (len - 1) / BLOCK_LEN;
+	for (std::size_t n = 0; n < blocks; n++)
+	{
+		accumulate(acc.data(), input + n * BLOCK_LEN, SECRET, STRIPES_PER_BLOCK);
+		scramble(acc.data(), SECRET + SECRET_SIZE - STRIPE_LEN);
+	}
+
+	// The last stripe always ends at the end of the input, overlapping the stripe
+	// before it unless the length is a multiple of the stripe length
+	std::size_t stripes = ((len - 1) - BLOCK_LEN * blocks) / STRIPE_LEN;
+	accumulate(acc.data(), input + blocks * BLOCK_LEN, SECRET, stripes);
+	accumulate(acc.data(),
+		input + len - STRIPE_LEN,
+		SECRET + SECRET_SIZE - STRIPE_LEN - SECRET_LASTACC_START,
+		1);
+
+	std::uint64_t result = len * PRIME64_1;
+	for (std::size_t i = 0; i < ACC_NB / 2; i++)
+	{
+		auto *key = SECRET + SECRET_MERGEACCS_START + 16 * i;
+		result +=
+			mul128_fold64(acc[2 * i] ^ read64(key), acc[2 * i + 1] ^ read64(key + 8));
+	}
+
+	return avalanche(result);
+}
+
+std::vector<Kernel> detect_kernels()
+{
+	std::vector<Kernel> kernels {Kernel::Scalar};
+#if defined(__x86_64__)
+	kernels.push_back(Kernel::Sse2);
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		kernels.push_back(Kernel::Avx2);
+	}
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		kernels.push_back(Kernel::Avx512);
+	}
+#endif
+	return kernels;
+}
+} // namespace
+
+std::span<const Kernel> supported_kernels()
+{
+	static const std::vector<Kernel> kernels = detect_kernels();
+	return kernels;
+}
+
+std::string_view kernel_name(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Scalar:
+		return "scalar";
+	case Kernel::Sse2:
+		return "sse2";
+	case Kernel::Avx2:
+		return "avx2";
+	case Kernel::Avx512:
+		return "avx512";
+	}
+
+	std::unreachable();
+}
+
+Digest hash_bytes(std::span<const std::byte> bytes, Kernel kernel)
+{
+	auto *input = bytes.data();
+	auto len = bytes.size();
+	if (len <= 16)
+	{
+		return hash_0to16(input, len);
+	}
+	else if (len <= 128)
+	{
+		return hash_17to128(input, len);
+	}
+	else if (len <= MIDSIZE_MAX)
+	{
+		return hash_129to240(input, len);
+	}
+
+	return hash_long(input, len, kernel);
+}
+
+Digest hash_bytes(std::span<const std::byte> bytes)
+{
+	static const Kernel fastest = supported_kernels().back();
+	return hash_bytes(bytes, fastest);
+}
+
+std::optional<Digest> hash_file(const std::filesystem::path& file)
+{
+	auto mapped = io::MappedFile::open(file);
+	if (!mapped)
+	{
+		return {};
+	}
+
+	return hash_bytes(mapped->bytes());
+}
+
+std::vector<std::optional<Digest>> hash_files(
+	std::span<const std::filesystem::path> files,
+	std::size_t jobs)
+{
+	std::vector<std::optional<Digest>> digests(files.size());
+
+	jobs::Scheduler scheduler {jobs};
+	for (std::size_t i = 0; i < files.size(); i++)
+	{
+		scheduler.add([&files, &digests, i] {
+			digests[i] = hash_file(files[i]);
+			return true;
+		});
+	}
+	scheduler.run();
+
+	return digests;
+}
+
+std::string to_hex(Digest digest)
+{
+	return std::format("{:016x}", digest);
+}
+
+std::optional<Digest> from_hex(std::string_view hex)
+{
+	Digest digest = 0;
+	auto [end, errc] = std::from_chars(hex.data(), hex.data() + hex.size(), digest, 16);
+	if (errc != std::errc {} || end != hex.data() + hex.size())
+	{
+		return {};
+	}
+
+	return digest;
+}
+} // namespace hash
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hash
+{
+using Digest = std::uint64_t;
+
+/**
+ * Incremental 64-bit FNV-1a hasher, for keys built from a few short strings. Not
+ * cryptographic; only used to detect changes between builds. Use `hash_bytes` for
+ * file contents, it is an order of magnitude faster on large inputs.
+ */
+class Hasher
+{
+private:
+	inline static constexpr const Digest OFFSET_BASIS = 0xcbf29ce484222325;
+	inline static constexpr const Digest PRIME = 0x100000001b3;
+	Digest state = OFFSET_BASIS;
+public:
+	Hasher() = default;
+
+	void update(std::span<const std::byte> bytes);
+
+	void update(std::string_view str)
+	{
+		update(std::as_bytes(std::span {str.data(), str.size()}));
+	}
+
+	void update(Digest digest)
+	{
+		update(std::as_bytes(std::span {&digest, 1}));
+	}
+
+	Digest finish() const
+	{
+		return state;
+	}
+};
+
+/**
+ * The implementations of `hash_bytes`, slowest first. They all produce the same
+ * digests.
+ */
+enum class Kernel
+{
+	Scalar,
+	Sse2,
+	Avx2,
+	Avx512,
+};
+
+/**
+ * The kernels the CPU supports, slowest first.
+ */
+std::span<const Kernel> supported_kernels();
+std::string_view kernel_name(Kernel kernel);
+
+/**
+ * Hashes `bytes` with XXH3-64, using the fastest kernel the CPU supports.
+ */
+Digest hash_bytes(std::span<const std::byte> bytes);
+Digest hash_bytes(std::span<const std::byte> bytes, Kernel kernel);
+
+/**
+ * Hashes the contents of `file`, or returns an empty optional if it couldn't be read.
+ */
+std::optional<Digest> hash_file(const std::filesystem::path& file);
+
+/**
+ * Hashes `files` on `jobs` threads. Each digest is empty if its file couldn't be read.
+ */
+std::vector<std::optional<Digest>> hash_files(
+	std::span<const std::filesystem::path> files,
+	std::size_t jobs);
+
+std::string to_hex(Digest digest);
+std::optional<Digest> from_hex(std::string_view hex);
+} // namespace hash
@@ -2,6 +2,10 @@
 
 #include "Support/Io.h"
 
+#include <atomic>
+#include <fcntl.h>
+#include <sys/file.h>
+
 namespace io
 {
 bool write_file(const std::filesystem::path file, std::string_view content)
@@ -12,10 +16,133 @@ bool write_file(const std::filesystem::path file, std::string_view content)
 		return false;
 	}
 
+	// A full disk only shows once the contents are flushed
 	stream << content;
+	stream.close();
+	return !stream.fail();
+}
+
+bool write_file_atomic(const std::filesystem::path& file, std::string_view content)
+{
+	auto tempFile = temp_path(file);
+
+	std::error_code errc;
+	if (!write_file(tempFile, content))
+	{
+		std::filesystem::remove(tempFile, errc);
+		return false;
+	}
+
+	std::filesystem::rename(tempFile, file, errc);
+	if (errc)
+	{
+		std::filesystem::remove(tempFile, errc);
+		return false;
+	}
+
 	return true;
 }
 
+std::filesystem::path temp_path(const std::filesystem::path& file)
+{
+	static std::atomic<std::uint64_t> counter = 0;
+	auto temp = file;
+	temp += std::format(".{}-{}.tmp", getpid(), counter++);
+	return temp;
+}
+
+std::optional<FileStamp> stamp_file(const std::filesystem::path& file)
+{
+	struct stat st {};
+	if (stat(file.c_str(), &st) == -1)
+	{
+		return {};
+	}
+
+	static constexpr std::int64_t NANOS_PER_SECOND = 1'000'000'000;
+	return FileStamp {
+		.device = static_cast<std::uint64_t>(st.st_dev),
+		.inode = static_cast<std::uint64_t>(st.st_ino),
+		.mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * NANOS_PER_SECOND +
+				 st.st_mtim.tv_nsec,
+		.size = static_cast<std::uint64_t>(st.st_size),
+	};
+}
+
+std::optional<std::string> read_file(const std::filesystem::path& file)
+{
+	std::ifstream stream {file, std::ios::binary};
+	if (!stream)
+	{
+		return {};
+	}
+
+	return std::string {std::istreambuf_iterator<char> {stream}, {}};
+}
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& file)
+{
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return {};
+	}
+
+	struct stat st {};
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return {};
+	}
+
+	// Empty files can't be mapped, but are still valid
+	auto size = static_cast<std::size_t>(st.st_size);
+	if (size == 0)
+	{
+		close(fd);
+		return MappedFile {};
+	}
+
+	void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return {};
+	}
+
+	return MappedFile {static_cast<const std::byte *>(data), size};
+}
+
+MappedFile::~MappedFile()
+{
+	if (data_ != nullptr)
+	{
+		munmap(const_cast<std::byte *>(data_), size_);
+	}
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: data_ {std::exchange(other.data_, nullptr)},
+	  size_ {std::exchange(other.size_, 0)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (data_ != nullptr)
+		{
+			munmap(const_cast<std::byte *>(data_), size_);
+		}
+
+		data_ = std::exchange(other.data_, nullptr);
+		size_ = std::exchange(other.size_, 0);
+	}
+
+	return *this;
+}
+
 AnonymousFile AnonymousFile::create(std::error_code& errc)
 {
 	static constexpr int NO_FLAGS = 0;
@@ -56,6 +183,82 @@ std::filesystem::path AnonymousFile::path() const
 	return std::format("/proc/self/fd/{}", fd);
 }
 
+FileLock FileLock::open(const std::filesystem::path& file, std::error_code& errc)
+{
+	// Children inheriting the descriptor would keep the lock held as long as they run
+	static constexpr mode_t MODE = 0644;
+	int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, MODE);
+	if (fd == -1)
+	{
+		errc = std::error_code(errno, std::system_category());
+		return FileLock {};
+	}
+
+	return FileLock {fd};
+}
+
+FileLock::~FileLock()
+{
+	if (fd != NO_FD)
+	{
+		close(fd);
+	}
+}
+
+FileLock::FileLock(FileLock&& other) noexcept : fd {std::exchange(other.fd, NO_FD)}
+{
+}
+
+FileLock& FileLock::operator=(FileLock&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (fd != NO_FD)
+		{
+			close(fd);
+		}
+
+		fd = std::exchange(other.fd, NO_FD);
+	}
+
+	return *this;
+}
+
+bool FileLock::try_lock()
+{
+	int result = 0;
+	do
+	{
+		result = flock(fd, LOCK_EX | LOCK_NB);
+	} while (result == -1 && errno == EINTR);
+
+	return result == 0;
+}
+
+static void lock_fd(int fd, int operation, std::error_code& errc)
+{
+	int result = 0;
+	do
+	{
+		result = flock(fd, operation);
+	} while (result == -1 && errno == EINTR);
+
+	if (result == -1)
+	{
+		errc = std::error_code(errno, std::system_category());
+	}
+}
+
+void FileLock::lock(std::error_code& errc)
+{
+	lock_fd(fd, LOCK_EX, errc);
+}
+
+void FileLock::lock_shared(std::error_code& errc)
+{
+	lock_fd(fd, LOCK_SH, errc);
+}
+
 // Pipe Pipe::create()
 // {
 // 	// TODO: pipe()
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <variant>
 
@@ -8,6 +12,77 @@ namespace io
 {
 bool write_file(const std::filesystem::path file, std::string_view content);
 
+/**
+ * Writes `content` to a temporary file next to `file` and renames it over `file`, so
+ * concurrent readers see either the old or the new contents, never a partial write.
+ */
+bool write_file_atomic(const std::filesystem::path& file, std::string_view content);
+
+/**
+ * A path next to `file` to write it to before renaming it into place. Unique to the
+ * call, so concurrent writers, in this process or another, never share one.
+ */
+std::filesystem::path temp_path(const std::filesystem::path& file);
+
+/**
+ * Reads the whole contents of `file`, or returns an empty optional if it couldn't be
+ * opened.
+ */
+std::optional<std::string> read_file(const std::filesystem::path& file);
+
+/**
+ * The identity, modification time and size of a file, used to cheaply tell whether it
+ * changed. Editors that save by renaming a new file over the old one change the inode
+ * even if the mtime and size happen to match.
+ */
+struct FileStamp
+{
+	std::uint64_t device;
+	std::uint64_t inode;
+	// Nanoseconds since the epoch
+	std::int64_t mtime;
+	std::uint64_t size;
+
+	bool operator==(const FileStamp&) const = default;
+};
+
+/**
+ * Stats `file`, following symlinks, or returns an empty optional if it doesn't exist.
+ */
+std::optional<FileStamp> stamp_file(const std::filesystem::path& file);
+
+/**
+ * A read-only, private memory mapping of a whole file.
+ */
+class MappedFile
+{
+private:
+	const std::byte *data_ = nullptr;
+	std::size_t size_ = 0;
+
+	MappedFile(const std::byte *data, std::size_t size) : data_ {data}, size_ {size}
+	{
+	}
+public:
+	MappedFile() = default;
+
+	/**
+	 * Maps `file`, or returns an empty optional if it couldn't be opened or mapped.
+	 */
+	static std::optional<MappedFile> open(const std::filesystem::path& file);
+
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&&) noexcept;
+	MappedFile& operator=(MappedFile&&) noexcept;
+
+	std::span<const std::byte> bytes() const
+	{
+		return {data_, size_};
+	}
+};
+
 /**
  * A handle to an anonymous file, that is, a memory-mapped file without a name in the
  * filesystem, making it accessible only through its file descriptor (which is owned
@@ -52,6 +127,52 @@ public:
 	std::filesystem::path path() const;
 };
 
+/**
+ * An advisory lock on a file, released when the FileLock is destroyed or the process
+ * exits, so a crashed process never leaves it held. Each `open` takes its own lock, so
+ * two FileLocks on the same file exclude each other even within one process, and a
+ * thread taking a second lock on a file its process already locked can deadlock.
+ */
+class FileLock
+{
+private:
+	inline static constexpr const int NO_FD = -1;
+	int fd = NO_FD;
+
+	FileLock(int fd) : fd {fd}
+	{
+	}
+public:
+	FileLock() = default;
+
+	/**
+	 * Opens `file` for locking, creating it if it doesn't exist, without locking it.
+	 */
+	static FileLock open(const std::filesystem::path& file, std::error_code& errc);
+
+	~FileLock();
+	FileLock(const FileLock&) = delete;
+	FileLock& operator=(const FileLock&) = delete;
+	FileLock(FileLock&&) noexcept;
+	FileLock& operator=(FileLock&&) noexcept;
+
+	/**
+	 * Locks the file unless another process holds it, returning whether it did.
+	 */
+	bool try_lock();
+
+	/**
+	 * Waits until the file can be locked, then locks it.
+	 */
+	void lock(std::error_code& errc);
+
+	/**
+	 * Waits until no process holds the file exclusively, then locks it shared with
+	 * other shared holders. Turns an exclusive lock held already into a shared one.
+	 */
+	void lock_shared(std::error_code& errc);
+};
+
 /**
  * A handle to an unnamed or named pipe.
  */
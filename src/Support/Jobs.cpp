@@ -0,0 +1,127 @@
+#include "../Pch.h"
+
+#include "Support/Jobs.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace jobs
+{
+Scheduler::Scheduler(std::size_t jobs) : jobs_ {std::max<std::size_t>(jobs, 1)}
+{
+}
+
+std::size_t Scheduler::default_jobs()
+{
+	return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+JobId Scheduler::add(Job job, std::span<const JobId> deps)
+{
+	JobId id = nodes.size();
+	Node& node = nodes.emplace_back(Node {.job = std::move(job)});
+
+	for (JobId dep : deps)
+	{
+		assert(dep < id && "jobs can only depend on jobs added before them");
+		nodes[dep].dependents.push_back(id);
+		node.pendingDeps++;
+	}
+
+	return id;
+}
+
+bool Scheduler::run()
+{
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<JobId> ready;
+	std::size_t running = 0;
+
+	for (JobId id = 0; id < nodes.size(); id++)
+	{
+		if (nodes[id].status == JobStatus::Pending && nodes[id].pendingDeps == 0)
+		{
+			ready.push_back(id);
+		}
+	}
+
+	auto worker = [&] {
+		std::unique_lock lock {mutex};
+		while (true)
+		{
+			cv.wait(lock, [&] { return !ready.empty() || running == 0; });
+			if (ready.empty())
+			{
+				// Nothing is running and nothing is left to start
+				cv.notify_all();
+				return;
+			}
+
+			JobId id = ready.front();
+			ready.pop_front();
+			running++;
+
+			lock.unlock();
+			bool succeeded = nodes[id].job();
+			lock.lock();
+
+			running--;
+			if (succeeded)
+			{
+				nodes[id].status = JobStatus::Succeeded;
+			}
+			else if (stopSource.stop_requested())
+			{
+				// Most likely killed by the stop, rather than failing on its own
+				nodes[id].status = JobStatus::Cancelled;
+			}
+			else
+			{
+				nodes[id].status = JobStatus::Failed;
+				if (failFast)
+				{
+					stopSource.request_stop();
+					ready.clear();
+				}
+			}
+
+			if (succeeded && !stopSource.stop_requested())
+			{
+				for (JobId dependent : nodes[id].dependents)
+				{
+					if (--nodes[dependent].pendingDeps == 0)
+					{
+						ready.push_front(dependent);
+					}
+				}
+			}
+
+			cv.notify_all();
+		}
+	};
+
+	std::vector<std::jthread> workers;
+	std::size_t workerCount = std::min(jobs_, std::max<std::size_t>(nodes.size(), 1));
+	for (std::size_t i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(worker);
+	}
+	workers.clear();
+
+	bool allSucceeded = true;
+	for (auto& node : nodes)
+	{
+		if (node.status == JobStatus::Pending)
+		{
+			node.status = stopSource.stop_requested() ? JobStatus::Cancelled
+													  : JobStatus::Skipped;
+		}
+
+		allSucceeded = allSucceeded && node.status == JobStatus::Succeeded;
+	}
+
+	return allSucceeded;
+}
+} // namespace jobs
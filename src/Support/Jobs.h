@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace jobs
+{
+using JobId = std::size_t;
+
+enum class JobStatus
+{
+	Pending,
+	Succeeded,
+	Failed,
+	// A dependency of the job failed, so it was never started
+	Skipped,
+	// Another job failed first, and the scheduler was failing fast. The job was either
+	// never started or stopped midway.
+	Cancelled,
+};
+
+/**
+ * A graph of jobs executed on a fixed-size pool of worker threads. A job is started
+ * once all of its dependencies have succeeded; jobs downstream of a failure are
+ * skipped. Jobs added with dependencies are preferred over fresh ones once they
+ * become ready, so that e.g. a link runs as soon as its objects are available instead
+ * of after every other compile.
+ *
+ * When failing fast, the first failure stops everything instead: no more jobs are
+ * started, and a stop is requested on `stop_token`, which running jobs can use to kill
+ * what they started.
+ */
+class Scheduler
+{
+public:
+	using Job = std::function<bool()>;
+
+	explicit Scheduler(std::size_t jobs = default_jobs());
+
+	JobId add(Job job, std::span<const JobId> deps = {});
+
+	JobId add(Job job, std::initializer_list<JobId> deps)
+	{
+		return add(std::move(job), std::span {deps.begin(), deps.size()});
+	}
+
+	/**
+	 * Runs every job added so far. Returns true if all of them succeeded.
+	 */
+	bool run();
+
+	void set_fail_fast(bool failFast)
+	{
+		this->failFast = failFast;
+	}
+
+	/**
+	 * Stopped once a job fails while failing fast.
+	 */
+	std::stop_token stop_token() const
+	{
+		return stopSource.get_token();
+	}
+
+	bool cancelled() const
+	{
+		return stopSource.stop_requested();
+	}
+
+	JobStatus status(JobId id) const
+	{
+		return nodes.at(id).status;
+	}
+
+	std::size_t jobs() const
+	{
+		return jobs_;
+	}
+
+	std::size_t size() const
+	{
+		return nodes.size();
+	}
+
+	static std::size_t default_jobs();
+private:
+	struct Node
+	{
+		Job job;
+		std::vector<JobId> dependents {};
+		std::size_t pendingDeps = 0;
+		JobStatus status = JobStatus::Pending;
+	};
+
+	std::vector<Node> nodes;
+	std::size_t jobs_;
+	bool failFast = false;
+	std::stop_source stopSource;
+};
+} // namespace jobs
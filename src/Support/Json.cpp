@@ -0,0 +1,521 @@
+#include "../Pch.h"
+
+#include "Support/Json.h"
+
+#include <charconv>
+#include <cmath>
+
+namespace json
+{
+const Value *Value::find(std::string_view key) const
+{
+	auto *object = as_object();
+	if (object == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (auto& [name, value] : *object)
+	{
+		if (name == key)
+		{
+			return &value;
+		}
+	}
+
+	return nullptr;
+}
+
+void Value::set(std::string_view key, Value value)
+{
+	auto *object = std::get_if<Object>(&storage);
+	if (object == nullptr)
+	{
+		return;
+	}
+
+	for (auto& [name, member] : *object)
+	{
+		if (name == key)
+		{
+			member = std::move(value);
+			return;
+		}
+	}
+
+	object->emplace_back(std::string {key}, std::move(value));
+}
+
+namespace
+{
+	class Parser
+	{
+	public:
+		Parser(std::string_view text) : text {text}
+		{
+		}
+
+		std::expected<Value, std::string> parse_document()
+		{
+			auto value = parse_value(0);
+			if (!value)
+			{
+				return value;
+			}
+
+			skip_whitespace();
+			if (pos != text.size())
+			{
+				return error("trailing characters after document");
+			}
+
+			return value;
+		}
+	private:
+		// Guards against stack overflows on maliciously nested documents
+		inline static constexpr const std::size_t MAX_DEPTH = 512;
+
+		std::string_view text;
+		std::size_t pos = 0;
+
+		std::unexpected<std::string> error(std::string_view message) const
+		{
+			return std::unexpected {
+				std::string {message} + " at offset " + std::to_string(pos)};
+		}
+
+		void skip_whitespace()
+		{
+			while (pos < text.size() &&
+				   (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' ||
+					   text[pos] == '\r'))
+			{
+				pos++;
+			}
+		}
+
+		bool consume(char c)
+		{
+			skip_whitespace();
+			if (pos < text.size() && text[pos] == c)
+			{
+				pos++;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool consume_literal(std::string_view literal)
+		{
+			if (text.substr(pos).starts_with(literal))
+			{
+				pos += literal.size();
+				return true;
+			}
+
+			return false;
+		}
+
+		std::expected<Value, std::string> parse_value(std::size_t depth)
+		{
+			if (depth > MAX_DEPTH)
+			{
+				return error("document is nested too deeply");
+			}
+
+			skip_whitespace();
+			if (pos >= text.size())
+			{
+				return error("unexpected end of document");
+			}
+
+			char c = text[pos];
+			if (c == '{')
+			{
+				return parse_object(depth);
+			}
+			else if (c == '[')
+			{
+				return parse_array(depth);
+			}
+			else if (c == '"')
+			{
+				auto str = parse_string();
+				if (!str)
+				{
+					return std::unexpected {std::move(str.error())};
+				}
+
+				return Value {std::move(*str)};
+			}
+			else if (consume_literal("true"))
+			{
+				return Value {true};
+			}
+			else if (consume_literal("false"))
+			{
+				return Value {false};
+			}
+			else if (consume_literal("null"))
+			{
+				return Value {};
+			}
+
+			return parse_number();
+		}
+
+		std::expected<Value, std::string> parse_number()
+		{
+			auto start = pos;
+			while (pos < text.size() &&
+				   std::string_view {"+-0123456789.eE"}.find(text[pos]) != std::string_view::npos)
+			{
+				pos++;
+			}
+
+			double number = 0;
+			auto [end, errc] = std::from_chars(text.data() + start, text.data() + pos, number);
+			if (start == pos || errc != std::errc {} || end != text.data() + pos)
+			{
+				pos = start;
+				return error("invalid value");
+			}
+
+			return Value {number};
+		}
+
+		static void append_utf8(std::string& out, std::uint32_t codepoint)
+		{
+			if (codepoint < 0x80)
+			{
+				out += static_cast<char>(codepoint);
+			}
+			else if (codepoint < 0x800)
+			{
+				out += static_cast<char>(0xC0 | (codepoint >> 6));
+				out += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+			else if (codepoint < 0x10000)
+			{
+				out += static_cast<char>(0xE0 | (codepoint >> 12));
+				out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+			else
+			{
+				out += static_cast<char>(0xF0 | (codepoint >> 18));
+				out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+				out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+		}
+
+		std::optional<std::uint32_t> parse_hex4()
+		{
+			if (pos + 4 > text.size())
+			{
+				return {};
+			}
+
+			std::uint32_t value = 0;
+			auto [end, errc] = std::from_chars(text.data() + pos, text.data() + pos + 4, value, 16);
+			if (errc != std::errc {} || end != text.data() + pos + 4)
+			{
+				return {};
+			}
+
+			pos += 4;
+			return value;
+		}
+
+		std::expected<std::string, std::string> parse_string()
+		{
+			// Skip the opening quote
+			pos++;
+
+			std::string out;
+			while (pos < text.size())
+			{
+				char c = text[pos++];
+				if (c == '"')
+				{
+					return out;
+				}
+				else if (c != '\\')
+				{
+					out += c;
+					continue;
+				}
+
+				if (pos >= text.size())
+				{
+					break;
+				}
+
+				char escape = text[pos++];
+				switch (escape)
+				{
+				case '"':
+				case '\\':
+				case '/':
+					out += escape;
+					break;
+				case 'b':
+					out += '\b';
+					break;
+				case 'f':
+					out += '\f';
+					break;
+				case 'n':
+					out += '\n';
+					break;
+				case 'r':
+					out += '\r';
+					break;
+				case 't':
+					out += '\t';
+					break;
+				case 'u':
+				{
+					auto codepoint = parse_hex4();
+					if (!codepoint)
+					{
+						return error("invalid unicode escape");
+					}
+
+					// Combine UTF-16 surrogate pairs
+					if (*codepoint >= 0xD800 && *codepoint < 0xDC00 &&
+						consume_literal("\\u"))
+					{
+						auto low = parse_hex4();
+						if (!low || *low < 0xDC00 || *low >= 0xE000)
+						{
+							return error("invalid unicode surrogate pair");
+						}
+
+						*codepoint = 0x10000 + ((*codepoint - 0xD800) << 10) + (*low - 0xDC00);
+					}
+
+					append_utf8(out, *codepoint);
+					break;
+				}
+				default:
+					return error("invalid escape sequence");
+				}
+			}
+
+			return error("unterminated string");
+		}
+
+		std::expected<Value, std::string> parse_array(std::size_t depth)
+		{
+			// Skip the opening bracket
+			pos++;
+
+			Array array;
+			if (consume(']'))
+			{
+				return Value {std::move(array)};
+			}
+
+			do
+			{
+				auto element = parse_value(depth + 1);
+				if (!element)
+				{
+					return element;
+				}
+
+				array.push_back(std::move(*element));
+			} while (consume(','));
+
+			if (!consume(']'))
+			{
+				return error("expected `,` or `]`");
+			}
+
+			return Value {std::move(array)};
+		}
+
+		std::expected<Value, std::string> parse_object(std::size_t depth)
+		{
+			// Skip the opening brace
+			pos++;
+
+			Object object;
+			if (consume('}'))
+			{
+				return Value {std::move(object)};
+			}
+
+			do
+			{
+				skip_whitespace();
+				if (pos >= text.size() || text[pos] != '"')
+				{
+					return error("expected a string key");
+				}
+
+				auto key = parse_string();
+				if (!key)
+				{
+					return std::unexpected {std::move(key.error())};
+				}
+
+				if (!consume(':'))
+				{
+					return error("expected `:`");
+				}
+
+				auto value = parse_value(depth + 1);
+				if (!value)
+				{
+					return value;
+				}
+
+				object.emplace_back(std::move(*key), std::move(*value));
+			} while (consume(','));
+
+			if (!consume('}'))
+			{
+				return error("expected `,` or `}`");
+			}
+
+			return Value {std::move(object)};
+		}
+	};
+
+	void write_string(std::string& out, std::string_view str)
+	{
+		static constexpr std::string_view HEX_DIGITS = "0123456789abcdef";
+
+		out += '"';
+		for (char c : str)
+		{
+			switch (c)
+			{
+			case '"':
+				out += "\\\"";
+				break;
+			case '\\':
+				out += "\\\\";
+				break;
+			case '\n':
+				out += "\\n";
+				break;
+			case '\r':
+				out += "\\r";
+				break;
+			case '\t':
+				out += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < ' ')
+				{
+					out += "\\u00";
+					out += HEX_DIGITS[static_cast<unsigned char>(c) >> 4];
+					out += HEX_DIGITS[static_cast<unsigned char>(c) & 0xF];
+				}
+				else
+				{
+					out += c;
+				}
+			}
+		}
+		out += '"';
+	}
+
+	void write_number(std::string& out, double number)
+	{
+		if (!std::isfinite(number))
+		{
+			// JSON has no representation for infinities or NaN
+			out += "null";
+			return;
+		}
+
+		std::array<char, 32> buffer {};
+		auto [end, errc] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), number);
+		out.append(buffer.data(), end);
+	}
+
+	void write_value(std::string& out, const Value& value, bool pretty, std::size_t indent)
+	{
+		auto newline = [&](std::size_t level) {
+			if (pretty)
+			{
+				out += '\n';
+				out.append(level * 2, ' ');
+			}
+		};
+
+		std::visit(
+			[&]<class T>(const T& inner) {
+				if constexpr (std::same_as<T, std::nullptr_t>)
+				{
+					out += "null";
+				}
+				else if constexpr (std::same_as<T, bool>)
+				{
+					out += inner ? "true" : "false";
+				}
+				else if constexpr (std::same_as<T, double>)
+				{
+					write_number(out, inner);
+				}
+				else if constexpr (std::same_as<T, std::string>)
+				{
+					write_string(out, inner);
+				}
+				else if constexpr (std::same_as<T, Array>)
+				{
+					out += '[';
+					for (std::size_t i = 0; i < inner.size(); i++)
+					{
+						out += i == 0 ? "" : ",";
+						newline(indent + 1);
+						write_value(out, inner[i], pretty, indent + 1);
+					}
+
+					if (!inner.empty())
+					{
+						newline(indent);
+					}
+					out += ']';
+				}
+				else if constexpr (std::same_as<T, Object>)
+				{
+					out += '{';
+					for (std::size_t i = 0; i < inner.size(); i++)
+					{
+						out += i == 0 ? "" : ",";
+						newline(indent + 1);
+						write_string(out, inner[i].first);
+						out += pretty ? ": " : ":";
+						write_value(out, inner[i].second, pretty, indent + 1);
+					}
+
+					if (!inner.empty())
+					{
+						newline(indent);
+					}
+					out += '}';
+				}
+			},
+			value.get());
+	}
+} // namespace
+
+std::expected<Value, std::string> parse(std::string_view text)
+{
+	return Parser {text}.parse_document();
+}
+
+std::string to_string(const Value& value, bool pretty)
+{
+	std::string out;
+	write_value(out, value, pretty, 0);
+	return out;
+}
+} // namespace json
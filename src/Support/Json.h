@@ -0,0 +1,126 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace json
+{
+class Value;
+
+using Array = std::vector<Value>;
+// Members are kept in insertion order, so written documents are stable
+using Object = std::vector<std::pair<std::string, Value>>;
+
+/**
+ * A JSON document. Numbers are always stored as doubles.
+ */
+class Value
+{
+public:
+	using Storage = std::variant<std::nullptr_t, bool, double, std::string, Array, Object>;
+
+	Value() : storage {nullptr}
+	{
+	}
+
+	Value(std::nullptr_t) : storage {nullptr}
+	{
+	}
+
+	Value(bool value) : storage {value}
+	{
+	}
+
+	Value(double value) : storage {value}
+	{
+	}
+
+	template<std::integral T>
+		requires(!std::same_as<T, bool>)
+	Value(T value) : storage {static_cast<double>(value)}
+	{
+	}
+
+	Value(std::string value) : storage {std::move(value)}
+	{
+	}
+
+	Value(std::string_view value) : storage {std::string {value}}
+	{
+	}
+
+	Value(const char *value) : storage {std::string {value}}
+	{
+	}
+
+	Value(Array value) : storage {std::move(value)}
+	{
+	}
+
+	Value(Object value) : storage {std::move(value)}
+	{
+	}
+
+	bool is_null() const
+	{
+		return std::holds_alternative<std::nullptr_t>(storage);
+	}
+
+	const bool *as_bool() const
+	{
+		return std::get_if<bool>(&storage);
+	}
+
+	const double *as_number() const
+	{
+		return std::get_if<double>(&storage);
+	}
+
+	const std::string *as_string() const
+	{
+		return std::get_if<std::string>(&storage);
+	}
+
+	const Array *as_array() const
+	{
+		return std::get_if<Array>(&storage);
+	}
+
+	const Object *as_object() const
+	{
+		return std::get_if<Object>(&storage);
+	}
+
+	/**
+	 * Looks up `key` if this is an object, returning null if it isn't or the key is
+	 * missing.
+	 */
+	const Value *find(std::string_view key) const;
+
+	/**
+	 * Sets `key` if this is an object, replacing an existing member with the same key.
+	 */
+	void set(std::string_view key, Value value);
+
+	const Storage& get() const
+	{
+		return storage;
+	}
+private:
+	Storage storage;
+};
+
+std::expected<Value, std::string> parse(std::string_view text);
+
+/**
+ * Serializes `value`. If `pretty` is true, nested values are put on separate,
+ * indented lines.
+ */
+std::string to_string(const Value& value, bool pretty = false);
+} // namespace json
@@ -2,6 +2,8 @@
 
 #include <expected>
 #include <system_error>
+#include <utility>
+
 namespace mem
 {
 template<class T> struct Shared
@@ -9,7 +11,7 @@ template<class T> struct Shared
 public:
 	Shared() : storage {nullptr} {};
 
-	Shared(const T& value)
+	Shared(const T& value) : storage {nullptr}
 	{
 		if (auto result = alloc(); !result.has_value())
 		{
@@ -21,14 +23,26 @@ public:
 
 	~Shared()
 	{
-		storage->~T();
-		dealloc();
+		reset();
 	}
 
 	Shared(const Shared&) = delete;
 	Shared& operator=(const Shared&) = delete;
-	Shared(Shared&&) = default;
-	Shared& operator=(Shared&&) = default;
+
+	Shared(Shared&& other) noexcept : storage {std::exchange(other.storage, nullptr)}
+	{
+	}
+
+	Shared& operator=(Shared&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			storage = std::exchange(other.storage, nullptr);
+		}
+
+		return *this;
+	}
 
 	bool empty() const
 	{
@@ -75,5 +89,14 @@ private:
 
 	std::expected<void, std::system_error> alloc();
 	void dealloc();
+
+	void reset()
+	{
+		if (!empty())
+		{
+			storage->~T();
+			dealloc();
+		}
+	}
 };
 }
\ No newline at end of file
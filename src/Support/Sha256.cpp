@@ -0,0 +1,200 @@
+#include "../Pch.h"
+
+#include "Support/Sha256.h"
+
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+#include "Support/Io.h"
+
+namespace sha256
+{
+static constexpr std::array<std::uint32_t, 64> ROUND_CONSTANTS {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+	0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+	0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+	0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+	0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+	0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+	0xc67178f2,
+};
+
+static constexpr std::array<std::uint32_t, 8> INITIAL_STATE {
+	0x6a09e667,
+	0xbb67ae85,
+	0x3c6ef372,
+	0xa54ff53a,
+	0x510e527f,
+	0x9b05688c,
+	0x1f83d9ab,
+	0x5be0cd19,
+};
+
+static std::uint32_t load_be32(const std::uint8_t *p)
+{
+	return (std::uint32_t {p[0]} << 24) | (std::uint32_t {p[1]} << 16) |
+		   (std::uint32_t {p[2]} << 8) | std::uint32_t {p[3]};
+}
+
+Hasher::Hasher() : state {INITIAL_STATE}
+{
+}
+
+void Hasher::compress(const std::uint8_t *chunk)
+{
+	std::array<std::uint32_t, 64> w;
+	for (std::size_t i = 0; i < 16; i++)
+	{
+		w[i] = load_be32(chunk + 4 * i);
+	}
+
+	for (std::size_t i = 16; i < 64; i++)
+	{
+		auto s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		auto s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	auto [a, b, c, d, e, f, g, h] = state;
+	for (std::size_t i = 0; i < 64; i++)
+	{
+		auto s1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
+		auto choose = (e & f) ^ (~e & g);
+		auto t1 = h + s1 + choose + ROUND_CONSTANTS[i] + w[i];
+		auto s0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
+		auto majority = (a & b) ^ (a & c) ^ (b & c);
+		auto t2 = s0 + majority;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void Hasher::update(std::span<const std::byte> bytes)
+{
+	auto *data = reinterpret_cast<const std::uint8_t *>(bytes.data());
+	auto size = bytes.size();
+	length += size;
+
+	// Top up a partial block first
+	if (blockSize > 0)
+	{
+		auto taken = std::min(size, block.size() - blockSize);
+		std::memcpy(block.data() + blockSize, data, taken);
+		blockSize += taken;
+		data += taken;
+		size -= taken;
+		if (blockSize < block.size())
+		{
+			return;
+		}
+
+		compress(block.data());
+		blockSize = 0;
+	}
+
+	for (; size >= block.size(); data += block.size(), size -= block.size())
+	{
+		compress(data);
+	}
+
+	std::memcpy(block.data(), data, size);
+	blockSize = size;
+}
+
+Digest Hasher::finish()
+{
+	// Pads with a single 1 bit, then zeroes up to the last 8 bytes of a block, which hold
+	// the message length in bits
+	std::uint64_t bits = length * 8;
+	std::array<std::uint8_t, 72> padding {0x80};
+	auto padded = (blockSize < 56 ? 56 : 120) - blockSize;
+	for (std::size_t i = 0; i < 8; i++)
+	{
+		padding[padded + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+	}
+
+	update(std::as_bytes(std::span {padding.data(), padded + 8}));
+
+	Digest digest;
+	for (std::size_t i = 0; i < state.size(); i++)
+	{
+		digest[4 * i] = static_cast<std::uint8_t>(state[i] >> 24);
+		digest[4 * i + 1] = static_cast<std::uint8_t>(state[i] >> 16);
+		digest[4 * i + 2] = static_cast<std::uint8_t>(state[i] >> 8);
+		digest[4 * i + 3] = static_cast<std::uint8_t>(state[i]);
+	}
+
+	return digest;
+}
+
+Digest hash_bytes(std::span<const std::byte> bytes)
+{
+	Hasher hasher;
+	hasher.update(bytes);
+	return hasher.finish();
+}
+
+std::optional<Digest> hash_file(const std::filesystem::path& file)
+{
+	auto mapped = io::MappedFile::open(file);
+	if (!mapped)
+	{
+		return {};
+	}
+
+	return hash_bytes(mapped->bytes());
+}
+
+std::string to_hex(const Digest& digest)
+{
+	std::string hex;
+	hex.reserve(2 * digest.size());
+	for (auto byte : digest)
+	{
+		hex += std::format("{:02x}", byte);
+	}
+
+	return hex;
+}
+
+std::optional<Digest> from_hex(std::string_view hex)
+{
+	Digest digest;
+	if (hex.size() != 2 * digest.size())
+	{
+		return {};
+	}
+
+	for (std::size_t i = 0; i < digest.size(); i++)
+	{
+		auto pair = hex.substr(2 * i, 2);
+		auto [end, errc] = std::from_chars(pair.data(), pair.data() + 2, digest[i], 16);
+		if (errc != std::errc {} || end != pair.data() + 2)
+		{
+			return {};
+		}
+	}
+
+	return digest;
+}
+} // namespace sha256
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace sha256
+{
+using Digest = std::array<std::uint8_t, 32>;
+
+/**
+ * Incremental SHA-256 hasher, as specified by FIPS 180-4. Unlike the digests of `hash`,
+ * its digests can't be forged, so it checks the integrity of downloaded packages.
+ * Much slower than XXH3, so never use it to detect changes between builds.
+ */
+class Hasher
+{
+private:
+	std::array<std::uint32_t, 8> state;
+	std::array<std::uint8_t, 64> block {};
+	std::size_t blockSize = 0;
+	std::uint64_t length = 0;
+
+	void compress(const std::uint8_t *chunk);
+public:
+	Hasher();
+
+	void update(std::span<const std::byte> bytes);
+
+	void update(std::string_view str)
+	{
+		update(std::as_bytes(std::span {str.data(), str.size()}));
+	}
+
+	Digest finish();
+};
+
+Digest hash_bytes(std::span<const std::byte> bytes);
+
+/**
+ * Hashes the contents of `file`, or returns an empty optional if it couldn't be read.
+ */
+std::optional<Digest> hash_file(const std::filesystem::path& file);
+
+std::string to_hex(const Digest& digest);
+std::optional<Digest> from_hex(std::string_view hex);
+} // namespace sha256
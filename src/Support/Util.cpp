@@ -1,8 +1,116 @@
 #include "../Pch.h"
 
 #include "Support/Util.h"
+
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <csignal>
+#include <fcntl.h>
+#include <mutex>
+#include <sched.h>
+#include <sys/wait.h>
+#include <thread>
+
+#include "Support/Io.h"
 #include "Support/Mem.h"
 
+namespace
+{
+/**
+ * The process groups of children started with `set_own_process_group`, which signals
+ * meant for Freight are forwarded to. Slots are read from a signal handler, so they
+ * are lock-free atomics instead of a container behind a mutex. Children started while
+ * every slot is taken stay in Freight's own process group.
+ */
+constexpr std::size_t MAX_PROCESS_GROUPS = 1024;
+std::array<std::atomic<pid_t>, MAX_PROCESS_GROUPS> processGroups {};
+std::once_flag installForwardingOnce;
+
+// Marks a slot taken by a child that is still being started
+constexpr pid_t RESERVED = -1;
+
+extern "C" void forward_signal(int signal)
+{
+	for (auto& group : processGroups)
+	{
+		pid_t pgid = group.load();
+		if (pgid > 0)
+		{
+			killpg(pgid, signal);
+		}
+	}
+
+	// Dies of the signal like Freight would have without the handler
+	std::signal(signal, SIG_DFL);
+	std::raise(signal);
+}
+
+void install_signal_forwarding()
+{
+	for (int signal : {SIGINT, SIGTERM, SIGHUP})
+	{
+		// Signals the parent chose to ignore stay ignored
+		struct sigaction previous {};
+		if (sigaction(signal, nullptr, &previous) == 0 && previous.sa_handler == SIG_DFL)
+		{
+			struct sigaction action {};
+			action.sa_handler = forward_signal;
+			sigemptyset(&action.sa_mask);
+			sigaction(signal, &action, nullptr);
+		}
+	}
+}
+
+std::atomic<pid_t> *reserve_process_group()
+{
+	std::call_once(installForwardingOnce, install_signal_forwarding);
+	for (auto& group : processGroups)
+	{
+		pid_t expected = 0;
+		if (group.compare_exchange_strong(expected, RESERVED))
+		{
+			return &group;
+		}
+	}
+
+	return nullptr;
+}
+
+void release_process_group(pid_t pgid)
+{
+	for (auto& group : processGroups)
+	{
+		pid_t expected = pgid;
+		if (group.compare_exchange_strong(expected, 0))
+		{
+			return;
+		}
+	}
+}
+} // namespace
+
+std::string format_bytes(std::uint64_t bytes)
+{
+	static constexpr std::array UNITS = {"KiB", "MiB", "GiB", "TiB"};
+	static constexpr double KIBI = 1024;
+
+	if (bytes < KIBI)
+	{
+		return std::format("{} B", bytes);
+	}
+
+	double value = static_cast<double>(bytes) / KIBI;
+	std::size_t unit = 0;
+	while (value >= KIBI && unit + 1 < UNITS.size())
+	{
+		value /= KIBI;
+		unit++;
+	}
+
+	return std::format("{:.1f} {}", value, UNITS[unit]);
+}
+
 ProcessBuilder::ProcessBuilder(const std::filesystem::path& path)
 	: path_ {path},
 	  nameInferred {true}
@@ -41,24 +149,25 @@ namespace mem {
 
 template<class T> std::expected<void, std::system_error> Shared<T>::alloc()
 {
-	assert(storage != nullptr &&
+	assert(storage == nullptr &&
 		   "Tried to reallocate non-null storage. Call `Shared::dealloc` first");
 	static constexpr int PROT_FLAGS = PROT_READ | PROT_WRITE;
 	static constexpr int MAP_FLAGS = MAP_SHARED | MAP_ANONYMOUS;
-	storage = static_cast<T *>(mmap(nullptr, sizeof(T), PROT_FLAGS, MAP_FLAGS, -1, 0));
-	if (storage == nullptr)
+	void *mapping = mmap(nullptr, sizeof(T), PROT_FLAGS, MAP_FLAGS, -1, 0);
+	if (mapping == MAP_FAILED)
 	{
 		return std::unexpected(std::system_error {errno, std::system_category()});
 	}
 	else
 	{
+		storage = static_cast<T *>(mapping);
 		return {};
 	}
 }
 
 template<class T> void Shared<T>::dealloc()
 {
-	assert(storage == nullptr && "Tried to deallocate null. Call `Shared::alloc` first");
+	assert(storage != nullptr && "Tried to deallocate null. Call `Shared::alloc` first");
 	int result = munmap(storage, sizeof(T));
 	assert(result != -1 && "munmap should never fail");
 	storage = nullptr;
@@ -66,7 +175,7 @@ template<class T> void Shared<T>::dealloc()
 
 } // namespace mem
 
-int ProcessBuilder::start() const
+Child ProcessBuilder::spawn() const
 {
 	using namespace std::filesystem;
 
@@ -79,39 +188,333 @@ int ProcessBuilder::start() const
 	}
 	catch (std::system_error& e)
 	{
-		bail("Failed to start child process\n\n%s",
-			cause("%s", strerror(e.code().value())));
+		bail("Failed to start child process\n\n{}",
+			cause("{}", strerror(e.code().value())));
+	}
+
+	// Only async-signal-safe calls are allowed between `fork` and `exec` when other
+	// threads may be running, so the argument vector is built up front
+	std::vector<char *> execArgs;
+	for (auto& arg : args)
+	{
+		execArgs.push_back(const_cast<char *>(arg.c_str())); // NOLINT
+	}
+	execArgs.push_back(nullptr);
+
+	const char *outputPath = outputFile ? outputFile->c_str() : nullptr;
+	const char *workingDirPath = workingDir ? workingDir->c_str() : nullptr;
+
+	std::vector<std::string> envStrings;
+	for (char **var = environ; *var != nullptr; var++)
+	{
+		std::string_view entry {*var};
+		auto name = entry.substr(0, entry.find('='));
+		bool overridden = std::ranges::any_of(
+			envOverrides, [&](auto& var) { return var.first == name; });
+		bool allowed = !envAllowlist || std::ranges::contains(*envAllowlist, name);
+		if (!overridden && allowed)
+		{
+			envStrings.emplace_back(entry);
+		}
+	}
+
+	for (auto& [name, value] : envOverrides)
+	{
+		envStrings.push_back(name + "=" + value);
+	}
+
+	std::vector<char *> envp;
+	for (auto& var : envStrings)
+	{
+		envp.push_back(var.data());
+	}
+	envp.push_back(nullptr);
+
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (cpu)
+	{
+		CPU_SET(*cpu, &cpuSet);
 	}
 
+	auto *group = ownGroup ? reserve_process_group() : nullptr;
+
 	pid_t pid = fork();
 
 	if (pid == -1)
 	{
-		errorNumber = errno;
+		if (group != nullptr)
+		{
+			group->store(0);
+		}
+
+		bail("Failed to start child process\n\n{}", cause("{}", strerror(errno)));
 	}
 
 	if (pid == 0)
 	{
-		std::vector<char *> execArgs;
-		for (auto& arg : args)
+		// Both the child and the parent set the group, so it's in place before either
+		// goes on, whichever runs first
+		if (group != nullptr && setpgid(0, 0) == -1)
+		{
+			errorNumber.get() = errno;
+			_exit(127);
+		}
+
+		if (outputPath != nullptr)
 		{
-			execArgs.push_back(const_cast<char *>(arg.c_str())); // NOLINT
+			static constexpr mode_t OUTPUT_MODE = 0644;
+			int fd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, OUTPUT_MODE);
+			if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1 || dup2(fd, STDERR_FILENO) == -1)
+			{
+				errorNumber.get() = errno;
+				_exit(127);
+			}
+
+			close(fd);
 		}
-		execArgs.push_back(nullptr);
 
-		execv(path_.c_str(), execArgs.data());
-		errorNumber = errno;
-		abort();
+		if (cpu && sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == -1)
+		{
+			errorNumber.get() = errno;
+			_exit(127);
+		}
+
+		if (workingDirPath != nullptr && chdir(workingDirPath) == -1)
+		{
+			errorNumber.get() = errno;
+			_exit(127);
+		}
+
+		execve(path_.c_str(), execArgs.data(), envp.data());
+		errorNumber.get() = errno;
+		_exit(127);
+	}
+
+	if (group != nullptr)
+	{
+		setpgid(pid, pid);
+		group->store(pid);
+	}
+
+	return Child {pid, std::move(errorNumber), group != nullptr};
+}
+
+void ProcessBuilder::set_output_file(const std::filesystem::path& file)
+{
+	outputFile = file;
+}
+
+void ProcessBuilder::set_env(const std::string& name, const std::string& value)
+{
+	std::erase_if(envOverrides, [&](auto& var) { return var.first == name; });
+	envOverrides.emplace_back(name, value);
+}
+
+void ProcessBuilder::set_env_allowlist(std::vector<std::string> names)
+{
+	envAllowlist = std::move(names);
+}
+
+void ProcessBuilder::set_cpu_affinity(int cpu)
+{
+	this->cpu = cpu;
+}
+
+void ProcessBuilder::set_working_dir(const std::filesystem::path& dir)
+{
+	workingDir = dir;
+}
+
+void ProcessBuilder::set_own_process_group()
+{
+	ownGroup = true;
+}
+
+std::size_t ProcessBuilder::command_line_size() const
+{
+	std::size_t size = 0;
+	for (auto& arg : args)
+	{
+		// Each argument also costs a terminator and a pointer
+		size += arg.size() + 1 + sizeof(char *);
+	}
+
+	return size;
+}
+
+std::optional<ProcessBuilder> ProcessBuilder::with_response_file(
+	const std::filesystem::path& file) const
+{
+	// GNU-style quoting, which every LLVM tool understands on Unix: whitespace
+	// separates arguments and a backslash escapes the next character
+	std::string content;
+	for (auto& arg : args | std::views::drop(1))
+	{
+		for (char c : arg)
+		{
+			if (std::isspace(static_cast<unsigned char>(c)) || c == '\\' || c == '"' ||
+				c == '\'')
+			{
+				content += '\\';
+			}
+
+			content += c;
+		}
+
+		content += '\n';
+	}
+
+	std::error_code errc;
+	std::filesystem::create_directories(file.parent_path(), errc);
+	if (!io::write_file(file, content))
+	{
+		return {};
+	}
+
+	ProcessBuilder pb {*this};
+	pb.args.resize(1);
+	pb.args.push_back("@" + file.string());
+	return pb;
+}
+
+Child::Child(pid_t pid, mem::Shared<int>&& errorNumber, bool ownGroup)
+	: pid_ {pid},
+	  ownGroup {ownGroup},
+	  errorNumber {std::move(errorNumber)}
+{
+}
+
+Child::~Child()
+{
+	if (pid_ != NO_PID && !exitCode)
+	{
+		reap(true);
+	}
+}
+
+Child::Child(Child&& other) noexcept
+	: pid_ {std::exchange(other.pid_, NO_PID)},
+	  ownGroup {other.ownGroup},
+	  exitCode {other.exitCode},
+	  errorNumber {std::move(other.errorNumber)}
+{
+}
+
+Child& Child::operator=(Child&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (pid_ != NO_PID && !exitCode)
+		{
+			reap(true);
+		}
+
+		pid_ = std::exchange(other.pid_, NO_PID);
+		ownGroup = other.ownGroup;
+		exitCode = other.exitCode;
+		errorNumber = std::move(other.errorNumber);
+	}
+
+	return *this;
+}
+
+std::optional<int> Child::reap(bool block)
+{
+	assert(pid_ != NO_PID);
+
+	if (exitCode)
+	{
+		return exitCode;
 	}
 
 	int status = 0;
-	waitpid(pid, &status, 0);
+	pid_t result = 0;
+	do
+	{
+		result = waitpid(pid_, &status, block ? 0 : WNOHANG);
+	} while (result == -1 && errno == EINTR);
+
+	if (result == 0)
+	{
+		return {};
+	}
+
+	if (ownGroup)
+	{
+		release_process_group(pid_);
+	}
 
 	if (errorNumber != 0)
 	{
 		int err = errorNumber;
-		bail("Failed to start child process\n\n%s", cause("%s", strerror(err)));
+		bail("Failed to start child process\n\n{}", cause("{}", strerror(err)));
+	}
+
+	static constexpr int SIGNAL_EXIT_BASE = 128;
+	exitCode = WIFSIGNALED(status) ? SIGNAL_EXIT_BASE + WTERMSIG(status)
+								   : WEXITSTATUS(status);
+	return exitCode;
+}
+
+int Child::wait()
+{
+	return *reap(true);
+}
+
+int Child::wait(std::stop_token stop)
+{
+	if (!stop.stop_possible())
+	{
+		return wait();
+	}
+
+	{
+		std::stop_callback onStop {stop, [this] { kill(); }};
+
+		// Waits without reaping, so the pid can't be reused by another process while
+		// the callback may still kill it
+		siginfo_t info {};
+		while (waitid(P_PID, static_cast<id_t>(pid_), &info, WEXITED | WNOWAIT) == -1 &&
+			   errno == EINTR)
+		{
+		}
 	}
 
-	return WEXITSTATUS(status);
-}
\ No newline at end of file
+	return wait();
+}
+
+std::optional<int> Child::wait_for(std::chrono::milliseconds timeout)
+{
+	using std::chrono::steady_clock;
+
+	static constexpr auto MAX_POLL_INTERVAL = std::chrono::milliseconds {50};
+
+	auto deadline = steady_clock::now() + timeout;
+	auto interval = std::chrono::milliseconds {1};
+	while (true)
+	{
+		if (auto code = reap(false))
+		{
+			return code;
+		}
+
+		auto now = steady_clock::now();
+		if (now >= deadline)
+		{
+			return {};
+		}
+
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+		std::this_thread::sleep_for(std::min({interval, remaining, MAX_POLL_INTERVAL}));
+		interval *= 2;
+	}
+}
+
+void Child::kill()
+{
+	if (pid_ != NO_PID && !exitCode)
+	{
+		::kill(ownGroup ? -pid_ : pid_, SIGKILL);
+	}
+}
@@ -1,21 +1,28 @@
 #pragma once
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <optional>
 #include <stb/stb_ds.h>
+#include <stop_token>
 #include <string>
 #include <string_view>
 #include <sys/mman.h>
+#include <sys/types.h>
 #include <system_error>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "Support/Mem.h"
+
 template<class... Args> void print_error(std::format_string<Args...> fmt, Args... args)
 {
 	std::println(std::cerr,
@@ -49,6 +56,63 @@ void print_status(const std::string_view status, std::format_string<Args...> fmt
 	std::cout.flush();
 }
 
+/**
+ * Formats a size for humans, in binary units: `512 B`, `1.5 KiB`, `3.2 GiB`.
+ */
+std::string format_bytes(std::uint64_t bytes);
+
+/**
+ * A handle to a child process started by `ProcessBuilder::spawn`. The child is reaped
+ * when the handle is destroyed if it hasn't been waited on yet.
+ */
+class Child
+{
+	inline static constexpr const pid_t NO_PID = -1;
+	pid_t pid_ = NO_PID;
+	// Whether the child leads a process group of its own
+	bool ownGroup = false;
+	std::optional<int> exitCode;
+	// Set by the child if `execv` fails
+	mem::Shared<int> errorNumber;
+public:
+	Child(pid_t pid, mem::Shared<int>&& errorNumber, bool ownGroup = false);
+	~Child();
+	Child(const Child&) = delete;
+	Child& operator=(const Child&) = delete;
+	Child(Child&& other) noexcept;
+	Child& operator=(Child&& other) noexcept;
+
+	pid_t pid() const
+	{
+		return pid_;
+	}
+
+	/**
+	 * Waits for the child to exit. Returns its exit code, or 128 plus the signal
+	 * number if it was terminated by a signal.
+	 */
+	int wait();
+
+	/**
+	 * Like `wait`, but kills the child as soon as `stop` is requested. The child is
+	 * still reaped, and its exit code reports the signal.
+	 */
+	int wait(std::stop_token stop);
+
+	/**
+	 * Like `wait`, but gives up once `timeout` has passed without the child exiting.
+	 */
+	std::optional<int> wait_for(std::chrono::milliseconds timeout);
+
+	/**
+	 * Sends SIGKILL to the child, and to everything it started if it leads its own
+	 * process group. It still has to be waited on.
+	 */
+	void kill();
+private:
+	std::optional<int> reap(bool block);
+};
+
 /**
  * Builder for subprocesses. Contains the path to the executable and the
  * arguments to pass to it.
@@ -58,6 +122,14 @@ class ProcessBuilder
 	std::filesystem::path path_;
 	bool nameInferred;
     std::vector<std::string> args;
+	std::optional<std::filesystem::path> outputFile;
+	// Environment variables set in addition to the inherited environment
+	std::vector<std::pair<std::string, std::string>> envOverrides;
+	// If set, only inherited variables named here are passed on
+	std::optional<std::vector<std::string>> envAllowlist;
+	std::optional<int> cpu;
+	std::optional<std::filesystem::path> workingDir;
+	bool ownGroup = false;
 public:
 	ProcessBuilder(const std::filesystem::path& path);
 
@@ -66,7 +138,69 @@ public:
 	void add_arg(const std::string& arg);
 	void infer_name();
 
-	int start() const;
+	/**
+	 * The command line of the child, starting with its name.
+	 */
+	const std::vector<std::string>& arguments() const
+	{
+		return args;
+	}
+
+	/**
+	 * Redirects both stdout and stderr of the child to `file`, truncating it.
+	 */
+	void set_output_file(const std::filesystem::path& file);
+
+	void set_env(const std::string& name, const std::string& value);
+
+	/**
+	 * Only passes the inherited variables named in `names` on to the child, instead of
+	 * the whole environment. Variables set with `set_env` are always passed on.
+	 */
+	void set_env_allowlist(std::vector<std::string> names);
+
+	/**
+	 * Pins the child to a single CPU.
+	 */
+	void set_cpu_affinity(int cpu);
+
+	/**
+	 * Starts the child in `dir` instead of Freight's working directory.
+	 */
+	void set_working_dir(const std::filesystem::path& dir);
+
+	/**
+	 * Starts the child in a process group of its own, so that killing it also kills
+	 * every process it started. The terminal no longer sends it SIGINT then, so Freight
+	 * forwards SIGINT, SIGTERM and SIGHUP to such groups itself. Not for children that
+	 * read from the terminal, which only the foreground group may do.
+	 */
+	void set_own_process_group();
+
+	/**
+	 * The number of bytes the arguments take up in the child's argument vector.
+	 */
+	std::size_t command_line_size() const;
+
+	/**
+	 * Returns a builder passing every argument through the response file `file`
+	 * instead, which tools of the LLVM toolchain expand when given `@file`. Empty if
+	 * the file couldn't be written.
+	 */
+	std::optional<ProcessBuilder> with_response_file(
+		const std::filesystem::path& file) const;
+
+	Child spawn() const;
+
+	int start() const
+	{
+		return spawn().wait();
+	}
+
+	int start(std::stop_token stop) const
+	{
+		return spawn().wait(std::move(stop));
+	}
 };
 
 namespace ranges
@@ -0,0 +1,338 @@
+#include "Pch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "Build.h"
+#include "Cmds.h"
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+#include "Support/Util.h"
+#include "Workspace.h"
+
+enum class TestOutcome
+{
+	Passed,
+	Failed,
+	TimedOut,
+};
+
+struct TestRun
+{
+	// Followed by the platform and variant the test was built for, like
+	// `smoke [asan]`, unless it's a plain host build
+	std::string name;
+	std::filesystem::path binary;
+	// Whether the binary writes a coverage profile
+	bool coverage = false;
+	// Where the combined stdout and stderr of the test is captured
+	std::filesystem::path outputFile;
+	TestOutcome outcome = TestOutcome::Failed;
+	int exitCode = 0;
+	std::chrono::steady_clock::duration duration {};
+};
+
+template<class R, class P> static double to_seconds(std::chrono::duration<R, P> d)
+{
+	return std::chrono::duration<double> {d}.count();
+}
+
+static bool matches_filters(const std::string& name, std::span<const std::string> filters)
+{
+	return filters.empty() || std::ranges::any_of(filters, [&](auto& filter) {
+		return name.find(filter) != std::string::npos;
+	});
+}
+
+/**
+ * Selects the tests to run, in a stable order so every CI job running a different
+ * shard agrees on which tests belong to which shard.
+ */
+static std::vector<std::string> select_tests(const Package& package,
+	const TestOptions& opts)
+{
+	std::vector<std::string> names;
+	for (auto& target : package.targets())
+	{
+		if (target.kind == TargetKind::Test && matches_filters(target.name, opts.filters))
+		{
+			names.push_back(target.name);
+		}
+	}
+
+	std::ranges::sort(names);
+
+	if (opts.shard)
+	{
+		std::vector<std::string> sharded;
+		for (std::size_t i = 0; i < names.size(); i++)
+		{
+			if (i % opts.shard->count == opts.shard->index - 1)
+			{
+				sharded.push_back(std::move(names[i]));
+			}
+		}
+
+		names = std::move(sharded);
+	}
+
+	return names;
+}
+
+static void run_test(TestRun& test, std::optional<std::chrono::seconds> timeout)
+{
+	using std::chrono::steady_clock;
+
+	ProcessBuilder pb {test.binary};
+	pb.set_output_file(test.outputFile);
+
+	// Killing a test that timed out also kills whatever it started, which would keep
+	// running and hold its output file open otherwise
+	pb.set_own_process_group();
+
+	if (test.coverage)
+	{
+		// One profile per process, next to the binary of the variant
+		pb.set_env("LLVM_PROFILE_FILE", test.binary.string() + "-%p.profraw");
+	}
+
+	auto startTime = steady_clock::now();
+	Child child = pb.spawn();
+
+	std::optional<int> exitCode = timeout ? child.wait_for(*timeout) : child.wait();
+	test.duration = steady_clock::now() - startTime;
+
+	if (!exitCode)
+	{
+		child.kill();
+		child.wait();
+		test.outcome = TestOutcome::TimedOut;
+	}
+	else
+	{
+		test.exitCode = *exitCode;
+		test.outcome = *exitCode == 0 ? TestOutcome::Passed : TestOutcome::Failed;
+	}
+}
+
+static std::string describe_outcome(const TestRun& test,
+	std::optional<std::chrono::seconds> timeout)
+{
+	switch (test.outcome)
+	{
+	case TestOutcome::Passed:
+		return "ok";
+	case TestOutcome::Failed:
+		return std::format("FAILED (exit code {})", test.exitCode);
+	case TestOutcome::TimedOut:
+		return std::format(
+			"TIMED OUT (after {}s)", timeout.value_or(std::chrono::seconds {0}).count());
+	}
+
+	std::unreachable();
+}
+
+static std::string xml_escape(std::string_view text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '&':
+			escaped += "&amp;";
+			break;
+		case '<':
+			escaped += "&lt;";
+			break;
+		case '>':
+			escaped += "&gt;";
+			break;
+		case '"':
+			escaped += "&quot;";
+			break;
+		case '\'':
+			escaped += "&apos;";
+			break;
+		default:
+			// Control characters other than whitespace aren't allowed in XML 1.0
+			if (static_cast<unsigned char>(c) >= ' ' || c == '\t' || c == '\n' || c == '\r')
+			{
+				escaped += c;
+			}
+		}
+	}
+
+	return escaped;
+}
+
+static bool write_junit_report(const std::filesystem::path& file,
+	const Package& package,
+	std::span<const TestRun> tests,
+	std::chrono::steady_clock::duration duration,
+	std::optional<std::chrono::seconds> timeout)
+{
+	auto failures = std::ranges::count_if(
+		tests, [](auto& test) { return test.outcome != TestOutcome::Passed; });
+	auto timestamp =
+		std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+	auto packageName = xml_escape(package.name());
+
+	std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	xml += std::format(
+		"<testsuites name=\"{0}\" tests=\"{1}\" failures=\"{2}\" errors=\"0\" "
+		"time=\"{3:.3f}\">\n"
+		"  <testsuite name=\"{0}\" tests=\"{1}\" failures=\"{2}\" errors=\"0\" "
+		"skipped=\"0\" time=\"{3:.3f}\" timestamp=\"{4:%FT%T}\">\n",
+		packageName,
+		tests.size(),
+		failures,
+		to_seconds(duration),
+		timestamp);
+
+	for (auto& test : tests)
+	{
+		xml += std::format("    <testcase name=\"{}\" classname=\"{}\" time=\"{:.3f}\">\n",
+			xml_escape(test.name),
+			packageName,
+			to_seconds(test.duration));
+
+		if (test.outcome != TestOutcome::Passed)
+		{
+			xml += std::format("      <failure message=\"{}\"/>\n",
+				xml_escape(describe_outcome(test, timeout)));
+		}
+
+		auto output = io::read_file(test.outputFile).value_or("");
+		if (!output.empty())
+		{
+			xml += std::format("      <system-out>{}</system-out>\n", xml_escape(output));
+		}
+
+		xml += "    </testcase>\n";
+	}
+
+	xml += "  </testsuite>\n</testsuites>\n";
+
+	std::error_code err;
+	std::filesystem::create_directories(file.parent_path(), err);
+	return !err && io::write_file_atomic(file, xml);
+}
+
+void exec_test(const TestOptions& opts)
+{
+	using namespace std::filesystem;
+	using std::chrono::steady_clock;
+
+	auto cwd = current_path();
+	GlobalContext gctx {cwd};
+	Workspace ws {cwd / "Freight.toml", gctx};
+	auto& package = ws.current();
+
+	auto names = select_tests(package, opts);
+	if (names.empty())
+	{
+		print_status(" Finished", "no tests to run");
+		return;
+	}
+
+	// Every test runs once per variant and platform, all of them sharing the same jobs
+	auto& buildOpts = opts.build_opts;
+	auto buildCount = std::max<std::size_t>(buildOpts.variants.size(), 1) *
+					  std::max<std::size_t>(buildOpts.targets.size(), 1);
+	auto compilation = build_package(ws, package, buildOpts, TargetKind::Test, names);
+	if (compilation.binaries.size() != names.size() * buildCount)
+	{
+		bail("could not compile tests for `{}`", package.name());
+	}
+
+	std::vector<TestRun> tests;
+	for (std::size_t i = 0; i < compilation.binaries.size(); i++)
+	{
+		auto& binary = compilation.binaries[i];
+		auto& profile = compilation.binaryProfiles[i];
+		auto name = binary.filename().string();
+		tests.push_back(TestRun {
+			.name = name + describe_build(profile, buildCount > 1),
+			.binary = binary,
+			.coverage = profile.variant.coverage,
+			.outputFile = binary.parent_path() / (name + ".log"),
+		});
+	}
+
+	std::ranges::sort(tests, {}, &TestRun::name);
+
+	std::size_t jobCount = opts.build_opts.jobs.value_or(jobs::Scheduler::default_jobs());
+	std::string shardDescription =
+		opts.shard ? std::format(", shard {}/{}", opts.shard->index, opts.shard->count)
+				   : "";
+	print_status("  Running",
+		"{} test(s) ({} jobs{})",
+		tests.size(),
+		jobCount,
+		shardDescription);
+
+	std::mutex outputMutex;
+	jobs::Scheduler scheduler {jobCount};
+	for (auto& test : tests)
+	{
+		scheduler.add([&test, &opts, &outputMutex] {
+			run_test(test, opts.timeout);
+
+			std::lock_guard lock {outputMutex};
+			print_status("     Test",
+				"{} ... {} ({:.3f}s)",
+				test.name,
+				describe_outcome(test, opts.timeout),
+				to_seconds(test.duration));
+			return test.outcome == TestOutcome::Passed;
+		});
+	}
+
+	auto startTime = steady_clock::now();
+	bool allPassed = scheduler.run();
+	auto timePassed = steady_clock::now() - startTime;
+
+	auto junitPath = opts.junit_path ? path {*opts.junit_path}
+									 : ws.build_dir() /
+										   select_profile(opts.build_opts).target_subdir /
+										   "junit.xml";
+	if (!write_junit_report(junitPath, package, tests, timePassed, opts.timeout))
+	{
+		print_error("failed to write JUnit report to `{}`", junitPath.string());
+	}
+
+	auto passed = std::ranges::count(tests, TestOutcome::Passed, &TestRun::outcome);
+	auto timedOut = std::ranges::count(tests, TestOutcome::TimedOut, &TestRun::outcome);
+	auto failed = static_cast<std::ptrdiff_t>(tests.size()) - passed - timedOut;
+
+	if (!allPassed)
+	{
+		std::println("\nfailures:");
+		for (auto& test : tests)
+		{
+			if (test.outcome != TestOutcome::Passed)
+			{
+				std::println("\n---- {} output ----", test.name);
+				std::print("{}", io::read_file(test.outputFile).value_or(""));
+			}
+		}
+	}
+
+	std::println("\ntest result: {}. {} passed; {} failed; {} timed out; finished in {:.3f}s\n",
+		allPassed ? "ok" : "FAILED",
+		passed,
+		failed,
+		timedOut,
+		to_seconds(timePassed));
+
+	if (!allPassed)
+	{
+		bail("{} test(s) failed", failed + timedOut);
+	}
+}
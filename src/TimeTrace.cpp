@@ -0,0 +1,233 @@
+#include "Pch.h"
+
+#include "TimeTrace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+
+namespace
+{
+using Totals = std::unordered_map<std::string, TimeTraceReport::Hotspot>;
+
+struct TraceTotals
+{
+	Totals headers;
+	Totals templates;
+	Totals functions;
+};
+
+/**
+ * Code generation and optimization events are named after the mangled function.
+ */
+std::string demangle(const std::string& name)
+{
+	if (!name.starts_with("_Z"))
+	{
+		return name;
+	}
+
+	int status = 0;
+	std::unique_ptr<char, decltype(&std::free)> demangled {
+		abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status),
+		&std::free};
+	return status == 0 && demangled ? std::string {demangled.get()} : name;
+}
+
+void add(Totals& totals, std::string name, double micros)
+{
+	auto& hotspot = totals[name];
+	if (hotspot.name.empty())
+	{
+		hotspot.name = std::move(name);
+	}
+
+	hotspot.micros += micros;
+	hotspot.count++;
+}
+
+/**
+ * Sums up the complete events of one trace, in the Chrome trace event format.
+ */
+std::optional<TraceTotals> read_trace(const std::filesystem::path& file)
+{
+	auto text = io::read_file(file);
+	if (!text)
+	{
+		return {};
+	}
+
+	auto trace = json::parse(*text);
+	auto *events = trace && trace->find("traceEvents")
+					   ? trace->find("traceEvents")->as_array()
+					   : nullptr;
+	if (events == nullptr)
+	{
+		return {};
+	}
+
+	TraceTotals totals;
+	for (auto& event : *events)
+	{
+		auto *phase = event.find("ph") ? event.find("ph")->as_string() : nullptr;
+		auto *name = event.find("name") ? event.find("name")->as_string() : nullptr;
+		auto *duration = event.find("dur") ? event.find("dur")->as_number() : nullptr;
+		auto *args = event.find("args");
+		auto *detail =
+			args && args->find("detail") ? args->find("detail")->as_string() : nullptr;
+		if (phase == nullptr || *phase != "X" || name == nullptr || duration == nullptr ||
+			detail == nullptr)
+		{
+			continue;
+		}
+
+		if (*name == "Source")
+		{
+			add(totals.headers, *detail, *duration);
+		}
+		else if (*name == "InstantiateClass" || *name == "InstantiateFunction")
+		{
+			add(totals.templates, *detail, *duration);
+		}
+		else if (*name == "CodeGen Function" || *name == "OptFunction")
+		{
+			add(totals.functions, demangle(*detail), *duration);
+		}
+	}
+
+	return totals;
+}
+
+void merge(Totals& into, Totals& from)
+{
+	for (auto& [key, hotspot] : from)
+	{
+		auto& total = into[key];
+		if (total.name.empty())
+		{
+			total.name = std::move(hotspot.name);
+		}
+
+		total.micros += hotspot.micros;
+		total.count += hotspot.count;
+	}
+}
+
+std::vector<TimeTraceReport::Hotspot> sorted(Totals& totals)
+{
+	std::vector<TimeTraceReport::Hotspot> hotspots;
+	hotspots.reserve(totals.size());
+	for (auto& [key, hotspot] : totals)
+	{
+		hotspots.push_back(std::move(hotspot));
+	}
+
+	// Ties are broken by name, so reports of identical builds are identical
+	std::ranges::sort(hotspots, [](auto& a, auto& b) {
+		return a.micros != b.micros ? a.micros > b.micros : a.name < b.name;
+	});
+	return hotspots;
+}
+
+std::string format_hotspots(std::string_view title,
+	std::span<const TimeTraceReport::Hotspot> hotspots,
+	std::size_t top)
+{
+	static constexpr double MICROS_PER_MILLI = 1000;
+
+	std::string text = std::format("{}:\n", title);
+	for (auto& hotspot : hotspots.first(std::min(top, hotspots.size())))
+	{
+		auto millis = hotspot.micros / MICROS_PER_MILLI;
+		text += std::format("{:>9.1f} ms {:>6}x {:>7.1f} ms avg  {}\n",
+			millis,
+			hotspot.count,
+			millis / static_cast<double>(hotspot.count),
+			hotspot.name);
+	}
+
+	if (hotspots.empty())
+	{
+		text += "  (none)\n";
+	}
+
+	return text;
+}
+
+json::Value hotspots_to_json(std::span<const TimeTraceReport::Hotspot> hotspots)
+{
+	json::Array array;
+	for (auto& hotspot : hotspots)
+	{
+		array.push_back(json::Object {
+			{"name", hotspot.name},
+			{"micros", hotspot.micros},
+			{"count", hotspot.count},
+		});
+	}
+
+	return array;
+}
+} // namespace
+
+TimeTraceReport TimeTraceReport::aggregate(std::span<const std::filesystem::path> files,
+	std::size_t jobs)
+{
+	std::vector<std::optional<TraceTotals>> traces(files.size());
+
+	jobs::Scheduler scheduler {jobs};
+	for (std::size_t i = 0; i < files.size(); i++)
+	{
+		scheduler.add([&files, &traces, i] {
+			traces[i] = read_trace(files[i]);
+			return true;
+		});
+	}
+	scheduler.run();
+
+	TraceTotals totals;
+	TimeTraceReport report;
+	for (auto& trace : traces)
+	{
+		if (!trace)
+		{
+			continue;
+		}
+
+		report.units++;
+		merge(totals.headers, trace->headers);
+		merge(totals.templates, trace->templates);
+		merge(totals.functions, trace->functions);
+	}
+
+	report.headers = sorted(totals.headers);
+	report.templates = sorted(totals.templates);
+	report.functions = sorted(totals.functions);
+	return report;
+}
+
+std::string TimeTraceReport::to_text(std::size_t top) const
+{
+	return std::format("Time trace of {} translation unit(s)\n\n{}\n{}\n{}",
+		units,
+		format_hotspots("Headers by total parse time", headers, top),
+		format_hotspots("Template instantiations by total time", templates, top),
+		format_hotspots("Functions by total code generation time", functions, top));
+}
+
+json::Value TimeTraceReport::to_json() const
+{
+	return json::Object {
+		{"units", units},
+		{"headers", hotspots_to_json(headers)},
+		{"templates", hotspots_to_json(templates)},
+		{"functions", hotspots_to_json(functions)},
+	};
+}
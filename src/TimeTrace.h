@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Support/Json.h"
+
+/**
+ * Where compile time went across a whole build, aggregated from the trace clang writes
+ * for each translation unit with `-ftime-trace`.
+ */
+struct TimeTraceReport
+{
+	struct Hotspot
+	{
+		std::string name;
+		// Total time across every translation unit, in microseconds
+		double micros = 0;
+		// Number of times it was parsed, instantiated or generated
+		std::size_t count = 0;
+	};
+
+	// Number of traces aggregated
+	std::size_t units = 0;
+	// Headers by total parse time, including the headers they include
+	std::vector<Hotspot> headers;
+	// Template instantiations by total time, including nested instantiations
+	std::vector<Hotspot> templates;
+	// Functions by total code generation and optimization time
+	std::vector<Hotspot> functions;
+
+	/**
+	 * Parses the traces at `files` on up to `jobs` threads and sums them up. Traces
+	 * that can't be read are skipped. Hotspots are sorted slowest first.
+	 */
+	static TimeTraceReport aggregate(std::span<const std::filesystem::path> files,
+		std::size_t jobs);
+
+	/**
+	 * A human-readable summary of the `top` slowest hotspots of each kind.
+	 */
+	std::string to_text(std::size_t top) const;
+
+	json::Value to_json() const;
+};
@@ -11,6 +11,23 @@ void print_parse_error(const toml::parse_error& error)
 	std::println(std::cerr, " --> {}:{}:{}", *src.path, src.end.line, src.end.column);
 }
 
+static std::vector<std::string> parse_strings(toml::node_view<toml::node> node)
+{
+	std::vector<std::string> strings;
+	if (auto *array = node.as_array())
+	{
+		for (auto& element : *array)
+		{
+			if (auto *str = element.as_string())
+			{
+				strings.push_back(str->get());
+			}
+		}
+	}
+
+	return strings;
+}
+
 TomlManifest serialize_toml([[maybe_unused]] const std::filesystem::path& manifestPath)
 {
 	toml::parse_result result = toml::parse_file(manifestPath.string());
@@ -44,5 +61,98 @@ TomlManifest serialize_toml([[maybe_unused]] const std::filesystem::path& manife
 		}
 	}
 
+	if (auto *profiles = table["profile"].as_table())
+	{
+		for (auto&& [name, node] : *profiles)
+		{
+			toml::node_view<toml::node> profile {node};
+			if (!profile.is_table())
+			{
+				continue;
+			}
+
+			TomlProfile tomlProfile;
+			if (profile["split-debuginfo"].is_string())
+			{
+				tomlProfile.splitDebugInfo =
+					profile["split-debuginfo"].as_string()->get();
+			}
+
+			if (profile["debug-compression"].is_string())
+			{
+				tomlProfile.debugCompression =
+					profile["debug-compression"].as_string()->get();
+			}
+
+			manifest.profile.emplace(std::string {name.str()}, std::move(tomlProfile));
+		}
+	}
+
+	if (auto *targets = table["target"].as_table())
+	{
+		for (auto&& [triple, node] : *targets)
+		{
+			toml::node_view<toml::node> target {node};
+			if (!target.is_table())
+			{
+				continue;
+			}
+
+			TomlPlatform platform;
+			if (target["sysroot"].is_string())
+			{
+				platform.sysroot = target["sysroot"].as_string()->get();
+			}
+
+			if (target["linker"].is_string())
+			{
+				platform.linker = target["linker"].as_string()->get();
+			}
+
+			platform.flags = parse_strings(target["flags"]);
+			platform.linkFlags = parse_strings(target["link-flags"]);
+			manifest.target.emplace(std::string {triple.str()}, std::move(platform));
+		}
+	}
+
+	// `name = "1.0"` is short for `name = { version = "1.0" }`
+	if (auto *dependencies = table["dependencies"].as_table())
+	{
+		for (auto&& [name, node] : *dependencies)
+		{
+			toml::node_view<toml::node> dependency {node};
+			TomlDependency tomlDependency;
+			if (dependency.is_string())
+			{
+				tomlDependency.version = dependency.as_string()->get();
+			}
+
+			if (dependency["path"].is_string())
+			{
+				tomlDependency.path = dependency["path"].as_string()->get();
+			}
+
+			if (dependency["version"].is_string())
+			{
+				tomlDependency.version = dependency["version"].as_string()->get();
+			}
+
+			tomlDependency.optional = dependency["optional"].value_or(false);
+			tomlDependency.features = parse_strings(dependency["features"]);
+			tomlDependency.defaultFeatures = dependency["default-features"].value_or(true);
+			manifest.dependencies.emplace(std::string {name.str()},
+				std::move(tomlDependency));
+		}
+	}
+
+	if (auto *features = table["features"].as_table())
+	{
+		for (auto&& [name, node] : *features)
+		{
+			manifest.features.emplace(std::string {name.str()},
+				parse_strings(toml::node_view<toml::node> {node}));
+		}
+	}
+
 	return manifest;
 }
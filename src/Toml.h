@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <map>
 #include <optional>
 #include <string>
 #include <vector>
@@ -18,10 +19,44 @@ struct TomlTarget
 	std::optional<std::vector<std::filesystem::path>> paths;
 };
 
+struct TomlProfile
+{
+	std::optional<std::string> splitDebugInfo;
+	std::optional<std::string> debugCompression;
+};
+
+struct TomlPlatform
+{
+	std::optional<std::string> sysroot;
+	std::optional<std::string> linker;
+	std::vector<std::string> flags;
+	std::vector<std::string> linkFlags;
+};
+
+struct TomlDependency
+{
+	// Relative to the package root
+	std::optional<std::string> path;
+	std::optional<std::string> version;
+	// Only built once a feature enables it
+	bool optional = false;
+	// Features of the dependency to enable
+	std::vector<std::string> features;
+	bool defaultFeatures = true;
+};
+
 struct TomlManifest
 {
 	std::optional<TomlPackage> package;
 	std::optional<std::vector<TomlTarget>> bin;
+	// The `[profile.<name>]` tables, by name
+	std::map<std::string, TomlProfile> profile;
+	// The `[target.<triple>]` tables, by triple
+	std::map<std::string, TomlPlatform> target;
+	// The `[dependencies]` table, by name
+	std::map<std::string, TomlDependency> dependencies;
+	// The `[features]` table: what each feature enables, by name
+	std::map<std::string, std::vector<std::string>> features;
 };
 
 TomlManifest serialize_toml(const std::filesystem::path& manifest_path);
\ No newline at end of file
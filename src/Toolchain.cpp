@@ -0,0 +1,464 @@
+#include "Pch.h"
+
+#include "Toolchain.h"
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Support/Hash.h"
+#include "Support/Io.h"
+#include "Support/Jobs.h"
+#include "Support/Json.h"
+#include "Support/Util.h"
+
+static constexpr double CACHE_VERSION = 3;
+
+// Every tool of a toolchain, along with the name of its executable
+static constexpr std::array<std::pair<std::string_view, Tool Toolchain::*>, 6> TOOLS = {{
+	{"clang++", &Toolchain::clang},
+	{"ld.lld", &Toolchain::lld},
+	{"llvm-ar", &Toolchain::ar},
+	{"llvm-dwp", &Toolchain::dwp},
+	{"llvm-profdata", &Toolchain::profdata},
+	{"clang-scan-deps", &Toolchain::scanDeps},
+}};
+
+using ToolStamps = std::array<std::string, TOOLS.size()>;
+
+hash::Digest Toolchain::identity() const
+{
+	static constexpr std::string_view SEPARATOR {"\0", 1};
+
+	hash::Hasher hasher;
+	for (auto& [name, member] : TOOLS)
+	{
+		auto& tool = this->*member;
+		hasher.update(tool.path.string());
+		hasher.update(SEPARATOR);
+		hasher.update(tool.version);
+		hasher.update(SEPARATOR);
+	}
+
+	hasher.update(triple);
+	for (auto& dir : builtinIncludeDirs)
+	{
+		hasher.update(SEPARATOR);
+		hasher.update(dir.string());
+	}
+
+	return hasher.finish();
+}
+
+static bool is_executable(const std::filesystem::path& file)
+{
+	return std::filesystem::is_regular_file(file) && access(file.c_str(), X_OK) == 0;
+}
+
+std::filesystem::path search_path(const std::filesystem::path& file)
+{
+	// The returned string belongs to the environment, so it must not be modified
+	const char *pathEnv = std::getenv("PATH");
+	if (pathEnv == nullptr)
+	{
+		return {};
+	}
+
+	for (auto entry : std::string_view {pathEnv} | std::views::split(':'))
+	{
+		// An empty entry stands for the current directory
+		std::string_view dir {entry};
+		auto candidate = (dir.empty() ? std::filesystem::path {"."} : std::filesystem::path {dir}) /
+						 file;
+		if (is_executable(candidate))
+		{
+			return std::filesystem::absolute(candidate);
+		}
+	}
+
+	return {};
+}
+
+std::filesystem::path find_tool(const std::string& name)
+{
+	auto tool = search_path(name);
+	if (tool.empty())
+	{
+		bail("could not find `{}` in `PATH`", name);
+	}
+
+	return tool;
+}
+
+/**
+ * The suffix of versioned installations such as `clang++-17`, whose tools are named
+ * `llvm-ar-17` and so on.
+ */
+static std::string version_suffix(const std::filesystem::path& clang)
+{
+	std::string name = clang.filename();
+	auto dash = name.rfind('-');
+	if (dash == std::string::npos || dash + 1 == name.size())
+	{
+		return {};
+	}
+
+	bool isVersion = std::ranges::all_of(name.substr(dash + 1),
+		[](char c) { return c >= '0' && c <= '9'; });
+	return isVersion ? name.substr(dash) : "";
+}
+
+/**
+ * Finds the tool called `name` that goes with `clang`, preferring the one installed
+ * next to it over the one in `PATH`.
+ */
+static std::filesystem::path find_tool(const std::filesystem::path& clang,
+	std::string_view name)
+{
+	std::vector<std::string> names;
+	if (auto suffix = version_suffix(clang); !suffix.empty())
+	{
+		names.push_back(std::format("{}{}", name, suffix));
+	}
+	names.emplace_back(name);
+
+	// Distributions usually symlink clang into `PATH`, while the rest of the tools may
+	// only exist in the LLVM installation
+	std::vector<std::filesystem::path> dirs {clang.parent_path()};
+	std::error_code errc;
+	auto canonical = std::filesystem::canonical(clang, errc);
+	if (!errc && canonical.parent_path() != clang.parent_path())
+	{
+		dirs.push_back(canonical.parent_path());
+	}
+
+	for (auto& dir : dirs)
+	{
+		for (auto& candidate : names)
+		{
+			if (is_executable(dir / candidate))
+			{
+				return dir / candidate;
+			}
+		}
+	}
+
+	for (auto& candidate : names)
+	{
+		if (auto found = search_path(candidate); !found.empty())
+		{
+			return found;
+		}
+	}
+
+	return {};
+}
+
+static std::string stamp_key(const std::filesystem::path& tool)
+{
+	auto stamp = io::stamp_file(tool);
+	return stamp ? std::format("{}:{}", stamp->mtime, stamp->size) : "";
+}
+
+/**
+ * Runs `pb` and returns everything it wrote to stdout and stderr.
+ */
+static std::string capture_output(ProcessBuilder pb)
+{
+	auto output = io::AnonymousFile::create();
+	pb.set_output_file(output.path());
+	pb.start();
+	return io::read_file(output.path()).value_or("");
+}
+
+static auto output_lines(std::string_view output)
+{
+	return output | std::views::split('\n') | std::views::transform([](auto line) {
+		std::string_view str {line};
+		auto start = str.find_first_not_of(" \t");
+		return start == std::string_view::npos ? std::string_view {} : str.substr(start);
+	});
+}
+
+/**
+ * Picks the line naming the version out of the output of `--version`. Some tools,
+ * such as `llvm-ar`, start with a banner instead.
+ */
+static std::string version_line(std::string_view output)
+{
+	std::string_view first;
+	for (auto line : output_lines(output))
+	{
+		if (line.contains("version"))
+		{
+			return std::string {line};
+		}
+		else if (first.empty())
+		{
+			first = line;
+		}
+	}
+
+	return std::string {first};
+}
+
+/**
+ * Parses the `#include <...>` search list clang prints with `-v`.
+ */
+static std::vector<std::filesystem::path> parse_include_dirs(std::string_view output)
+{
+	static constexpr std::string_view FRAMEWORK_SUFFIX = " (framework directory)";
+
+	std::vector<std::filesystem::path> dirs;
+	bool inList = false;
+	for (auto line : output_lines(output))
+	{
+		if (line.starts_with("#include <...> search starts here:"))
+		{
+			inList = true;
+		}
+		else if (line.starts_with("End of search list."))
+		{
+			break;
+		}
+		else if (inList && !line.empty())
+		{
+			if (line.ends_with(FRAMEWORK_SUFFIX))
+			{
+				line.remove_suffix(FRAMEWORK_SUFFIX.size());
+			}
+
+			dirs.emplace_back(line);
+		}
+	}
+
+	return dirs;
+}
+
+/**
+ * Times compiling an empty file with `clang`, after the other probes so they don't
+ * skew it. The fastest of a few runs is used, as the first one is usually slowed down
+ * by a cold page cache.
+ */
+static std::chrono::microseconds measure_spawn_overhead(const std::filesystem::path& clang)
+{
+	static constexpr int RUNS = 3;
+
+	ProcessBuilder pb {clang};
+	for (auto arg : {"-fsyntax-only", "-x", "c++", "/dev/null"})
+	{
+		pb.add_arg(arg);
+	}
+
+	auto fastest = std::chrono::microseconds::max();
+	for (int i = 0; i < RUNS; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		pb.start();
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start);
+		fastest = std::min(fastest, elapsed);
+	}
+
+	return fastest;
+}
+
+/**
+ * Fills in everything about `toolchain` that is only known by running its tools,
+ * running them in parallel.
+ */
+static void probe_toolchain(Toolchain& toolchain)
+{
+	std::array<std::string, TOOLS.size()> versionOutputs;
+	std::string tripleOutput;
+	std::string searchListOutput;
+
+	jobs::Scheduler scheduler {TOOLS.size() + 2};
+	for (std::size_t i = 0; i < TOOLS.size(); i++)
+	{
+		auto& tool = toolchain.*TOOLS[i].second;
+		if (!tool.found())
+		{
+			continue;
+		}
+
+		scheduler.add([&tool, &output = versionOutputs[i]] {
+			ProcessBuilder pb {tool.path};
+			pb.add_arg("--version");
+			output = capture_output(pb);
+			return true;
+		});
+	}
+
+	scheduler.add([&toolchain, &tripleOutput] {
+		ProcessBuilder pb {toolchain.clang.path};
+		pb.add_arg("-dumpmachine");
+		tripleOutput = capture_output(pb);
+		return true;
+	});
+
+	scheduler.add([&toolchain, &searchListOutput] {
+		ProcessBuilder pb {toolchain.clang.path};
+		for (auto arg : {"-E", "-x", "c++", "-v", "/dev/null", "-o", "/dev/null"})
+		{
+			pb.add_arg(arg);
+		}
+
+		searchListOutput = capture_output(pb);
+		return true;
+	});
+
+	scheduler.run();
+
+	for (std::size_t i = 0; i < TOOLS.size(); i++)
+	{
+		(toolchain.*TOOLS[i].second).version = version_line(versionOutputs[i]);
+	}
+
+	toolchain.triple = tripleOutput.substr(0, tripleOutput.find('\n'));
+	toolchain.builtinIncludeDirs = parse_include_dirs(searchListOutput);
+	toolchain.spawnOverhead = measure_spawn_overhead(toolchain.clang.path);
+}
+
+static json::Value toolchain_to_json(const Toolchain& toolchain, const ToolStamps& stamps)
+{
+	json::Array tools;
+	for (std::size_t i = 0; i < TOOLS.size(); i++)
+	{
+		auto& [name, member] = TOOLS[i];
+		auto& tool = toolchain.*member;
+		tools.push_back(json::Object {
+			{"name", name},
+			{"path", tool.path.string()},
+			{"stamp", stamps[i]},
+			{"version", tool.version},
+		});
+	}
+
+	json::Array includeDirs;
+	for (auto& dir : toolchain.builtinIncludeDirs)
+	{
+		includeDirs.push_back(dir.string());
+	}
+
+	return json::Object {
+		{"version", CACHE_VERSION},
+		{"tools", std::move(tools)},
+		{"triple", toolchain.triple},
+		{"include_dirs", std::move(includeDirs)},
+		{"spawn_overhead_us", toolchain.spawnOverhead.count()},
+	};
+}
+
+static const std::string *string_member(const json::Value& value, std::string_view key)
+{
+	auto *member = value.find(key);
+	return member != nullptr ? member->as_string() : nullptr;
+}
+
+/**
+ * Loads the probed parts of `resolved` from the cache, if none of its tools changed
+ * since the cache was written.
+ */
+static std::optional<Toolchain> load_cached_toolchain(const std::filesystem::path& cacheFile,
+	const Toolchain& resolved,
+	const ToolStamps& stamps)
+{
+	auto text = io::read_file(cacheFile);
+	if (!text)
+	{
+		return {};
+	}
+
+	auto document = json::parse(*text);
+	if (!document)
+	{
+		return {};
+	}
+
+	auto *version = document->find("version");
+	auto *tools = document->find("tools");
+	auto *triple = string_member(*document, "triple");
+	auto *includeDirs = document->find("include_dirs");
+	auto *spawnOverhead = document->find("spawn_overhead_us");
+	if (version == nullptr || version->as_number() == nullptr ||
+		*version->as_number() != CACHE_VERSION || tools == nullptr ||
+		tools->as_array() == nullptr || tools->as_array()->size() != TOOLS.size() ||
+		triple == nullptr || includeDirs == nullptr || includeDirs->as_array() == nullptr ||
+		spawnOverhead == nullptr || spawnOverhead->as_number() == nullptr)
+	{
+		return {};
+	}
+
+	Toolchain toolchain = resolved;
+	for (std::size_t i = 0; i < TOOLS.size(); i++)
+	{
+		auto& entry = (*tools->as_array())[i];
+		auto *name = string_member(entry, "name");
+		auto *path = string_member(entry, "path");
+		auto *stamp = string_member(entry, "stamp");
+		auto *toolVersion = string_member(entry, "version");
+		auto& tool = toolchain.*TOOLS[i].second;
+		if (name == nullptr || *name != TOOLS[i].first || path == nullptr ||
+			*path != tool.path.string() || stamp == nullptr || *stamp != stamps[i] ||
+			toolVersion == nullptr)
+		{
+			return {};
+		}
+
+		tool.version = *toolVersion;
+	}
+
+	toolchain.triple = *triple;
+	toolchain.spawnOverhead =
+		std::chrono::microseconds {static_cast<std::int64_t>(*spawnOverhead->as_number())};
+	for (auto& dir : *includeDirs->as_array())
+	{
+		if (dir.as_string() == nullptr)
+		{
+			return {};
+		}
+
+		toolchain.builtinIncludeDirs.emplace_back(*dir.as_string());
+	}
+
+	return toolchain;
+}
+
+Toolchain load_toolchain(const std::filesystem::path& clang,
+	const std::filesystem::path& cacheFile)
+{
+	Toolchain toolchain;
+	toolchain.clang.path = clang;
+	for (auto& [name, member] : TOOLS)
+	{
+		if (member != &Toolchain::clang)
+		{
+			(toolchain.*member).path = find_tool(clang, name);
+		}
+	}
+
+	// Stamped before probing, so a tool replaced while it's probed is probed again next
+	// time
+	ToolStamps stamps;
+	for (std::size_t i = 0; i < TOOLS.size(); i++)
+	{
+		stamps[i] = stamp_key((toolchain.*TOOLS[i].second).path);
+	}
+
+	if (auto cached = load_cached_toolchain(cacheFile, toolchain, stamps))
+	{
+		return std::move(*cached);
+	}
+
+	probe_toolchain(toolchain);
+
+	// The cache is only an optimization, so failing to write it isn't an error
+	std::error_code errc;
+	std::filesystem::create_directories(cacheFile.parent_path(), errc);
+	io::write_file_atomic(cacheFile, json::to_string(toolchain_to_json(toolchain, stamps), true));
+
+	return toolchain;
+}
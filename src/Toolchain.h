@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Support/Hash.h"
+
+/**
+ * A tool of the LLVM toolchain. Tools that couldn't be found have an empty path.
+ */
+struct Tool
+{
+	std::filesystem::path path;
+	// The line of `<tool> --version` naming the version
+	std::string version;
+
+	bool found() const
+	{
+		return !path.empty();
+	}
+};
+
+/**
+ * The compiler, the LLVM tools installed alongside it, and what clang reports about
+ * itself.
+ */
+struct Toolchain
+{
+	Tool clang;
+	Tool lld;
+	Tool ar;
+	Tool dwp;
+	Tool profdata;
+	Tool scanDeps;
+	std::string triple;
+	std::vector<std::filesystem::path> builtinIncludeDirs;
+	// How long clang takes to compile an empty file, roughly the fixed cost of every
+	// compiler process. Not part of the identity.
+	std::chrono::microseconds spawnOverhead {0};
+
+	/**
+	 * A hash of everything about the toolchain that affects build outputs. Fingerprints
+	 * include it, so upgrading the compiler invalidates previous builds.
+	 */
+	hash::Digest identity() const;
+};
+
+/**
+ * Finds the executable `file` in one of the directories in `PATH`, or returns an empty
+ * path if there is none.
+ */
+std::filesystem::path search_path(const std::filesystem::path& file);
+
+/**
+ * Like `search_path`, but bails if there is no `name` in `PATH`.
+ */
+std::filesystem::path find_tool(const std::string& name);
+
+/**
+ * Resolves the tools that go with the compiler at `clang` and probes them. Probing
+ * spawns every tool, so the result is cached in `cacheFile` and only redone once the
+ * path or mtime of one of the tools changes.
+ */
+Toolchain load_toolchain(const std::filesystem::path& clang,
+	const std::filesystem::path& cacheFile);
@@ -0,0 +1,225 @@
+#include "Pch.h"
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "Cmds.h"
+#include "Features.h"
+#include "Support/Util.h"
+#include "Workspace.h"
+
+/**
+ * Watches directory trees for changes through inotify. Directories created inside a
+ * watched tree are watched too.
+ */
+class Watcher
+{
+private:
+	static constexpr std::uint32_t EVENTS = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+											IN_MOVED_FROM | IN_MOVED_TO |
+											IN_DELETE_SELF;
+
+	struct Watch
+	{
+		std::filesystem::path dir;
+		// The only file in `dir` to report changes of, if any
+		std::optional<std::string> only;
+	};
+
+	int fd;
+	std::unordered_map<int, Watch> watches;
+public:
+	Watcher() : fd {inotify_init1(IN_CLOEXEC)}
+	{
+		if (fd == -1)
+		{
+			bail("failed to watch for changes\n\n{}",
+				cause(std::error_code {errno, std::system_category()}.message()));
+		}
+	}
+
+	~Watcher()
+	{
+		close(fd);
+	}
+
+	Watcher(const Watcher&) = delete;
+	Watcher& operator=(const Watcher&) = delete;
+	Watcher(Watcher&&) = delete;
+	Watcher& operator=(Watcher&&) = delete;
+
+	void add_tree(const std::filesystem::path& root)
+	{
+		add_dir(root);
+
+		using namespace std::filesystem;
+
+		std::error_code errc;
+		auto options = directory_options::skip_permission_denied;
+		for (auto& entry : recursive_directory_iterator {root, options, errc})
+		{
+			if (entry.is_directory())
+			{
+				add_dir(entry.path());
+			}
+		}
+	}
+
+	/**
+	 * Watches a single file. Its directory is watched rather than the file itself, so
+	 * editors that replace the file on save are still noticed.
+	 */
+	void add_file(const std::filesystem::path& file)
+	{
+		add_dir(file.parent_path(), file.filename().string());
+	}
+
+	/**
+	 * Blocks until a file changes, then waits for `quiet` to pass without further
+	 * changes, so saving several files at once only counts once. Returns the first
+	 * file that changed.
+	 */
+	std::filesystem::path wait(std::chrono::milliseconds quiet)
+	{
+		auto changed = read_events(-1);
+		while (changed.empty())
+		{
+			changed = read_events(-1);
+		}
+
+		while (!read_events(static_cast<int>(quiet.count())).empty())
+		{
+		}
+
+		return changed;
+	}
+private:
+	void add_dir(const std::filesystem::path& dir, std::optional<std::string> only = {})
+	{
+		int wd = inotify_add_watch(fd, dir.c_str(), EVENTS);
+		if (wd != -1)
+		{
+			watches[wd] = Watch {.dir = dir, .only = std::move(only)};
+		}
+	}
+
+	/**
+	 * Reads the pending events, waiting up to `timeout` milliseconds for some. Returns
+	 * the first file that changed, or an empty path if none did.
+	 */
+	std::filesystem::path read_events(int timeout)
+	{
+		pollfd pfd {.fd = fd, .events = POLLIN, .revents = 0};
+		if (poll(&pfd, 1, timeout) <= 0)
+		{
+			return {};
+		}
+
+		alignas(inotify_event) std::array<char, 4096> buffer;
+		auto size = read(fd, buffer.data(), buffer.size());
+		if (size <= 0)
+		{
+			return {};
+		}
+
+		std::filesystem::path changed;
+		for (std::size_t pos = 0; pos < static_cast<std::size_t>(size);)
+		{
+			auto *event = reinterpret_cast<const inotify_event *>(buffer.data() + pos);
+			pos += sizeof(inotify_event) + event->len;
+
+			auto it = watches.find(event->wd);
+			if (it == watches.end() || event->len == 0)
+			{
+				continue;
+			}
+
+			// Editors' swap and backup files aren't sources
+			std::string_view name {event->name};
+			auto& watch = it->second;
+			if (name.starts_with('.') || name.ends_with('~') ||
+				(watch.only && name != *watch.only))
+			{
+				continue;
+			}
+
+			auto file = watch.dir / name;
+			if ((event->mask & IN_ISDIR) != 0 && (event->mask & IN_CREATE) != 0)
+			{
+				add_tree(file);
+			}
+
+			if (changed.empty())
+			{
+				changed = std::move(file);
+			}
+		}
+
+		return changed;
+	}
+};
+
+void exec_watch(const WatchOptions& opts)
+{
+	using namespace std::filesystem;
+
+	auto cwd = current_path();
+	GlobalContext gctx {cwd};
+	Workspace ws {cwd / "Freight.toml", gctx};
+	auto& package = ws.current();
+
+	Watcher watcher;
+	for (auto dir : {"src", "tests", "benches", "include"})
+	{
+		if (is_directory(package.root() / dir))
+		{
+			watcher.add_tree(package.root() / dir);
+		}
+	}
+
+	// Headers and libraries of path dependencies are part of the build too
+	auto features = resolve_features(ws, package, FeatureSelection {});
+	for (auto *dependency : ws.dependencies(package, features))
+	{
+		for (auto dir : {"src", "include"})
+		{
+			if (is_directory(dependency->root() / dir))
+			{
+				watcher.add_tree(dependency->root() / dir);
+			}
+		}
+	}
+
+	// Watching the whole package root would pick up every write to `target/`
+	watcher.add_file(package.manifest_path());
+	if (auto script = package.build_script())
+	{
+		watcher.add_file(*script);
+	}
+
+	// Rerunning Freight itself picks up manifest changes and keeps a failing command
+	// from taking the watcher down with it
+	ProcessBuilder pb {read_symlink("/proc/self/exe")};
+	pb.set_name("freight");
+	for (auto& arg : opts.command)
+	{
+		pb.add_arg(arg);
+	}
+
+	static constexpr std::chrono::milliseconds QUIET_PERIOD {50};
+	while (true)
+	{
+		pb.start();
+
+		print_status("  Waiting", "for changes in `{}`", package.root().string());
+		auto changed = watcher.wait(QUIET_PERIOD);
+		print_status("  Changed", "{}", relative(changed, cwd).string());
+	}
+}
@@ -2,27 +2,33 @@
 
 #include "Workspace.h"
 
-#include <cstring>
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <expected>
 #include <filesystem>
-#include <gsl/zstring>
+#include <functional>
 #include <optional>
 #include <string>
 #include <sys/stat.h>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-#include "Toml.h"
+#include "Features.h"
+#include "Lockfile.h"
+#include "ManifestSnapshot.h"
+#include "Registry.h"
+#include "Support/Hash.h"
 #include "Support/Util.h"
+#include "Toml.h"
+#include "Toolchain.h"
 
 static bool is_real_cpp_file(const std::filesystem::path file)
 {
 	return std::filesystem::is_regular_file(file) && file.extension() == ".cpp";
 }
 
-template<class T>
-using CollectResult = std::expected<std::vector<T>, std::filesystem::directory_entry>;
-
 static CollectResult<std::filesystem::path> collect_target_sources(
 	const std::filesystem::path& dir)
 {
@@ -41,6 +47,8 @@ static CollectResult<std::filesystem::path> collect_target_sources(
 		}
 	}
 
+	// Directories are listed in no particular order, but link order has to be stable
+	std::ranges::sort(paths);
 	return paths;
 }
 
@@ -69,10 +77,34 @@ static CollectResult<Target> infer_binary_targets(const std::filesystem::path& d
 		}
 	}
 
+	std::ranges::sort(targets, {}, &Target::name);
+	return targets;
+}
+
+/**
+ * Infers targets of `kind` from a directory laid out like `src/bin`, such as `tests/`.
+ */
+static CollectResult<Target> infer_auxiliary_targets(const std::filesystem::path& dir,
+	TargetKind kind)
+{
+	if (!std::filesystem::is_directory(dir))
+	{
+		return std::vector<Target> {};
+	}
+
+	auto targets = infer_binary_targets(dir);
+	if (targets)
+	{
+		for (auto& target : *targets)
+		{
+			target.kind = kind;
+		}
+	}
+
 	return targets;
 }
 
-static CollectResult<Target> infer_targets(GlobalContext& gctx,
+CollectResult<Target> infer_targets(const std::filesystem::path& root,
 	const std::string& packageName)
 {
 	using namespace std::filesystem;
@@ -80,7 +112,7 @@ static CollectResult<Target> infer_targets(GlobalContext& gctx,
 	std::vector<Target> targets;
 	std::vector<path> mainTargetPaths;
 
-	for (auto& entry : directory_iterator(gctx.cwd() / "src"))
+	for (auto& entry : directory_iterator(root / "src"))
 	{
 		if (is_real_cpp_file(entry))
 		{
@@ -98,6 +130,12 @@ static CollectResult<Target> infer_targets(GlobalContext& gctx,
 
 				ranges::move_back_range(targets, *binaryTargets);
 			}
+			else if (entry.path().filename() == "lib")
+			{
+				targets.emplace_back(packageName,
+					std::vector {entry.path()},
+					TargetKind::Lib);
+			}
 			else
 			{
 				mainTargetPaths.push_back(entry);
@@ -105,6 +143,7 @@ static CollectResult<Target> infer_targets(GlobalContext& gctx,
 		}
 	}
 
+	std::ranges::sort(mainTargetPaths);
 	if (!mainTargetPaths.empty())
 	{
 		targets.emplace_back(packageName, mainTargetPaths);
@@ -188,7 +227,291 @@ static std::optional<Standard> parse_standard(std::string_view standard)
 	}
 }
 
-static Manifest read_manifest(GlobalContext& gctx,
+static std::optional<SplitDebugInfo> parse_split_debuginfo(std::string_view value)
+{
+	if (value == "off")
+	{
+		return SplitDebugInfo::Off;
+	}
+	else if (value == "unpacked")
+	{
+		return SplitDebugInfo::Unpacked;
+	}
+	else if (value == "packed")
+	{
+		return SplitDebugInfo::Packed;
+	}
+	else
+	{
+		return {};
+	}
+}
+
+static std::optional<DebugCompression> parse_debug_compression(std::string_view value)
+{
+	if (value == "none")
+	{
+		return DebugCompression::None;
+	}
+	else if (value == "zlib")
+	{
+		return DebugCompression::Zlib;
+	}
+	else if (value == "zstd")
+	{
+		return DebugCompression::Zstd;
+	}
+	else
+	{
+		return {};
+	}
+}
+
+static void validate_profiles(ManifestReaderState& mrs, const TomlManifest& manifest)
+{
+	for (auto& [name, profile] : manifest.profile)
+	{
+		if (name != "dev" && name != "release")
+		{
+			mrs.fail(cause("unknown profile `{}`\n"
+						   "  supported profiles are `dev` and `release`",
+				name));
+		}
+
+		if (profile.splitDebugInfo && !parse_split_debuginfo(*profile.splitDebugInfo))
+		{
+			mrs.fail(std::format("{}\n\n{}",
+				cause("failed to parse the `split-debuginfo` key of `[profile.{}]`",
+					name),
+				cause("supported values are `off`, `unpacked` and `packed`, but `{}` is"
+					  " unknown",
+					*profile.splitDebugInfo)));
+		}
+
+		if (profile.debugCompression &&
+			!parse_debug_compression(*profile.debugCompression))
+		{
+			mrs.fail(std::format("{}\n\n{}",
+				cause("failed to parse the `debug-compression` key of `[profile.{}]`",
+					name),
+				cause("supported values are `none`, `zlib` and `zstd`, but `{}` is"
+					  " unknown",
+					*profile.debugCompression)));
+		}
+	}
+}
+
+/**
+ * Checks that every entry of `[features]` names a feature of the package, an optional
+ * dependency as `dep:<name>`, or a feature of a dependency as `<dependency>/<feature>`.
+ */
+static void validate_features(ManifestReaderState& mrs, const TomlManifest& manifest)
+{
+	// Feature names end up in macro names
+	auto validName = [](std::string_view name) {
+		return !name.empty() && std::ranges::all_of(name, [](char c) {
+			return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+		});
+	};
+
+	auto invalid = [&mrs](std::string_view feature, std::string_view reason) {
+		mrs.fail(cause("invalid feature `{}`\n  {}", feature, reason));
+	};
+
+	for (auto& [feature, enables] : manifest.features)
+	{
+		if (!validName(feature))
+		{
+			invalid(feature,
+				"feature names may only contain letters, digits, `_` and `-`");
+		}
+
+		for (std::string_view entry : enables)
+		{
+			auto slash = entry.find('/');
+			if (entry.starts_with("dep:"))
+			{
+				auto name = entry.substr(4);
+				auto it = manifest.dependencies.find(std::string {name});
+				if (it == manifest.dependencies.end() || !it->second.optional)
+				{
+					invalid(feature,
+						std::format("`{}` is not an optional dependency", name));
+				}
+			}
+			else if (slash != std::string_view::npos)
+			{
+				auto name = entry.substr(0, slash);
+				if (!manifest.dependencies.contains(std::string {name}) ||
+					!validName(entry.substr(slash + 1)))
+				{
+					invalid(feature,
+						std::format("`{}` is not a feature of a dependency", entry));
+				}
+			}
+			else if (!manifest.features.contains(std::string {entry}))
+			{
+				invalid(feature, std::format("`{}` is not a feature", entry));
+			}
+		}
+	}
+
+	for (auto& [name, dependency] : manifest.dependencies)
+	{
+		for (auto& feature : dependency.features)
+		{
+			if (!validName(feature))
+			{
+				mrs.fail(cause("invalid feature `{}` of dependency `{}`", feature, name));
+			}
+		}
+	}
+}
+
+std::string Variant::name() const
+{
+	std::string name;
+	auto append = [&name](std::string_view part) {
+		name += name.empty() ? "" : "-";
+		name += part;
+	};
+
+	for (auto sanitizer : sanitizers)
+	{
+		switch (sanitizer)
+		{
+		case Sanitizer::Address:
+			append("asan");
+			break;
+		case Sanitizer::Undefined:
+			append("ubsan");
+			break;
+		case Sanitizer::Thread:
+			append("tsan");
+			break;
+		case Sanitizer::Memory:
+			append("msan");
+			break;
+		case Sanitizer::Leak:
+			append("lsan");
+			break;
+		}
+	}
+
+	if (coverage)
+	{
+		append("cov");
+	}
+
+	return name;
+}
+
+Profile Profile::with_variant(Variant variant) const
+{
+	Profile profile = *this;
+	if (!variant.name().empty())
+	{
+		profile.target_subdir += std::format("-{}", variant.name());
+	}
+
+	profile.variant = std::move(variant);
+	return profile;
+}
+
+Profile Profile::with_platform(Platform platform) const
+{
+	Profile profile = *this;
+	profile.target_subdir = platform.triple / target_subdir;
+	profile.platform = std::move(platform);
+	return profile;
+}
+
+std::optional<std::filesystem::path> Package::build_script() const
+{
+	auto script = root() / "build.cpp";
+	if (!std::filesystem::is_regular_file(script))
+	{
+		return {};
+	}
+
+	return script;
+}
+
+std::string Package::version() const
+{
+	auto& package = manifest().toml().package;
+	return package && package->version ? *package->version : "0.0.0";
+}
+
+std::vector<std::filesystem::path> Package::exported_include_dirs() const
+{
+	std::vector<std::filesystem::path> dirs;
+	for (auto dir : {"include", "src/lib"})
+	{
+		if (std::filesystem::is_directory(root() / dir))
+		{
+			dirs.push_back(root() / dir);
+		}
+	}
+
+	return dirs;
+}
+
+Platform Package::platform(const std::string& triple) const
+{
+	Platform platform;
+	platform.triple = triple;
+
+	auto& targets = manifest().toml().target;
+	auto it = targets.find(triple);
+	if (it == targets.end())
+	{
+		return platform;
+	}
+
+	auto& settings = it->second;
+	if (settings.sysroot)
+	{
+		platform.sysroot = root() / *settings.sysroot;
+	}
+
+	// Bare names are looked up in `PATH` by clang
+	if (settings.linker)
+	{
+		auto linker = std::filesystem::path {*settings.linker};
+		platform.linker = linker.has_parent_path() ? root() / linker : linker;
+	}
+
+	platform.flags = settings.flags;
+	platform.linkFlags = settings.linkFlags;
+	return platform;
+}
+
+Profile Manifest::profile(Profile base) const
+{
+	// Values were validated when the manifest was read
+	auto it = toml_.profile.find(base.name);
+	if (it == toml_.profile.end())
+	{
+		return base;
+	}
+
+	auto& overrides = it->second;
+	if (overrides.splitDebugInfo)
+	{
+		base.splitDebugInfo = parse_split_debuginfo(*overrides.splitDebugInfo).value();
+	}
+
+	if (overrides.debugCompression)
+	{
+		base.debugCompression =
+			parse_debug_compression(*overrides.debugCompression).value();
+	}
+
+	return base;
+}
+
+Manifest read_manifest(GlobalContext& gctx,
 	const std::filesystem::path& manifestPath)
 {
 	TomlManifest tomlManifest = serialize_toml(manifestPath);
@@ -233,7 +556,7 @@ static Manifest read_manifest(GlobalContext& gctx,
 	}
 	else
 	{
-		auto inferredTargets = infer_targets(gctx, packageName);
+		auto inferredTargets = infer_targets(manifestPath.parent_path(), packageName);
 		if (!inferredTargets)
 		{
 			bail("source file `{}` is not a regular file",
@@ -251,6 +574,25 @@ static Manifest read_manifest(GlobalContext& gctx,
 				  " [[bin]] section must be present"));
 	}
 
+	static constexpr std::array AUXILIARY_TARGET_DIRS = {
+		std::pair {"tests", TargetKind::Test},
+		std::pair {"benches", TargetKind::Bench},
+	};
+
+	for (auto [dir, kind] : AUXILIARY_TARGET_DIRS)
+	{
+		auto auxiliaryTargets = infer_auxiliary_targets(manifestPath.parent_path() / dir, kind);
+		if (!auxiliaryTargets)
+		{
+			bail("source file `{}` is not a regular file",
+				auxiliaryTargets.error().path().string());
+		}
+
+		ranges::move_back_range(targets, *auxiliaryTargets);
+	}
+
+	validate_profiles(mrs, tomlManifest);
+
 	Standard standard {};
 	if (tomlManifest.package && tomlManifest.package->standard)
 	{
@@ -274,7 +616,55 @@ static Manifest read_manifest(GlobalContext& gctx,
 		standard = Standard::CXX23;
 	}
 
-	return Manifest {std::move(tomlManifest), packageName, std::move(targets), standard};
+	std::vector<Dependency> dependencies;
+	for (auto& [name, dependency] : tomlManifest.dependencies)
+	{
+		// A path takes precedence, the version only matters to the registry
+		if (dependency.path)
+		{
+			auto manifest = manifestPath.parent_path() / *dependency.path / "Freight.toml";
+			dependencies.push_back({
+				.name = name,
+				.manifest = manifest.lexically_normal(),
+				.version = {},
+				.optional = dependency.optional,
+				.features = dependency.features,
+				.defaultFeatures = dependency.defaultFeatures,
+			});
+		}
+		else if (dependency.version)
+		{
+			if (!version_requirement_valid(*dependency.version))
+			{
+				mrs.fail(cause("invalid version requirement `{}` for dependency `{}`",
+					*dependency.version,
+					name));
+			}
+
+			dependencies.push_back({
+				.name = name,
+				.manifest = {},
+				.version = dependency.version,
+				.optional = dependency.optional,
+				.features = dependency.features,
+				.defaultFeatures = dependency.defaultFeatures,
+			});
+		}
+		else
+		{
+			mrs.fail(cause("dependency `{}` has neither a `path` nor a `version`", name));
+		}
+	}
+
+	validate_features(mrs, tomlManifest);
+
+	return Manifest {
+		std::move(tomlManifest),
+		packageName,
+		std::move(targets),
+		standard,
+		std::move(dependencies),
+	};
 }
 
 static std::optional<std::filesystem::path> find_manifest(
@@ -317,52 +707,194 @@ Workspace::Workspace(const std::filesystem::path& currentManifest, GlobalContext
 		currentManifest_ = currentManifest;
 	}
 
-	packages.emplace(currentManifest,
+	memberManifests.push_back(currentManifest_);
+}
+
+std::filesystem::path Workspace::manifest_snapshot(
+	const std::filesystem::path& manifest) const
+{
+	auto name = hash::to_hex(hash::hash_bytes(std::as_bytes(
+		std::span {manifest.native().data(), manifest.native().size()})));
+	return target_dir() / ".freight" / "manifests" / name;
+}
+
+const Package& Workspace::package(const std::filesystem::path& manifest) const
+{
+	auto& loaded = packages.container();
+	if (auto it = loaded.find(manifest); it != loaded.end())
+	{
+		return it->second;
+	}
+
+	return packages.emplace(manifest,
 		Package {
-			read_manifest(gctx, currentManifest),
-			currentManifest,
+			load_manifest(*gctx_, manifest, manifest_snapshot(manifest)),
+			manifest,
 		});
 }
 
-static std::filesystem::path search_path(const std::filesystem::path& file)
+const Package& Workspace::resolve(const Package& dependent,
+	const Dependency& dependency) const
 {
-	using namespace std::filesystem;
+	auto manifest = dependency.manifest;
+	if (manifest.empty())
+	{
+		manifest = resolve_registry_dependency(dependency);
+	}
 
-	gsl::zstring pathEnv = getenv("PATH");
-	if (!pathEnv)
+	if (!std::filesystem::exists(manifest))
 	{
-		return {};
+		bail("failed to load dependency `{}` of `{}`\n\n{}",
+			dependency.name,
+			dependent.name(),
+			cause("no manifest at `{}`", manifest.string()));
+	}
+
+	// Libraries are named after their package
+	auto& loaded = package(manifest);
+	if (loaded.name() != dependency.name)
+	{
+		bail("dependency `{}` of `{}` is named `{}` instead",
+			dependency.name,
+			dependent.name(),
+			loaded.name());
+	}
+
+	return loaded;
+}
+
+std::vector<const Package *> Workspace::dependencies(const Package& package,
+	const FeatureResolution& features) const
+{
+	// Packages on the path from `package` to the one being visited, to report cycles
+	std::vector<const Package *> path {&package};
+	// Packages map to whether all of their dependencies were visited
+	std::unordered_map<const Package *, bool> visited;
+	visited.emplace(&package, false);
+	std::vector<const Package *> order;
+
+	std::function<void(const Package&)> visit = [&](const Package& dependent) {
+		for (auto& dependency : dependent.dependencies())
+		{
+			if (dependency.optional && !features.dependency_enabled(dependent, dependency))
+			{
+				continue;
+			}
+
+			auto& loaded = resolve(dependent, dependency);
+			auto it = visited.find(&loaded);
+			if (it != visited.end() && !it->second)
+			{
+				std::string cycle;
+				for (auto *member : path)
+				{
+					cycle += std::format("`{}` -> ", member->name());
+				}
+
+				bail("cyclic package dependency\n\n{}",
+					cause("{}`{}`", cycle, dependency.name));
+			}
+			else if (it != visited.end())
+			{
+				continue;
+			}
+
+			visited.emplace(&loaded, false);
+			path.push_back(&loaded);
+			visit(loaded);
+			path.pop_back();
+			visited[&loaded] = true;
+			order.push_back(&loaded);
+		}
+	};
+
+	visit(package);
+
+	// Visited depth-first, so every package was added after the ones it depends on
+	std::ranges::reverse(order);
+	return order;
+}
+
+std::filesystem::path Workspace::resolve_registry_dependency(
+	const Dependency& dependency) const
+{
+	auto registry = Registry::from_env();
+	if (!registry)
+	{
+		bail("failed to resolve dependency `{}`\n\n{}",
+			dependency.name,
+			cause("no registry configured, set `FREIGHT_REGISTRY` to a registry "
+				  "directory or URL"));
 	}
 
-	gsl::zstring dirToken = std::strtok(pathEnv, ":");
-	while (dirToken)
+	// Every package depending on the same registry package gets the same version, so
+	// its library is only built and linked once
+	for (auto& [manifest, source] : registrySources)
 	{
-		auto joined = path(dirToken) / file;
-		if (exists(joined))
+		if (source.name != dependency.name)
 		{
-			return joined;
+			continue;
 		}
 
-		dirToken = std::strtok(nullptr, ":");
+		if (!version_matches(*dependency.version, source.version))
+		{
+			bail("failed to resolve dependency `{}`\n\n{}",
+				dependency.name,
+				cause("`{}` is required, but version {} was already selected",
+					*dependency.version,
+					source.version));
+		}
+
+		return manifest;
 	}
 
-	return {};
+	const LockedPackage *locked = nullptr;
+	auto lockfile = Lockfile::load(lockfile_path());
+	auto *entry = lockfile ? lockfile->find(dependency.name) : nullptr;
+	if (entry && entry->source == std::format("registry+{}", registry->location()))
+	{
+		locked = entry;
+	}
+
+	auto resolved =
+		resolve_package(*registry, dependency.name, *dependency.version, locked);
+	registrySources.insert_or_assign(resolved.manifest, std::move(resolved.source));
+	return resolved.manifest;
 }
 
-const std::filesystem::path& GlobalContext::clang_path() const
+const RegistrySource *Workspace::registry_source(const Package& package) const
 {
-	static std::filesystem::path cachedPath;
+	auto it = registrySources.find(package.manifest_path());
+	return it != registrySources.end() ? &it->second : nullptr;
+}
 
-	if (!compilerPath.empty())
+const Toolchain& Workspace::toolchain() const
+{
+	if (!toolchain_)
 	{
-		cachedPath.clear();
-		return compilerPath;
+		auto& clang = gctx_->clang_path();
+		if (clang.empty())
+		{
+			bail("could not find `clang++` in `PATH`");
+		}
+
+		// Toolchains are cached per compiler, so switching between them doesn't reprobe
+		hash::Hasher hasher;
+		hasher.update(clang.native());
+		auto cacheFile = target_dir() / ".freight" /
+						 std::format("toolchain-{}.json", hash::to_hex(hasher.finish()));
+		toolchain_ = load_toolchain(clang, cacheFile);
 	}
 
-	if (cachedPath.empty())
+	return *toolchain_;
+}
+
+const std::filesystem::path& GlobalContext::clang_path() const
+{
+	if (compilerPath.empty())
 	{
-		cachedPath = search_path("clang++");
+		compilerPath = search_path("clang++");
 	}
 
-	return cachedPath;
-}
\ No newline at end of file
+	return compilerPath;
+}
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <expected>
 #include <filesystem>
+#include <map>
+#include <optional>
 #include <ranges>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "Support/Sha256.h"
 #include "Toml.h"
+#include "Toolchain.h"
 
 enum class OptLevel
 {
@@ -33,6 +39,67 @@ enum class Standard
 	CXX23,
 };
 
+enum class SplitDebugInfo
+{
+	// Debug info is linked into the binary
+	Off,
+	// Debug info stays in a `.dwo` file next to each object, and the linker never
+	// reads it
+	Unpacked,
+	// Like `Unpacked`, but the `.dwo` files are then packaged into a `.dwp` file next
+	// to the binary
+	Packed,
+};
+
+enum class DebugCompression
+{
+	None,
+	Zlib,
+	Zstd,
+};
+
+/**
+ * A target triple to cross-compile for, with the settings of its `[target.<triple>]`
+ * table.
+ */
+struct Platform
+{
+	std::string triple;
+	std::optional<std::filesystem::path> sysroot;
+	// Passed to clang with `--ld-path`
+	std::optional<std::filesystem::path> linker;
+	std::vector<std::string> flags;
+	std::vector<std::string> linkFlags;
+};
+
+enum class Sanitizer
+{
+	Address,
+	Undefined,
+	Thread,
+	Memory,
+	Leak,
+};
+
+/**
+ * An instrumented flavor of a profile. Each variant is built in its own
+ * `target/<profile>-<variant>` directory, with its own objects and fingerprints, so
+ * switching between variants never rebuilds another one.
+ */
+struct Variant
+{
+	// Sorted, without duplicates
+	std::vector<Sanitizer> sanitizers;
+	bool coverage = false;
+
+	/**
+	 * Names the variant, like `asan-ubsan-cov`. Empty for the uninstrumented variant.
+	 */
+	std::string name() const;
+
+	bool operator==(const Variant&) const = default;
+};
+
 struct Profile
 {
 	std::string name;
@@ -43,6 +110,11 @@ struct Profile
 	// If false, defines the `NDEBUG` macro
 	bool debug_assertions = true;
 	bool incremental;
+	SplitDebugInfo splitDebugInfo = SplitDebugInfo::Off;
+	DebugCompression debugCompression = DebugCompression::None;
+	Variant variant {};
+	// Only set when cross-compiling
+	std::optional<Platform> platform {};
 
 	static Profile dev()
 	{
@@ -56,6 +128,16 @@ struct Profile
 		};
 	}
 
+	/**
+	 * This profile built as `variant`, in its own subdirectory of `target/`.
+	 */
+	Profile with_variant(Variant variant) const;
+
+	/**
+	 * This profile cross-compiled for `platform`, in `target/<triple>/`.
+	 */
+	Profile with_platform(Platform platform) const;
+
 	static Profile release()
 	{
 		return {
@@ -69,10 +151,61 @@ struct Profile
 	}
 };
 
+enum class TargetKind
+{
+	// A binary in `src/` or `src/bin/`
+	Bin,
+	// An integration test in `tests/`
+	Test,
+	// A benchmark in `benches/`, always built with the release profile
+	Bench,
+	// The library in `src/lib/`, archived and linked into every other target of its
+	// package
+	Lib,
+};
+
 struct Target
 {
 	std::string name;
 	std::vector<std::filesystem::path> paths;
+	TargetKind kind = TargetKind::Bin;
+};
+
+struct FeatureResolution;
+
+/**
+ * A package from the `[dependencies]` table, whose library is linked into every target
+ * of the package depending on it.
+ */
+struct Dependency
+{
+	std::string name;
+	// Resolved against the root of the depending package. Empty for dependencies
+	// from the registry, which are only located once they are resolved.
+	std::filesystem::path manifest;
+	// The versions of a registry dependency that can be used, like `10.2`
+	std::optional<std::string> version;
+	// Only built once a feature of the depending package enables it with `dep:<name>`
+	bool optional = false;
+	// Features of the dependency to enable, on top of its default ones unless
+	// `defaultFeatures` is false
+	std::vector<std::string> features;
+	bool defaultFeatures = true;
+};
+
+/**
+ * Where a package resolved from a registry came from.
+ */
+struct RegistrySource
+{
+	std::string name;
+	std::string version;
+	// The directory or URL of the registry
+	std::string registry;
+	// SHA-256 of the source archive
+	sha256::Digest checksum {};
+	// SHA-256 of the prebuilt libraries of the version, by artifact key
+	std::map<std::string, sha256::Digest> artifacts;
 };
 
 class Manifest
@@ -81,11 +214,13 @@ public:
 	Manifest(TomlManifest&& toml,
 		const std::string& name,
 		std::vector<Target>&& targets,
-		Standard standard)
+		Standard standard,
+		std::vector<Dependency>&& dependencies)
 		: toml_ {std::move(toml)},
 		  name_ {name},
 		  targets_ {std::move(targets)},
-		  standard_ {standard}
+		  standard_ {standard},
+		  dependencies_ {std::move(dependencies)}
 	{
 	}
 
@@ -99,7 +234,7 @@ public:
 		return targets_;
 	}
 
-	const TomlManifest& toml()
+	const TomlManifest& toml() const
 	{
 		return toml_;
 	}
@@ -108,11 +243,31 @@ public:
 	{
 		return standard_;
 	}
+
+	std::span<const Dependency> dependencies() const
+	{
+		return dependencies_;
+	}
+
+	/**
+	 * The `[features]` table: the features, dependencies and features of dependencies
+	 * each feature enables.
+	 */
+	const std::map<std::string, std::vector<std::string>>& features() const
+	{
+		return toml().features;
+	}
+
+	/**
+	 * Applies the settings of the `[profile.<name>]` table matching `base`, if any.
+	 */
+	Profile profile(Profile base) const;
 private:
 	TomlManifest toml_;
 	std::string name_;
 	std::vector<Target> targets_;
 	Standard standard_;
+	std::vector<Dependency> dependencies_;
 };
 
 class Package
@@ -153,6 +308,34 @@ public:
 	{
 		return manifest().standard();
 	}
+
+	/**
+	 * The `version` key of `[package]`, `0.0.0` if there is none.
+	 */
+	std::string version() const;
+
+	std::span<const Dependency> dependencies() const
+	{
+		return manifest().dependencies();
+	}
+
+	/**
+	 * The directories packages depending on this one get on their include path:
+	 * `include/` and `src/lib/`, if they exist.
+	 */
+	std::vector<std::filesystem::path> exported_include_dirs() const;
+
+	/**
+	 * The settings for cross-compiling to `triple`, from its `[target.<triple>]` table
+	 * if there is one. Relative paths are resolved against the package root.
+	 */
+	Platform platform(const std::string& triple) const;
+
+	/**
+	 * The build script compiled and run before the package, `build.cpp` in the package
+	 * root, if there is one.
+	 */
+	std::optional<std::filesystem::path> build_script() const;
 private:
 	Manifest manifest_;
 	std::filesystem::path manifestPath;
@@ -162,7 +345,8 @@ class GlobalContext
 {
 private:
 	std::filesystem::path cwd_;
-	std::filesystem::path compilerPath;
+	// Resolved from `PATH` on first use unless overridden
+	mutable std::filesystem::path compilerPath;
 public:
 	GlobalContext(std::filesystem::path cwd) : cwd_ {std::move(cwd)}
 	{
@@ -173,9 +357,32 @@ public:
 		return cwd_;
 	}
 
+	/**
+	 * The compiler to build with, or an empty path if there is none in `PATH`.
+	 */
 	const std::filesystem::path& clang_path() const;
+
+	/**
+	 * Overrides the compiler found in `PATH`.
+	 */
+	void set_clang_path(std::filesystem::path path)
+	{
+		compilerPath = std::move(path);
+	}
 };
 
+template<class T>
+using CollectResult = std::expected<std::vector<T>, std::filesystem::directory_entry>;
+
+/**
+ * Infers the binary and library targets of the package at `root` from the layout of
+ * `src/`. On failure, returns the entry that isn't a source file or directory.
+ */
+CollectResult<Target> infer_targets(const std::filesystem::path& root,
+	const std::string& packageName);
+
+Manifest read_manifest(GlobalContext& gctx, const std::filesystem::path& manifestPath);
+
 class Packages
 {
 private:
@@ -225,7 +432,12 @@ private:
 	std::optional<std::filesystem::path> rootManifest;
 	std::optional<std::filesystem::path> targetDir;
 	std::optional<std::filesystem::path> objectDir;
-	Packages packages;
+	std::vector<std::filesystem::path> memberManifests;
+	// Members are only loaded once a command asks for them
+	mutable Packages packages;
+	mutable std::optional<Toolchain> toolchain_;
+	// Packages resolved from the registry, by manifest
+	mutable std::unordered_map<std::filesystem::path, RegistrySource> registrySources;
 
 	Workspace(GlobalContext& gctx,
 		std::filesystem::path&& current_manifest,
@@ -241,6 +453,14 @@ private:
 		  packages {std::move(packages)}
 	{
 	}
+
+	std::filesystem::path manifest_snapshot(const std::filesystem::path& manifest) const;
+
+	/**
+	 * Resolves `dependency` against the registry, preferring the version in the
+	 * lockfile, and returns the manifest of the downloaded package.
+	 */
+	std::filesystem::path resolve_registry_dependency(const Dependency& dependency) const;
 public:
 	Workspace(const std::filesystem::path& current_manifest, GlobalContext& gctx);
 
@@ -271,13 +491,66 @@ public:
 		return objectDir.value_or(target_dir());
 	}
 
+	/**
+	 * Overrides where profiles' artifacts and objects are placed. Caches shared by
+	 * every build stay in `target_dir()`.
+	 */
+	void set_build_dir(std::filesystem::path dir)
+	{
+		objectDir = std::move(dir);
+	}
+
+	/**
+	 * Returns the package whose manifest is at `manifest`, loading it if this is the
+	 * first time it's needed. Not thread-safe.
+	 */
+	const Package& package(const std::filesystem::path& manifest) const;
+
+	/**
+	 * Loads every member of the workspace. Prefer `current()` when other members aren't
+	 * needed.
+	 */
 	auto members() const
 	{
-		return std::views::values(packages.container());
+		return memberManifests |
+			   std::views::transform([this](auto& manifest) -> const Package& {
+				   return package(manifest);
+			   });
 	}
 
 	const Package& current() const
 	{
-		return packages[currentManifest_];
+		return package(currentManifest_);
 	}
+
+	/**
+	 * The package `dependency` of `dependent` refers to, resolving it against the
+	 * registry and loading it as needed. Not thread-safe.
+	 */
+	const Package& resolve(const Package& dependent, const Dependency& dependency) const;
+
+	/**
+	 * Every package `package` depends on, directly or not, loading them as needed.
+	 * Optional dependencies are left out unless `features` enabled them. Packages come
+	 * before the packages they depend on, which is the order static libraries are
+	 * linked in. Not thread-safe.
+	 */
+	std::vector<const Package *> dependencies(const Package& package,
+		const FeatureResolution& features) const;
+
+	std::filesystem::path lockfile_path() const
+	{
+		return root() / "Freight.lock";
+	}
+
+	/**
+	 * Where `package` came from, if it was resolved from a registry by `dependencies()`.
+	 */
+	const RegistrySource *registry_source(const Package& package) const;
+
+	/**
+	 * The toolchain of `gctx().clang_path()`, probed on first use or loaded from
+	 * `target/`. Not thread-safe, so it should be loaded before starting any jobs.
+	 */
+	const Toolchain& toolchain() const;
 };
\ No newline at end of file